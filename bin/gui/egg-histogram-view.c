@@ -17,6 +17,7 @@
 
 #include <math.h>
 #include "egg-histogram-view.h"
+#include "uca-statistics.h"
 
 G_DEFINE_TYPE (EggHistogramView, egg_histogram_view, GTK_TYPE_DRAWING_AREA)
 
@@ -33,7 +34,8 @@ struct _EggHistogramViewPrivate
 
     /* This could be moved into a real histogram class */
     guint n_bins;
-    gint *bins;
+    guint32 *bins;
+    UcaStatistics stats;
     /* gdouble *grabbed; */
     enum {
         GRAB_MIN,
@@ -44,8 +46,8 @@ struct _EggHistogramViewPrivate
     gdouble min_value;    /* lowest value of the first bin */
     gdouble max_value;    /* highest value of the last bin */
 
-    gint     n_elements;
-    gint     n_bits;
+    gsize    n_elements;
+    guint    n_threads;
 };
 
 enum
@@ -78,9 +80,8 @@ egg_histogram_view_new (guint n_elements,
     view = EGG_HISTOGRAM_VIEW (g_object_new (EGG_TYPE_HISTOGRAM_VIEW, NULL));
     priv = view->priv;
 
-    priv->bins = g_malloc0 (n_bins * sizeof (guint));
+    priv->bins = g_malloc0 (n_bins * sizeof (guint32));
     priv->n_bins = n_bins;
-    priv->n_bits = n_bits;
     priv->n_elements = n_elements;
 
     priv->min_value = 0.0;
@@ -92,37 +93,37 @@ egg_histogram_view_new (guint n_elements,
 void
 egg_histogram_view_update (EggHistogramView *view,
                            gpointer buffer)
+{
+    g_return_if_fail (EGG_IS_HISTOGRAM_VIEW (view));
+    egg_histogram_view_update_region (view, buffer, view->priv->n_elements, 1, view->priv->n_elements);
+}
+
+void
+egg_histogram_view_update_region (EggHistogramView *view,
+                                  gpointer buffer,
+                                  guint width,
+                                  guint height,
+                                  guint stride)
 {
     EggHistogramViewPrivate *priv;
-    guint n_bins;
+    guint pixel_size;
+    guint shift;
 
     g_return_if_fail (EGG_IS_HISTOGRAM_VIEW (view));
     priv = view->priv;
-    n_bins = priv->n_bins - 1;
-
-    for (guint i = 0; i < priv->n_bins; i++)
-        priv->bins[i] = 0;
-
-    if (priv->n_bits == 8) {
-        guint8 *data = (guint8 *) buffer;
-
-        for (guint i = 0; i < priv->n_elements; i++) {
-            guint8 v = data[i];
-
-            guint index = (guint) round (((gdouble) v) / priv->max * n_bins);
-            priv->bins[index]++;
-        }
-    }
-    else {
-        guint16 *data = (guint16 *) buffer;
+    pixel_size = priv->max > G_MAXUINT8 ? 2 : 1;
+    shift = uca_statistics_get_shift ((guint) priv->max, priv->n_bins);
 
-        for (guint i = 0; i < priv->n_elements; i++) {
-            guint16 v = data[i];
+    uca_statistics_compute_region (&priv->stats, priv->bins, priv->n_bins, shift,
+                                   buffer, width, height, stride, pixel_size, priv->n_threads);
+}
 
-            guint index = (guint) floor (((gdouble ) v) / priv->max * n_bins);
-            priv->bins[index]++;
-        }
-    }
+void
+egg_histogram_view_get_statistics (EggHistogramView *view,
+                                   UcaStatistics *stats)
+{
+    g_return_if_fail (EGG_IS_HISTOGRAM_VIEW (view));
+    *stats = view->priv->stats;
 }
 
 void
@@ -146,6 +147,14 @@ egg_histogram_view_set_max (EggHistogramView *view,
     view->priv->max = max;
 }
 
+void
+egg_histogram_view_set_n_elements (EggHistogramView *view,
+                                   gsize n_elements)
+{
+    g_return_if_fail (EGG_IS_HISTOGRAM_VIEW (view));
+    view->priv->n_elements = n_elements;
+}
+
 static void
 set_cursor_type (EggHistogramView *view, GdkCursorType cursor_type)
 {
@@ -175,7 +184,7 @@ draw_bins (EggHistogramViewPrivate *priv,
     gdouble skip = ((gdouble) width) / priv->n_bins;
     gdouble x = BORDER;
     gdouble ys = height + BORDER - 1;
-    gint max_value = 0;
+    guint32 max_value = 0;
 
     for (guint i = 0; i < priv->n_bins; i++) {
         if (priv->bins[i] > max_value)
@@ -517,6 +526,7 @@ egg_histogram_view_init (EggHistogramView *view)
     priv->bins = NULL;
     priv->n_bins = 0;
     priv->n_elements = 0;
+    priv->n_threads = g_get_num_processors ();
     priv->min_value = 0;
     priv->max_value = 256;
 
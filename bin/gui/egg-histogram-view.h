@@ -19,6 +19,7 @@
 #define EGG_HISTOGRAM_VIEW_H
 
 #include <gtk/gtk.h>
+#include "uca-statistics.h"
 
 G_BEGIN_DECLS
 
@@ -55,11 +56,23 @@ GtkWidget   * egg_histogram_view_new      (guint             n_elements,
                                            guint             n_bins);
 void          egg_histogram_view_update   (EggHistogramView *view,
                                            gpointer          data);
+void          egg_histogram_view_update_region
+                                          (EggHistogramView *view,
+                                           gpointer          data,
+                                           guint             width,
+                                           guint             height,
+                                           guint             stride);
+void          egg_histogram_view_get_statistics
+                                          (EggHistogramView *view,
+                                           UcaStatistics    *stats);
 void          egg_histogram_get_range     (EggHistogramView *view,
                                            gdouble          *min,
                                            gdouble          *max);
 void          egg_histogram_view_set_max  (EggHistogramView *view,
                                            guint             max);
+void          egg_histogram_view_set_n_elements
+                                          (EggHistogramView *view,
+                                           gsize             n_elements);
 
 G_END_DECLS
 
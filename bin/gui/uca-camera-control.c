@@ -23,9 +23,14 @@
 #include <cairo.h>
 #include <string.h>
 
+#ifdef HAVE_LIBTIFF
+#include <tiffio.h>
+#endif
+
 #include "uca-camera.h"
 #include "uca-plugin-manager.h"
 #include "uca-ring-buffer.h"
+#include "uca-statistics.h"
 #include "egg-property-tree-view.h"
 #include "egg-histogram-view.h"
 #include "resources.h"
@@ -33,9 +38,64 @@
 typedef enum {
     IDLE,
     RUNNING,
-    RECORDING
+    RECORDING,
+    FLUSHING
 } State;
 
+#define MAILBOX_INDEX   3
+#define MAILBOX_FRESH   4
+
+/* Redraw the preview at about the refresh rate of common displays */
+#define RENDER_INTERVAL 16
+
+/*
+ * Triple buffer handing the newest frame from the acquisition thread to the
+ * render timeout. The acquisition thread fills back and the renderer shows
+ * front. Either swaps its buffer with the middle one, whose index is kept
+ * together with a flag telling if it holds an unseen frame in one atomic
+ * integer.
+ */
+typedef struct {
+    guchar  *frames[3];
+    gint     back;
+    gint     front;
+    gint     middle;
+    gint     n_acquired;
+    gint     n_skipped;
+} Mailbox;
+
+/* Update interval of the recording status in milliseconds */
+#define STREAM_STATUS_INTERVAL  500
+
+/*
+ * Recording to disk: the record thread queues frames in the ring buffer and a
+ * writer thread drains it to a raw or multi-page TIFF file, so that the length
+ * of a recording is limited by the disk instead of memory. If the disk cannot
+ * keep up, frames are dropped instead of stalling the camera. Counters are
+ * accessed atomically by the status timeout.
+ */
+typedef struct {
+    gchar       *filename;
+    guint        width;
+    guint        height;
+    guint        pixel_size;
+    gpointer     scratch;
+    GThread     *thread;
+    GMutex       lock;
+    GCond        cond;
+    gboolean     done;
+    gint         failed;
+    gint         n_queued;
+    gint         n_written;
+    gint         n_dropped;
+    gsize        size;
+    gint64       started;
+    gint64       last_report;
+    gint         n_reported;
+    guint        status_source;
+    GError      *error;
+} Stream;
+
 typedef struct {
     UcaCamera   *camera;
     GtkWidget   *main_window;
@@ -44,6 +104,7 @@ typedef struct {
     GtkWidget   *start_button;
     GtkWidget   *stop_button;
     GtkWidget   *record_button;
+    GtkWidget   *record_to_disk_item;
     GtkWidget   *download_button;
     GtkWidget   *zoom_in_button;
     GtkWidget   *zoom_out_button;
@@ -81,7 +142,6 @@ typedef struct {
     GtkToggleButton *histogram_button;
     GtkToggleButton *log_button;
     UcaRingBuffer   *buffer;
-    guchar          *shadow;
     guchar          *pixels;
     cairo_t         *cr;
     State           state;
@@ -113,6 +173,35 @@ typedef struct {
     gdouble      zoom_before;
     gdouble      red, green, blue;
     gdouble      percent_width, percent_height;
+
+    /* Frame pixels behind the visible part of the image, see update_statistics() */
+    gint         view_x, view_y;
+    gint         view_width, view_height;
+
+    /* Display conversion tables, see update_lut() */
+    guint8      *lut;
+    gsize        lut_size;
+    gdouble      lut_min, lut_max;
+    gboolean     lut_log;
+    gint         lut_colormap;
+    guint8       palette[256 * 3];
+    guint       *columns;
+    guint8      *row;
+    gint         n_columns;
+
+    GtkStatusbar *statusbar;
+    guint        status_context;
+
+    Mailbox      mailbox;
+    guint        render_source;
+    guint        n_displayed;
+    guint        n_reported_acquired;
+    guint        n_reported_displayed;
+    gint64       last_report;
+
+    gchar       *stream_filename;
+    Stream       stream;
+    gboolean     quit_after_flush;
 } ThreadData;
 
 static UcaPluginManager *plugin_manager;
@@ -120,20 +209,133 @@ static gsize mem_size = 2048;
 
 static void update_pixbuf (ThreadData *data, gpointer buffer);
 static void update_pixbuf_dimensions (ThreadData *data);
+static void update_current_frame (ThreadData *data);
+static void stop_acquisition (ThreadData *data);
+
+/* Display value of a pixel, log() is applied before clamping like before */
+static guint8
+map_value (gdouble value, gdouble min, gdouble factor, gboolean do_log)
+{
+    gdouble dval = (value - min) * factor;
+
+    if (do_log)
+        dval = dval > 0.0 ? log (dval) : 0.0;
+
+    return (guint8) CLAMP (dval, 0.0, 255.0);
+}
+
+static void
+fill_palette (guint8 *palette, gint colormap)
+{
+    for (gint i = 0; i < 256; i++) {
+        gfloat val = (gfloat) i;
+        gfloat red = 0;
+        gfloat green = 0;
+        gfloat blue = 0;
+
+        if (colormap == 1) {
+            red = green = blue = val;
+        }
+        else if (i == 255) {
+            red = 255;
+            green = 255;
+            blue = 255;
+        }
+        else if (i == 0) {
+        }
+        else if (val <= 31.875) {
+            blue = 255 - 4 * (31.875 - val);
+        }
+        else if (val <= 95.625) {
+            green = 255 - 4 * (95.625 - val);
+            blue = 255;
+        }
+        else if (val <= 159.375) {
+            red = 255 - 4 * (159.375 - val);
+            green = 255;
+            blue = 255 + 4 * (95.625 - val);
+        }
+        else if (val <= 223.125) {
+            red = 255;
+            green = 255 + 4 * (159.375 - val);
+        }
+        else {
+            red = 255 + 4 * (223.125 - val);
+        }
+
+        palette[3 * i + 0] = (guint8) red;
+        palette[3 * i + 1] = (guint8) green;
+        palette[3 * i + 2] = (guint8) blue;
+    }
+}
+
+/*
+ * Map every possible pixel value to its display value once, so that the
+ * conversion of a frame is a table lookup per pixel. The tables are only
+ * rebuilt when the histogram range, the log toggle or the colormap change.
+ */
+static void
+update_lut (ThreadData *data, gdouble min, gdouble max, gboolean do_log)
+{
+    gsize n_values = data->pixel_size == 1 ? 256 : 65536;
+    gdouble factor = 255.0 / (max - min);
+
+    if (data->lut != NULL && data->lut_size == n_values && data->lut_min == min &&
+        data->lut_max == max && data->lut_log == do_log && data->lut_colormap == data->colormap)
+        return;
+
+    if (data->lut_size != n_values) {
+        g_free (data->lut);
+        data->lut = g_malloc (n_values);
+        data->lut_size = n_values;
+    }
+
+    for (gsize v = 0; v < n_values; v++)
+        data->lut[v] = map_value ((gdouble) v, min, factor, do_log);
+
+    fill_palette (data->palette, data->colormap);
+
+    data->lut_min = min;
+    data->lut_max = max;
+    data->lut_log = do_log;
+    data->lut_colormap = data->colormap;
+}
+
+static void
+lookup_row_8 (guint8 *output, const guint8 *input, const guint *columns, gint n, const guint8 *lut)
+{
+    for (gint x = 0; x < n; x++)
+        output[x] = lut[input[columns[x]]];
+}
+
+static void
+lookup_row_16 (guint8 *output, const guint16 *input, const guint *columns, gint n, const guint8 *lut)
+{
+    for (gint x = 0; x < n; x++)
+        output[x] = lut[input[columns[x]]];
+}
+
+static void
+colorize_row (guint8 *output, const guint8 *input, gint n, const guint8 *palette)
+{
+    for (gint x = 0; x < n; x++) {
+        const guint8 *rgb = palette + 3 * input[x];
+
+        output[3 * x + 0] = rgb[0];
+        output[3 * x + 1] = rgb[1];
+        output[3 * x + 2] = rgb[2];
+    }
+}
 
 static void
 up_and_down_scale (ThreadData *data, gpointer buffer)
 {
     gdouble min;
     gdouble max;
-    gdouble factor;
-    gdouble dval = 0.0;
-    gboolean do_log;
     guint8 *output;
-    gint i = 0;
     gint zoom;
     gint stride;
-    gint offset = 0;
+    gint n_columns;
     gint min_x;
     gint min_y;
     gint max_x;
@@ -156,11 +358,9 @@ up_and_down_scale (ThreadData *data, gpointer buffer)
     }
 
     egg_histogram_get_range (EGG_HISTOGRAM_VIEW (data->histogram_view), &min, &max);
-    factor = 255.0 / (max - min);
     output = data->pixels;
     zoom = (gint) data->zoom_factor;
     stride = (gint) 1 / data->zoom_factor;
-    do_log = gtk_toggle_button_get_active (data->log_button);
     min_x = gtk_adjustment_get_value (data->hadjustment);
     min_y = gtk_adjustment_get_value (data->vadjustment);
     current_x = min_x;
@@ -242,183 +442,93 @@ up_and_down_scale (ThreadData *data, gpointer buffer)
 
     gtk_misc_set_alignment (GTK_MISC(data->image), data->percent_width, data->percent_height);
 
-    if (data->pixel_size == 1) {
-        guint8 *input = (guint8 *) buffer;
-        for (gint y = min_y; y < max_y; y++) {
-            for (gint x = min_x; x < max_x; x++) {
-                if (zoom <= 1)
-                    offset = (y * stride * data->width) + (x * stride);
-                else
-                    offset = ((gint) (y / zoom) * data->width) + ((gint) (x / zoom));
-
-                if (do_log)
-                    dval = log ((input[offset] - min) * factor);
-                else
-                    dval = (input[offset] - min) * factor;
-
-                guchar val = (guchar) CLAMP(dval, 0.0, 255.0);
-
-                if (data->colormap == 1) {
-                    output[i++] = val;
-                    output[i++] = val;
-                    output[i++] = val;
-                }
-                else {
-                    val = (float) val;
-                    float red = 0;
-                    float green = 0;
-                    float blue = 0;
-
-                    if (val == 255) {
-                        red = 255;
-                        green = 255;
-                        blue = 255;
-                    }
-                    else if (val == 0) {
-                    }
-                    else if (val <= 31.875) {
-                        blue = 255 - 4 * (31.875 - val);
-                    }
-                    else if (val <= 95.625) {
-                        green = 255 - 4 * (95.625 - val);
-                        blue = 255;
-                    }
-                    else if (val <= 159.375) {
-                        red = 255 - 4 * (159.375 - val);
-                        green = 255;
-                        blue = 255 + 4 * (95.625 - val);
-                    }
-                    else if (val <= 223.125) {
-                        red = 255;
-                        green = 255 + 4 * (159.375 - val);
-                    }
-                    else {
-                        red = 255 + 4 * (223.125 - val);
-                    }
-                    output[i++] = (guchar) red;
-                    output[i++] = (guchar) green;
-                    output[i++] = (guchar) blue;
-                }
-            }
-        }
+    if (zoom <= 1) {
+        data->view_x = min_x * stride;
+        data->view_y = min_y * stride;
+        data->view_width = (max_x - min_x) * stride;
+        data->view_height = (max_y - min_y) * stride;
     }
-    else if (data->pixel_size == 2) {
-        guint16 *input = (guint16 *) buffer;
-
-        for (gint y = min_y; y < max_y; y++) {
-            for (gint x = min_x; x < max_x; x++) {
-                if (zoom <= 1)
-                    offset = (y * stride * data->width) + (x * stride);
-                else
-                    offset = ((gint) (y / zoom) * data->width) + ((gint) (x / zoom));
-
-                if (do_log)
-                    dval = log ((input[offset] - min) * factor);
-                else
-                    dval = (input[offset] - min) * factor;
-
-                guchar val = (guchar) CLAMP(dval, 0.0, 255.0);
-
-                if (data->colormap == 1) {
-                    output[i++] = val;
-                    output[i++] = val;
-                    output[i++] = val;
-                }
-                else {
-                    val = (float) val;
-                    float red = 0;
-                    float green = 0;
-                    float blue = 0;
-
-                    if (val == 255) {
-                        red = 65535;
-                        green = 65535;
-                        blue = 65535;
-                    }
-                    else if (val == 0) {
-                    }
-                    else if (val <= 31.875) {
-                        blue = (255 - 4 * (31.875 - val)) * 257;
-                    }
-                    else if (val <= 95.625) {
-                        green = (255 - 4 * (95.625 - val)) * 257;
-                        blue = 65535;
-                    }
-                    else if (val <= 159.375) {
-                        red = (255 - 4 * (159.375 - val)) * 257;
-                        green = 65535;
-                        blue = (255 + 4 * (95.625 - val)) * 257;
-                    }
-                    else if (val <= 223.125) {
-                        red = 65535;
-                        green = (255 + 4 * (159.375 - val)) * 257;
-                    }
-                    else {
-                        red = (255 + 4 * (223.125 - val)) * 257;
-                    }
-
-                    output[i++] = (guchar) red;
-                    output[i++] = (guchar) green;
-                    output[i++] = (guchar) blue;
-                }
-            }
-        }
+    else {
+        data->view_x = min_x / zoom;
+        data->view_y = min_y / zoom;
+        data->view_width = (max_x - 1) / zoom - data->view_x + 1;
+        data->view_height = (max_y - 1) / zoom - data->view_y + 1;
     }
-}
 
-static void
-get_statistics (ThreadData *data, gdouble *mean, gdouble *sigma, guint *_max, guint *_min, gpointer buffer)
-{
-    gdouble sum = 0.0;
-    gdouble squared_sum = 0.0;
-    guint min = G_MAXUINT;
-    guint max = 0;
-    guint n = data->width * data->height;
+    if (data->pixel_size != 1 && data->pixel_size != 2)
+        return;
 
-    if (data->pixel_size == 1) {
-        guint8 *input = (guint8 *) buffer;
+    update_lut (data, min, max, gtk_toggle_button_get_active (data->log_button));
+    n_columns = MAX (max_x - min_x, 0);
 
-        for (gint i = 0; i < n; i++) {
-            guint8 val = input[i];
+    if (n_columns > data->n_columns) {
+        data->columns = g_renew (guint, data->columns, n_columns);
+        data->row = g_renew (guint8, data->row, n_columns);
+        data->n_columns = n_columns;
+    }
 
-            if (val > max)
-                max = val;
+    /* Nearest-neighbour source column of each displayed column */
+    for (gint x = min_x; x < max_x; x++)
+        data->columns[x - min_x] = zoom <= 1 ? x * stride : x / zoom;
 
-            if (val < min)
-                min = val;
+    for (gint y = min_y; y < max_y; y++) {
+        gsize row = zoom <= 1 ? y * stride : y / zoom;
 
-            sum += val;
-            squared_sum += val * val;
-        }
+        if (data->pixel_size == 1)
+            lookup_row_8 (data->row, (guint8 *) buffer + row * data->width, data->columns, n_columns, data->lut);
+        else
+            lookup_row_16 (data->row, (guint16 *) buffer + row * data->width, data->columns, n_columns, data->lut);
+
+        colorize_row (output, data->row, n_columns, data->palette);
+        output += 3 * n_columns;
+    }
+}
+
+static void
+update_statistics (ThreadData *data, gpointer buffer, guint *x, guint *y, guint *width, guint *height)
+{
+    gint from_x = CLAMP (data->view_x, 0, data->width);
+    gint from_y = CLAMP (data->view_y, 0, data->height);
+    gint to_x = CLAMP (data->view_x + data->view_width, from_x, data->width);
+    gint to_y = CLAMP (data->view_y + data->view_height, from_y, data->height);
+
+    /* Fall back to the whole frame until something has been displayed */
+    if (to_x == from_x || to_y == from_y) {
+        from_x = from_y = 0;
+        to_x = data->width;
+        to_y = data->height;
     }
-    else {
-        guint16 *input = (guint16 *) buffer;
 
-        for (gint i = 0; i < n; i++) {
-            guint16 val = input[i];
+    /* Only the visible pixels are read, which is cheap when zoomed in */
+    egg_histogram_view_update_region (EGG_HISTOGRAM_VIEW (data->histogram_view),
+                                      (guint8 *) buffer + ((gsize) from_y * data->width + from_x) * data->pixel_size,
+                                      to_x - from_x, to_y - from_y, data->width);
 
-            if (val > max)
-                max = val;
+    *x = from_x;
+    *y = from_y;
+    *width = to_x - from_x;
+    *height = to_y - from_y;
+}
 
-            if (val < min)
-                min = val;
+static void
+get_statistics (ThreadData *data, gdouble *mean, gdouble *sigma, guint *_max, guint *_min)
+{
+    UcaStatistics stats;
 
-            sum += val;
-            squared_sum += val * val;
-        }
-    }
+    /* Computed along with the histogram in the same pass over the frame */
+    egg_histogram_view_get_statistics (EGG_HISTOGRAM_VIEW (data->histogram_view), &stats);
 
     if (gtk_toggle_button_get_active (data->log_button)) {
-        *mean = log (sum/n);
-        *sigma = log (sqrt((squared_sum - sum*sum/n) / (n - 1)));
+        *mean = log (uca_statistics_get_mean (&stats));
+        *sigma = log (uca_statistics_get_sigma (&stats));
     }
     else {
-        *mean = sum / n;
-        *sigma = sqrt ((squared_sum - sum*sum/n) / (n - 1));
+        *mean = uca_statistics_get_mean (&stats);
+        *sigma = uca_statistics_get_sigma (&stats);
     }
 
-    *_min = min;
-    *_max = max;
+    *_min = stats.min;
+    *_max = stats.max;
 }
 
 static void
@@ -649,8 +759,8 @@ update_pixbuf (ThreadData *data, gpointer buffer)
     guint max;
     guint width;
     guint height;
-    guint x = 0;
-    guint y = 0;
+    guint x;
+    guint y;
     gint sub_x = 0;
     gint sub_y = 0;
     gint sub_width = 0;
@@ -684,18 +794,8 @@ update_pixbuf (ThreadData *data, gpointer buffer)
     }
     gtk_widget_queue_draw (data->image);
 
-    if (data->adj_width > 0 && data->adj_height > 0) {
-        x = data->from_x;
-        y = data->from_y;
-        width = data->pixbuf_width;
-        height = data->pixbuf_height;
-    }
-    else {
-        width = data->display_width;
-        height = data->display_height;
-    }
-
-    get_statistics (data, &mean, &sigma, &max, &min, buffer);
+    update_statistics (data, buffer, &x, &y, &width, &height);
+    get_statistics (data, &mean, &sigma, &max, &min);
 
     g_snprintf (string, 32, "\u03bc = %3.2f", mean);
     gtk_label_set_text (data->mean_label, string);
@@ -843,6 +943,8 @@ set_tool_button_state (ThreadData *data)
                               data->state == RUNNING || data->state == RECORDING);
     gtk_widget_set_sensitive (data->record_button,
                               data->state == IDLE);
+    gtk_widget_set_sensitive (data->record_to_disk_item,
+                              data->state == IDLE);
     gtk_widget_set_sensitive (data->download_button,
                               data->data_in_camram);
     gtk_widget_set_sensitive (data->acquisition_expander,
@@ -853,47 +955,391 @@ set_tool_button_state (ThreadData *data)
                               data->state == IDLE);
 }
 
+static void
+show_preview_rates (ThreadData *data, gdouble acquired, gdouble displayed, guint n_skipped)
+{
+    gchar string[128];
+
+    g_snprintf (string, 128, "Acquired: %.1f frames/s, displayed: %.1f frames/s, skipped: %u",
+                acquired, displayed, n_skipped);
+    gtk_statusbar_pop (data->statusbar, data->status_context);
+    gtk_statusbar_push (data->statusbar, data->status_context, string);
+}
+
+static void
+mailbox_init (Mailbox *mailbox, gsize size)
+{
+    for (gint i = 0; i < 3; i++)
+        mailbox->frames[i] = g_malloc0 (size);
+
+    mailbox->back = 0;
+    mailbox->middle = 1;
+    mailbox->front = 2;
+    mailbox->n_acquired = 0;
+    mailbox->n_skipped = 0;
+}
+
+static void
+mailbox_free (Mailbox *mailbox)
+{
+    for (gint i = 0; i < 3; i++) {
+        g_free (mailbox->frames[i]);
+        mailbox->frames[i] = NULL;
+    }
+}
+
+/* Swap the middle buffer for the one given, returning the old middle state */
+static gint
+mailbox_exchange (Mailbox *mailbox, gint middle)
+{
+    gint old;
+
+    do {
+        old = g_atomic_int_get (&mailbox->middle);
+    } while (!g_atomic_int_compare_and_exchange (&mailbox->middle, old, middle));
+
+    return old;
+}
+
+/* Called by the acquisition thread once the back buffer holds a new frame */
+static void
+mailbox_publish (Mailbox *mailbox)
+{
+    gint old;
+
+    old = mailbox_exchange (mailbox, mailbox->back | MAILBOX_FRESH);
+    mailbox->back = old & MAILBOX_INDEX;
+    g_atomic_int_inc (&mailbox->n_acquired);
+
+    /* The frame we replaced was never shown */
+    if (old & MAILBOX_FRESH)
+        g_atomic_int_inc (&mailbox->n_skipped);
+}
+
+/* Called by the render path, moves the newest frame to the front buffer */
+static gboolean
+mailbox_take (Mailbox *mailbox)
+{
+    if (!(g_atomic_int_get (&mailbox->middle) & MAILBOX_FRESH))
+        return FALSE;
+
+    mailbox->front = mailbox_exchange (mailbox, mailbox->front) & MAILBOX_INDEX;
+    return TRUE;
+}
+
+static gboolean
+render_preview (ThreadData *data)
+{
+    Mailbox *mailbox = &data->mailbox;
+    gint64 now;
+
+    if (mailbox_take (mailbox)) {
+        guchar *frame = mailbox->frames[mailbox->front];
+
+        up_and_down_scale (data, frame);
+        update_pixbuf (data, frame);
+
+        if ((data->ev_x >= 0) && (data->ev_y >= 0) && (data->ev_y <= data->display_height) && (data->ev_x <= data->display_width)) {
+            update_sidebar (data, frame);
+        }
+
+        data->n_displayed++;
+    }
+
+    now = g_get_monotonic_time ();
+
+    if (now - data->last_report >= G_USEC_PER_SEC) {
+        guint n_acquired = (guint) g_atomic_int_get (&mailbox->n_acquired);
+        gdouble elapsed = (now - data->last_report) / (gdouble) G_USEC_PER_SEC;
+
+        show_preview_rates (data,
+                            (n_acquired - data->n_reported_acquired) / elapsed,
+                            (data->n_displayed - data->n_reported_displayed) / elapsed,
+                            (guint) g_atomic_int_get (&mailbox->n_skipped));
+
+        data->n_reported_acquired = n_acquired;
+        data->n_reported_displayed = data->n_displayed;
+        data->last_report = now;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Grabs at the camera rate and only hands frames to the render timeout, so
+ * that slow drawing cannot slow down acquisition.
+ */
 static gpointer
 preview_frames (void *args)
 {
     ThreadData *data = (ThreadData *) args;
-    gint counter = 0;
+    Mailbox *mailbox = &data->mailbox;
+    gsize size;
+    guchar *newest;
     GError *error = NULL;
 
     data->n_recorded = 0;
-    data->shadow = g_malloc (uca_ring_buffer_get_block_size (data->buffer));
+    size = uca_ring_buffer_get_block_size (data->buffer);
+    mailbox_init (mailbox, size);
 
-    uca_camera_grab (data->camera, data->shadow, &error);
+    gdk_threads_enter ();
+    data->n_displayed = 0;
+    data->n_reported_acquired = 0;
+    data->n_reported_displayed = 0;
+    data->last_report = g_get_monotonic_time ();
+    data->render_source = gdk_threads_add_timeout (RENDER_INTERVAL, (GSourceFunc) render_preview, data);
+    gdk_threads_leave ();
 
     while (data->state == RUNNING) {
-        up_and_down_scale (data, data->shadow);
-        uca_camera_grab (data->camera, data->shadow, &error);
-
-        gdk_threads_enter ();
-
-        update_pixbuf (data, data->shadow);
-        egg_histogram_view_update (EGG_HISTOGRAM_VIEW (data->histogram_view), data->shadow);
-
-        if ((data->ev_x >= 0) && (data->ev_y >= 0) && (data->ev_y <= data->display_height) && (data->ev_x <= data->display_width)) {
-            update_sidebar (data, data->shadow);
+        if (!uca_camera_grab (data->camera, mailbox->frames[mailbox->back], &error)) {
+            print_and_free_error (&error);
+            break;
         }
 
-        gdk_threads_leave ();
-        counter++;
+        mailbox_publish (mailbox);
     }
 
-    up_and_down_scale (data, data->shadow);
+    /* The render timeout holds the GDK lock, so it is not running now */
     gdk_threads_enter ();
-    update_pixbuf (data, data->shadow);
+    g_source_remove (data->render_source);
+
+    /* Nothing was taken since the last publish if the middle buffer is fresh */
+    if (g_atomic_int_get (&mailbox->middle) & MAILBOX_FRESH)
+        newest = mailbox->frames[mailbox->middle & MAILBOX_INDEX];
+    else
+        newest = mailbox->frames[mailbox->front];
+
+    up_and_down_scale (data, newest);
+    update_pixbuf (data, newest);
     gdk_threads_leave ();
 
     gpointer buffer = uca_ring_buffer_get_write_pointer (data->buffer);
-    memcpy (buffer, data->shadow, uca_ring_buffer_get_block_size (data->buffer));
-    g_free (data->shadow);
+    memcpy (buffer, newest, size);
+    mailbox_free (mailbox);
 
     return NULL;
 }
 
+#ifdef HAVE_LIBTIFF
+static gboolean
+is_tiff_filename (const gchar *filename)
+{
+    return g_str_has_suffix (filename, ".tif") || g_str_has_suffix (filename, ".tiff");
+}
+
+static gboolean
+write_tiff_page (TIFF *tif, Stream *stream, gpointer frame, guint index)
+{
+    gsize row_size = stream->width * stream->pixel_size;
+
+    TIFFSetField (tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+    TIFFSetField (tif, TIFFTAG_IMAGEWIDTH, stream->width);
+    TIFFSetField (tif, TIFFTAG_IMAGELENGTH, stream->height);
+    TIFFSetField (tif, TIFFTAG_BITSPERSAMPLE, stream->pixel_size * 8);
+    TIFFSetField (tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+    TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize (tif, (guint32) - 1));
+    TIFFSetField (tif, TIFFTAG_PAGENUMBER, index, 0);
+
+    for (guint y = 0; y < stream->height; y++) {
+        if (TIFFWriteScanline (tif, (guint8 *) frame + y * row_size, y, 0) < 0)
+            return FALSE;
+    }
+
+    return TIFFWriteDirectory (tif) == 1;
+}
+#endif
+
+/* Returns the next queued frame or NULL once recording has finished */
+static gpointer
+stream_next_frame (Stream *stream, UcaRingBuffer *buffer)
+{
+    gpointer frame = NULL;
+
+    g_mutex_lock (&stream->lock);
+
+    while (!uca_ring_buffer_available (buffer) && !stream->done)
+        g_cond_wait (&stream->cond, &stream->lock);
+
+    if (uca_ring_buffer_available (buffer))
+        frame = uca_ring_buffer_get_read_pointer (buffer);
+
+    g_mutex_unlock (&stream->lock);
+
+    return frame;
+}
+
+static gpointer
+write_stream (ThreadData *data)
+{
+    Stream *stream = &data->stream;
+    GOutputStream *output = NULL;
+    gpointer frame;
+#ifdef HAVE_LIBTIFF
+    TIFF *tif = NULL;
+
+    if (is_tiff_filename (stream->filename)) {
+        tif = TIFFOpen (stream->filename, "w");
+
+        if (tif == NULL)
+            g_set_error (&stream->error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         "Could not open `%s'", stream->filename);
+    }
+    else
+#endif
+    {
+        GFile *file;
+
+        file = g_file_new_for_path (stream->filename);
+        output = (GOutputStream *) g_file_replace (file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION,
+                                                   NULL, &stream->error);
+        g_object_unref (file);
+    }
+
+    while (stream->error == NULL && (frame = stream_next_frame (stream, data->buffer)) != NULL) {
+#ifdef HAVE_LIBTIFF
+        if (tif != NULL) {
+            if (!write_tiff_page (tif, stream, frame, stream->n_written))
+                g_set_error (&stream->error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                             "Could not write to `%s'", stream->filename);
+        }
+        else
+#endif
+        g_output_stream_write_all (output, frame, stream->size, NULL, NULL, &stream->error);
+
+        if (stream->error == NULL)
+            g_atomic_int_inc (&stream->n_written);
+    }
+
+    /* Stops the record thread, which would otherwise fill the buffer and drop */
+    if (stream->error != NULL)
+        g_atomic_int_set (&stream->failed, TRUE);
+
+#ifdef HAVE_LIBTIFF
+    if (tif != NULL)
+        TIFFClose (tif);
+#endif
+
+    if (output != NULL) {
+        g_output_stream_close (output, NULL, stream->error == NULL ? &stream->error : NULL);
+        g_object_unref (output);
+    }
+
+    return NULL;
+}
+
+static gboolean
+show_stream_status (ThreadData *data)
+{
+    Stream *stream = &data->stream;
+    gchar string[256];
+    gint64 now;
+    gint n_written;
+    gint n_backlog;
+    gdouble rate;
+
+    now = g_get_monotonic_time ();
+    n_written = g_atomic_int_get (&stream->n_written);
+    n_backlog = g_atomic_int_get (&stream->n_queued) - n_written;
+    rate = (n_written - stream->n_reported) * (stream->size / 1024. / 1024.) / ((now - stream->last_report) / 1e6);
+
+    g_snprintf (string, 256, "Writing to %s: %.1f MB/s, backlog: %i frames (%.1f MB), dropped: %i",
+                stream->filename, rate, n_backlog, n_backlog * (stream->size / 1024. / 1024.),
+                g_atomic_int_get (&stream->n_dropped));
+    gtk_statusbar_pop (data->statusbar, data->status_context);
+    gtk_statusbar_push (data->statusbar, data->status_context, string);
+
+    stream->last_report = now;
+    stream->n_reported = n_written;
+
+    return TRUE;
+}
+
+static void
+stream_start (ThreadData *data)
+{
+    Stream *stream = &data->stream;
+
+    stream->filename = g_strdup (data->stream_filename);
+    stream->width = data->width;
+    stream->height = data->height;
+    stream->pixel_size = data->pixel_size;
+    stream->size = uca_ring_buffer_get_block_size (data->buffer);
+    stream->scratch = g_malloc (stream->size);
+    stream->done = FALSE;
+    stream->failed = FALSE;
+    stream->n_queued = 0;
+    stream->n_written = 0;
+    stream->n_dropped = 0;
+    stream->n_reported = 0;
+    stream->started = stream->last_report = g_get_monotonic_time ();
+    stream->error = NULL;
+
+    g_mutex_init (&stream->lock);
+    g_cond_init (&stream->cond);
+    stream->thread = g_thread_new ("writer", (GThreadFunc) write_stream, data);
+    stream->status_source = gdk_threads_add_timeout (STREAM_STATUS_INTERVAL, (GSourceFunc) show_stream_status, data);
+}
+
+static void
+stream_push (Stream *stream, UcaRingBuffer *buffer)
+{
+    g_mutex_lock (&stream->lock);
+    uca_ring_buffer_write_advance (buffer);
+    g_atomic_int_inc (&stream->n_queued);
+    g_cond_signal (&stream->cond);
+    g_mutex_unlock (&stream->lock);
+}
+
+static void
+stream_finish (ThreadData *data)
+{
+    Stream *stream = &data->stream;
+    gchar string[256];
+    gdouble elapsed;
+
+    g_mutex_lock (&stream->lock);
+    stream->done = TRUE;
+    g_cond_signal (&stream->cond);
+    g_mutex_unlock (&stream->lock);
+
+    /* The writer drains the backlog before it returns */
+    g_thread_join (stream->thread);
+
+    /* The writer consumed the frames, make them available for browsing and saving */
+    uca_ring_buffer_rewind (data->buffer);
+    elapsed = (g_get_monotonic_time () - stream->started) / 1e6;
+
+    if (stream->error != NULL) {
+        g_printerr ("Failed to record to disk: %s\n", stream->error->message);
+        g_snprintf (string, 256, "Recording to %s failed after %i frames: %s",
+                    stream->filename, stream->n_written, stream->error->message);
+        g_error_free (stream->error);
+        stream->error = NULL;
+    }
+    else {
+        g_snprintf (string, 256, "Wrote %i frames (%.1f MB) to %s at %.1f MB/s, dropped: %i",
+                    stream->n_written, stream->n_written * (stream->size / 1024. / 1024.), stream->filename,
+                    elapsed > 0.0 ? stream->n_written * (stream->size / 1024. / 1024.) / elapsed : 0.0,
+                    stream->n_dropped);
+    }
+
+    /* The status timeout holds the GDK lock, so it is not running now */
+    gdk_threads_enter ();
+    g_source_remove (stream->status_source);
+    gtk_statusbar_pop (data->statusbar, data->status_context);
+    gtk_statusbar_push (data->statusbar, data->status_context, string);
+    gdk_threads_leave ();
+
+    g_mutex_clear (&stream->lock);
+    g_cond_clear (&stream->cond);
+    g_free (stream->scratch);
+    g_free (stream->filename);
+    stream->scratch = NULL;
+    stream->filename = NULL;
+}
+
 static gpointer
 record_frames (gpointer args)
 {
@@ -901,6 +1347,8 @@ record_frames (gpointer args)
     gpointer buffer;
     guint n_max;
     guint n_frames = 0;
+    gboolean streaming;
+    gboolean failed = FALSE;
     GError *error = NULL;
 
     data = (ThreadData *) args;
@@ -908,45 +1356,94 @@ record_frames (gpointer args)
 
     data->n_recorded = 0;
     n_max = (guint) gtk_adjustment_get_value (data->count);
+    streaming = data->stream_filename != NULL;
+
+    if (streaming)
+        stream_start (data);
 
     while (1) {
+        gboolean drop;
+
         if (data->state != RECORDING)
             break;
 
         if (n_max > 0 && n_frames >= n_max)
             break;
 
-        buffer = uca_ring_buffer_get_write_pointer (data->buffer);
-        uca_camera_grab (data->camera, buffer, NULL);
-        uca_ring_buffer_write_advance (data->buffer);
+        if (streaming && g_atomic_int_get (&data->stream.failed)) {
+            failed = TRUE;
+            break;
+        }
 
-        if (error == NULL) {
-            n_frames++;
-            data->n_recorded++;
+        /* If the disk cannot keep up, keep the camera going and lose frames */
+        drop = streaming && uca_ring_buffer_full (data->buffer);
+        buffer = drop ? data->stream.scratch : uca_ring_buffer_get_write_pointer (data->buffer);
+
+        if (!uca_camera_grab (data->camera, buffer, &error)) {
+            /* Stop may end the recording while the last frame is grabbed */
+            if (data->state == RECORDING) {
+                print_and_free_error (&error);
+                failed = TRUE;
+            }
+            else
+                g_clear_error (&error);
+
+            break;
         }
+
+        if (drop)
+            g_atomic_int_inc (&data->stream.n_dropped);
+        else if (streaming)
+            stream_push (&data->stream, data->buffer);
         else
-            print_and_free_error (&error);
+            uca_ring_buffer_write_advance (data->buffer);
+
+        n_frames++;
+
+        if (!drop)
+            data->n_recorded++;
     }
 
-    if (n_max > 0) {
+    if (streaming)
+        stream_finish (data);
+
+    if (n_max > 0 || failed)
         uca_camera_stop_recording (data->camera, NULL);
-        data->state = IDLE;
-        set_tool_button_state (data);
-    }
 
     n_frames = uca_ring_buffer_get_num_blocks (data->buffer);
 
     gdk_threads_enter ();
+
+    /* Stop leaves a stream flushing, the frames can only be used from now on */
+    if (n_max > 0 || failed || data->state == FLUSHING) {
+        data->state = IDLE;
+        set_tool_button_state (data);
+    }
+
     gtk_adjustment_set_upper (data->frame_slider, n_frames - 1);
     gtk_adjustment_set_value (data->frame_slider, n_frames - 1);
+
+    if (data->state == IDLE && n_frames > 0)
+        update_current_frame (data);
+
+    if (data->quit_after_flush)
+        gtk_widget_destroy (data->main_window);
+
     gdk_threads_leave ();
 
     return NULL;
 }
 
-gboolean
-on_delete_event (GtkWidget *widget, GdkEvent *event, gpointer data)
+static gboolean
+on_delete_event (GtkWidget *widget, GdkEvent *event, ThreadData *data)
 {
+    /* The writer still uses the ring buffer, close once it is done */
+    if (data->state == FLUSHING || (data->state == RECORDING && data->stream_filename != NULL)) {
+        stop_acquisition (data);
+        data->quit_after_flush = TRUE;
+        return TRUE;
+    }
+
     return FALSE;
 }
 
@@ -956,6 +1453,10 @@ on_destroy (GtkWidget *widget, ThreadData *data)
     data->state = IDLE;
     g_object_unref (data->camera);
     g_object_unref (data->buffer);
+    g_free (data->lut);
+    g_free (data->columns);
+    g_free (data->row);
+    g_free (data->stream_filename);
     gtk_main_quit ();
 }
 
@@ -970,9 +1471,8 @@ update_current_frame (ThreadData *data)
     n_max = uca_ring_buffer_get_num_blocks (data->buffer);
 
     if (n_max > 0 && data->n_recorded > 0) {
-        /* Shift index so that we always show the oldest frames first */
-        index = (index + data->n_recorded - n_max) % n_max;
-        buffer = uca_ring_buffer_get_pointer (data->buffer, index);
+        /* Indices count from the oldest intact frame */
+        buffer = uca_ring_buffer_get_pointer (data->buffer, MIN (index, n_max - 1));
     }
     else {
         /* we were in preview mode. Grab the 'next' frame in the buffer */
@@ -980,7 +1480,6 @@ update_current_frame (ThreadData *data)
         buffer = uca_ring_buffer_get_read_pointer (data->buffer);
     }
 
-    egg_histogram_view_update (EGG_HISTOGRAM_VIEW (data->histogram_view), buffer);
     up_and_down_scale (data, buffer);
     update_pixbuf (data, buffer);
 }
@@ -1036,6 +1535,37 @@ on_save (GtkMenuItem *item, ThreadData *data)
     gtk_widget_destroy (dialog);
 }
 
+static void
+on_record_to_disk_toggled (GtkCheckMenuItem *item, ThreadData *data)
+{
+    GtkWidget *dialog;
+    gchar *filename = NULL;
+
+    if (gtk_check_menu_item_get_active (item)) {
+        dialog = gtk_file_chooser_dialog_new ("Record to Disk", NULL,
+                                              GTK_FILE_CHOOSER_ACTION_SAVE,
+                                              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                              GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+                                              NULL);
+
+        gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog), TRUE);
+
+        if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT)
+            filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+        gtk_widget_destroy (dialog);
+
+        /* Unchecking calls us again and clears the file name */
+        if (filename == NULL) {
+            gtk_check_menu_item_set_active (item, FALSE);
+            return;
+        }
+    }
+
+    g_free (data->stream_filename);
+    data->stream_filename = filename;
+}
+
 static void
 on_start_button_clicked (GtkWidget *widget, ThreadData *data)
 {
@@ -1058,22 +1588,40 @@ on_start_button_clicked (GtkWidget *widget, ThreadData *data)
 }
 
 static void
-on_stop_button_clicked (GtkWidget *widget, ThreadData *data, GtkAdjustment *adjustment)
+stop_acquisition (ThreadData *data)
 {
     GError *error = NULL;
 
+    if (data->state == FLUSHING)
+        return;
+
     g_object_get (data->camera, "has-camram-recording", &data->data_in_camram, NULL);
-    data->state = IDLE;
+
+    /*
+     * While recording to disk, the record thread switches to IDLE once the
+     * writer has drained the backlog and the ring buffer can be browsed.
+     */
+    if (data->state == RECORDING && data->stream_filename != NULL)
+        data->state = FLUSHING;
+    else
+        data->state = IDLE;
+
     set_tool_button_state (data);
     uca_camera_stop_recording (data->camera, &error);
     data->stopped = TRUE;
     update_pixbuf_dimensions (data);
 
-    on_frame_slider_changed (adjustment, data);
+    if (data->state == IDLE)
+        update_current_frame (data);
 
     if (error != NULL)
-        g_printerr ("Failed to stop: %s\n", error->message);
+        print_and_free_error (&error);
+}
 
+static void
+on_stop_button_clicked (GtkWidget *widget, ThreadData *data)
+{
+    stop_acquisition (data);
 }
 
 static void
@@ -1280,6 +1828,9 @@ update_ring_buffer_dimensions (ThreadData *data)
 
     data->buffer = uca_ring_buffer_new (image_size, num_frames);
     g_message ("Allocated memory for %d frames", num_frames);
+
+    if (data->histogram_view != NULL)
+        egg_histogram_view_set_n_elements (EGG_HISTOGRAM_VIEW (data->histogram_view), data->width * data->height);
 }
 
 static void
@@ -1305,7 +1856,7 @@ on_sensor_bitdepth_changed (GObject *object, GParamSpec *pspec, ThreadData *data
     gdouble max_value;
     g_object_get (object, "sensor-bitdepth", &bitdepth, NULL);
     data->pixel_size = bitdepth > 8 ? 2 : 1;
-    max_value = pow (2, bitdepth);
+    max_value = pow (2, bitdepth) - 1;
     egg_histogram_view_set_max (EGG_HISTOGRAM_VIEW (data->histogram_view), max_value);
     update_ring_buffer_dimensions (data);
 }
@@ -1364,6 +1915,7 @@ create_main_window (GtkBuilder *builder, const gchar* camera_name)
     td.start_button     = GTK_WIDGET (gtk_builder_get_object (builder, "start-button"));
     td.stop_button      = GTK_WIDGET (gtk_builder_get_object (builder, "stop-button"));
     td.record_button    = GTK_WIDGET (gtk_builder_get_object (builder, "record-button"));
+    td.record_to_disk_item = GTK_WIDGET (gtk_builder_get_object (builder, "record-to-disk-item"));
     td.download_button  = GTK_WIDGET (gtk_builder_get_object (builder, "download-button"));
     td.zoom_in_button   = GTK_WIDGET (gtk_builder_get_object (builder, "zoom-in-button"));
     td.zoom_out_button  = GTK_WIDGET (gtk_builder_get_object (builder, "zoom-out-button"));
@@ -1399,6 +1951,9 @@ create_main_window (GtkBuilder *builder, const gchar* camera_name)
     td.download_dialog  = GTK_DIALOG (gtk_builder_get_object (builder, "download-dialog"));
     td.download_adjustment = GTK_ADJUSTMENT (gtk_builder_get_object (builder, "download-adjustment"));
 
+    td.statusbar        = GTK_STATUSBAR (gtk_builder_get_object (builder, "statusbar"));
+    td.status_context   = gtk_statusbar_get_context_id (td.statusbar, "frame rate");
+
     /* Set initial data */
     td.pixel_size = bits_per_sample > 8 ? 2 : 1;
     td.width  = td.display_width = width;
@@ -1446,6 +2001,9 @@ create_main_window (GtkBuilder *builder, const gchar* camera_name)
     g_signal_connect (gtk_builder_get_object (builder, "save-item"),
                       "activate", G_CALLBACK (on_save), &td);
 
+    g_signal_connect (td.record_to_disk_item,
+                      "toggled", G_CALLBACK (on_record_to_disk_toggled), &td);
+
     g_signal_connect (gtk_builder_get_object (builder, "colormap-box"),
                       "changed", G_CALLBACK (on_colormap_changed), &td);
 
@@ -1463,6 +2021,7 @@ create_main_window (GtkBuilder *builder, const gchar* camera_name)
     g_signal_connect (td.zoom_normal_button, "clicked", G_CALLBACK (on_zoom_normal_button_clicked), &td);
     g_signal_connect (td.rect_color_button, "clicked", G_CALLBACK (on_rect_color_button_clicked), &td);
     g_signal_connect (histogram_view, "changed", G_CALLBACK (on_histogram_changed), &td);
+    g_signal_connect (window, "delete-event", G_CALLBACK (on_delete_event), &td);
     g_signal_connect (window, "destroy", G_CALLBACK (on_destroy), &td);
 
     /* Layout */
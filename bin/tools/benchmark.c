@@ -20,8 +20,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include "uca-camera.h"
 #include "uca-plugin-manager.h"
+#include "uca-ring-buffer.h"
+#include "uca-transform.h"
 #include "common.h"
 
 
@@ -32,6 +35,15 @@ typedef struct {
     gboolean test_software;
     gboolean test_external;
     gboolean test_readout;
+    gboolean test_buffered;
+    gboolean test_zero_copy;
+    gboolean test_batch;
+    gboolean test_transform;
+    gboolean huge_pages;
+    gboolean hugetlb;
+    gboolean mlock;
+    gboolean prefault;
+    gint numa_node;
 
     gsize n_bytes;
 } Options;
@@ -40,6 +52,10 @@ typedef guint (*GrabFrameFunc) (UcaCamera *, gpointer, guint, UcaCameraTriggerSo
 
 static UcaCamera *camera = NULL;
 
+/* Batch size and buffer used by grab_frames_batched, set up by benchmark() */
+static guint batch_size = 1;
+static gpointer batch_buffer = NULL;
+
 static void
 sigint_handler(int signal)
 {
@@ -114,6 +130,83 @@ grab_frames_sync (UcaCamera *camera, gpointer buffer, guint n_frames, UcaCameraT
     return total;
 }
 
+static guint
+grab_frames_buffered (UcaCamera *camera, gpointer buffer, guint n_frames, UcaCameraTriggerSource trigger_source, GTimer *timer)
+{
+    guint total;
+
+    g_object_set (camera, "buffered", TRUE, NULL);
+    total = grab_frames_sync (camera, buffer, n_frames, trigger_source, timer);
+    g_object_set (camera, "buffered", FALSE, NULL);
+
+    return total;
+}
+
+static guint
+grab_frames_batched (UcaCamera *camera, gpointer buffer, guint n_frames, UcaCameraTriggerSource trigger_source, GTimer *timer)
+{
+    GError *error = NULL;
+    guint total = 0;
+
+    g_object_set (camera, "trigger-source", trigger_source, NULL);
+    uca_camera_start_recording (camera, &error);
+
+    g_timer_start (timer);
+
+    while (total < n_frames) {
+        total += uca_camera_grab_n (camera, batch_buffer, MIN (batch_size, n_frames - total), &error);
+
+        if (error != NULL) {
+            g_warning ("Error grabbing frame %02i/%i: `%s'", total, n_frames, error->message);
+            g_error_free (error);
+            error = NULL;
+            break;
+        }
+    }
+
+    g_timer_stop (timer);
+
+    uca_camera_stop_recording (camera, &error);
+    return total;
+}
+
+static guint
+grab_frames_borrowed (UcaCamera *camera, gpointer buffer, guint n_frames, UcaCameraTriggerSource trigger_source, GTimer *timer)
+{
+    GError *error = NULL;
+    guint total = 0;
+
+    g_object_set (camera,
+                  "buffered", TRUE,
+                  "trigger-source", trigger_source,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+
+    g_timer_start (timer);
+    for (guint i = 0; i < n_frames; i++) {
+        if (trigger_source == UCA_CAMERA_TRIGGER_SOURCE_SOFTWARE)
+            uca_camera_trigger (camera, &error);
+
+        if (uca_camera_borrow_frame (camera, &error) != NULL) {
+            uca_camera_release_frame (camera);
+            total++;
+        }
+
+        if (error != NULL) {
+            g_warning ("Error borrowing frame %02i/%i: `%s'", i, n_frames, error->message);
+            g_error_free (error);
+            error = NULL;
+        }
+    }
+    g_timer_stop (timer);
+
+    uca_camera_stop_recording (camera, &error);
+    g_object_set (camera, "buffered", FALSE, NULL);
+
+    return total;
+}
+
 static guint
 grab_frames_readout (UcaCamera *camera, gpointer buffer, guint n_frames, UcaCameraTriggerSource trigger_source, GTimer *timer)
 {
@@ -184,6 +277,23 @@ grab_frames_async (UcaCamera *camera, gpointer buffer, guint n_frames, UcaCamera
     return n_frames;
 }
 
+/*
+ * CPU time spent by the calling thread, i.e. the consumer of the frames. This
+ * shows how much a blocking grab costs compared to the wall-clock time.
+ */
+static gdouble
+get_thread_cpu_time (void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return 0.0;
+#endif
+}
+
 static void
 benchmark_method (UcaCamera *camera, gpointer buffer, GrabFrameFunc func, Options *options, UcaCameraTriggerSource trigger_source)
 {
@@ -191,8 +301,11 @@ benchmark_method (UcaCamera *camera, gpointer buffer, GrabFrameFunc func, Option
     gdouble fps;
     gdouble bandwidth;
     gdouble total_time = 0.0;
+    gdouble cpu_time = 0.0;
     guint num_frames_total;
     guint num_frames_acquired = 0;
+    guint64 num_ring_drops = 0;
+    guint max_high_water = 0;
     GError *error = NULL;
 
     timer = g_timer_new ();
@@ -200,6 +313,12 @@ benchmark_method (UcaCamera *camera, gpointer buffer, GrabFrameFunc func, Option
 
     if (func == grab_frames_sync)
         g_print ("sync   ");
+    else if (func == grab_frames_buffered)
+        g_print ("buf    ");
+    else if (func == grab_frames_borrowed)
+        g_print ("zcopy  ");
+    else if (func == grab_frames_batched)
+        g_print ("n=%-5u", batch_size);
     else if (func == grab_frames_readout)
         g_print ("rout   ");
     else
@@ -218,13 +337,30 @@ benchmark_method (UcaCamera *camera, gpointer buffer, GrabFrameFunc func, Option
     }
 
     for (guint run = 0; run < options->n_runs; run++) {
+        gdouble cpu_start;
+
         g_print ("%i/%i", run + 1, options->n_runs);
         g_message ("Start run %i of %i", run + 1, options->n_runs);
 
+        cpu_start = get_thread_cpu_time ();
         num_frames_acquired += func (camera, buffer, options->n_frames, trigger_source, timer);
+        cpu_time += get_thread_cpu_time () - cpu_start;
 
         total_time += g_timer_elapsed (timer, NULL);
         g_print ("\b\b\b");
+
+        if (func == grab_frames_buffered || func == grab_frames_borrowed) {
+            guint64 dropped;
+            guint high_water;
+
+            g_object_get (camera,
+                          "frames-dropped", &dropped,
+                          "buffer-high-water", &high_water,
+                          NULL);
+
+            num_ring_drops += dropped;
+            max_high_water = MAX (max_high_water, high_water);
+        }
     }
 
     g_assert_no_error (error);
@@ -232,13 +368,115 @@ benchmark_method (UcaCamera *camera, gpointer buffer, GrabFrameFunc func, Option
     fps = options->n_runs * options->n_frames / total_time;
     bandwidth = options->n_bytes * fps / 1024 / 1024;
     num_frames_total = options->n_runs * options->n_frames;
-    g_print (" %8.2f Hz  %8.2f MB/s  %d/%d acquired (%3.2f%% dropped)\n",
+    g_print (" %8.2f Hz  %8.2f MB/s  %d/%d acquired (%3.2f%% dropped)  %8.2f us CPU/frame\n",
              fps, bandwidth, num_frames_acquired, num_frames_total,
-             100 * (num_frames_total - num_frames_acquired) / ((gdouble) num_frames_total));
+             100 * (num_frames_total - num_frames_acquired) / ((gdouble) num_frames_total),
+             cpu_time / num_frames_total * G_USEC_PER_SEC);
+
+    if (func == grab_frames_buffered || func == grab_frames_borrowed)
+        g_print ("              %" G_GUINT64_FORMAT " frames dropped in ring buffer, maximum fill %u\n",
+                 num_ring_drops, max_high_water);
+
+    g_timer_destroy (timer);
+}
+
+static UcaRingBufferAllocFlags
+get_alloc_flags (Options *options)
+{
+    UcaRingBufferAllocFlags flags = UCA_RING_BUFFER_ALLOC_DEFAULT;
+
+    if (options->huge_pages)
+        flags |= UCA_RING_BUFFER_ALLOC_HUGE_PAGES;
+
+    if (options->hugetlb)
+        flags |= UCA_RING_BUFFER_ALLOC_HUGETLB;
+
+    if (options->mlock)
+        flags |= UCA_RING_BUFFER_ALLOC_LOCKED;
+
+    if (options->prefault)
+        flags |= UCA_RING_BUFFER_ALLOC_PREFAULT;
+
+    return flags;
+}
+
+/*
+ * Time the construction of a ring buffer as uca_camera_start_recording() would
+ * do in buffered mode, including pre-faulting and locking if requested.
+ */
+static void
+benchmark_allocation (UcaCamera *camera, Options *options)
+{
+    UcaRingBuffer *ring;
+    GTimer *timer;
+    guint num_buffers;
+
+    g_object_get (camera, "num-buffers", &num_buffers, NULL);
+    num_buffers = MAX (num_buffers, 2);
+
+    timer = g_timer_new ();
+    ring = uca_ring_buffer_new_full (options->n_bytes, num_buffers,
+                                     get_alloc_flags (options), options->numa_node);
+    g_timer_stop (timer);
+
+    g_print ("alloc        %u x %.2f MB  %8.2f ms\n", num_buffers,
+             options->n_bytes / 1024. / 1024., g_timer_elapsed (timer, NULL) * 1000.);
 
+    g_object_unref (ring);
     g_timer_destroy (timer);
 }
 
+/*
+ * Compare mirroring and rotating a frame of the current ROI with a plain copy
+ * of the same size, independent of the camera speed.
+ */
+static void
+benchmark_transform (Options *options, guint width, guint height, guint pixel_size)
+{
+    gpointer src;
+    gpointer dst;
+    GTimer *timer;
+    guint n_frames;
+    gdouble copy_bandwidth;
+
+    src = g_malloc0 (options->n_bytes);
+    dst = g_malloc0 (options->n_bytes);
+    timer = g_timer_new ();
+    n_frames = options->n_frames * options->n_runs;
+
+    g_timer_start (timer);
+
+    for (guint i = 0; i < n_frames; i++)
+        memcpy (dst, src, options->n_bytes);
+
+    g_timer_stop (timer);
+    copy_bandwidth = n_frames * options->n_bytes / g_timer_elapsed (timer, NULL) / 1024 / 1024;
+    g_print ("memcpy                  %8.2f MB/s\n", copy_bandwidth);
+
+    for (guint mirror = 0; mirror < 2; mirror++) {
+        for (guint rotate = 0; rotate < 4; rotate++) {
+            gdouble bandwidth;
+
+            if (uca_transform_is_identity (mirror, rotate))
+                continue;
+
+            g_timer_start (timer);
+
+            for (guint i = 0; i < n_frames; i++)
+                uca_transform_frame (dst, src, width, height, pixel_size, mirror, rotate);
+
+            g_timer_stop (timer);
+            bandwidth = n_frames * options->n_bytes / g_timer_elapsed (timer, NULL) / 1024 / 1024;
+            g_print ("mirror=%u rotate=%u       %8.2f MB/s  %5.1f%% of memcpy\n",
+                     mirror, rotate * 90, bandwidth, 100 * bandwidth / copy_bandwidth);
+        }
+    }
+
+    g_timer_destroy (timer);
+    g_free (src);
+    g_free (dst);
+}
+
 static void
 benchmark (UcaCamera *camera, Options *options)
 {
@@ -272,13 +510,41 @@ benchmark (UcaCamera *camera, Options *options)
     options->n_bytes = roi_width * roi_height * n_bytes_per_pixel;
     buffer = g_malloc0 (options->n_bytes);
 
-    g_object_set (G_OBJECT(camera), "transfer-asynchronously", FALSE, NULL);
+    g_object_set (G_OBJECT(camera),
+                  "transfer-asynchronously", FALSE,
+                  "buffer-alloc-flags", get_alloc_flags (options),
+                  "buffer-numa-node", options->numa_node,
+                  NULL);
+
+    if (options->test_buffered || options->test_zero_copy)
+        benchmark_allocation (camera, options);
+
+    if (options->test_transform)
+        benchmark_transform (options, roi_width, roi_height, n_bytes_per_pixel);
 
     if(options->test_readout)
         benchmark_method (camera, buffer, grab_frames_readout, options, UCA_CAMERA_TRIGGER_SOURCE_AUTO);
     else
         benchmark_method (camera, buffer, grab_frames_sync, options, UCA_CAMERA_TRIGGER_SOURCE_AUTO);
 
+    if (options->test_buffered)
+        benchmark_method (camera, buffer, grab_frames_buffered, options, UCA_CAMERA_TRIGGER_SOURCE_AUTO);
+
+    if (options->test_zero_copy)
+        benchmark_method (camera, buffer, grab_frames_borrowed, options, UCA_CAMERA_TRIGGER_SOURCE_AUTO);
+
+    if (options->test_batch) {
+        static const guint batch_sizes[] = { 1, 4, 16, 64, 256 };
+
+        for (guint i = 0; i < G_N_ELEMENTS (batch_sizes); i++) {
+            batch_size = batch_sizes[i];
+            batch_buffer = g_malloc0 (batch_size * options->n_bytes);
+            benchmark_method (camera, buffer, grab_frames_batched, options, UCA_CAMERA_TRIGGER_SOURCE_AUTO);
+            g_free (batch_buffer);
+            batch_buffer = NULL;
+        }
+    }
+
     if (options->test_software)
         benchmark_method (camera, buffer, grab_frames_sync, options, UCA_CAMERA_TRIGGER_SOURCE_SOFTWARE);
 
@@ -316,6 +582,15 @@ main (int argc, char *argv[])
         .test_software = FALSE,
         .test_external = FALSE,
         .test_readout = FALSE,
+        .test_buffered = FALSE,
+        .test_zero_copy = FALSE,
+        .test_batch = FALSE,
+        .test_transform = FALSE,
+        .huge_pages = FALSE,
+        .hugetlb = FALSE,
+        .mlock = FALSE,
+        .prefault = FALSE,
+        .numa_node = -1,
     };
 
     static GOptionEntry entries[] = {
@@ -325,6 +600,15 @@ main (int argc, char *argv[])
         { "software", 0, 0, G_OPTION_ARG_NONE, &options.test_software, "Test software trigger mode", NULL },
         { "external", 0, 0, G_OPTION_ARG_NONE, &options.test_external, "Test external trigger mode", NULL },
         { "readout", 0, 0, G_OPTION_ARG_NONE, &options.test_readout, "Test readout from camRAM instead of sync acquisition", NULL},
+        { "buffered", 0, 0, G_OPTION_ARG_NONE, &options.test_buffered, "Test buffered acquisition", NULL },
+        { "zero-copy", 0, 0, G_OPTION_ARG_NONE, &options.test_zero_copy, "Test buffered acquisition with borrowed frames", NULL },
+        { "batch-sweep", 0, 0, G_OPTION_ARG_NONE, &options.test_batch, "Test batched acquisition with uca_camera_grab_n and increasing batch sizes", NULL },
+        { "transform", 0, 0, G_OPTION_ARG_NONE, &options.test_transform, "Measure mirroring and rotating frames against memcpy", NULL },
+        { "huge-pages", 0, 0, G_OPTION_ARG_NONE, &options.huge_pages, "Use transparent huge pages for the ring buffer", NULL },
+        { "hugetlb", 0, 0, G_OPTION_ARG_NONE, &options.hugetlb, "Use explicit huge pages for the ring buffer", NULL },
+        { "mlock", 0, 0, G_OPTION_ARG_NONE, &options.mlock, "Lock the ring buffer in memory", NULL },
+        { "prefault", 0, 0, G_OPTION_ARG_NONE, &options.prefault, "Pre-fault the ring buffer in parallel", NULL },
+        { "numa-node", 0, 0, G_OPTION_ARG_INT, &options.numa_node, "Bind the ring buffer to NUMA node N", "N" },
         { NULL }
     };
 
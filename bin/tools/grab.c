@@ -15,15 +15,25 @@
    with this library; if not, write to the Free Software Foundation, Inc., 51
    Franklin St, Fifth Floor, Boston, MA 02110, USA */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "config.h"
 
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "uca-plugin-manager.h"
 #include "uca-camera.h"
 #include "uca-ring-buffer.h"
+#include "uca-statistics.h"
 #include "common.h"
 
 #ifdef HAVE_LIBTIFF
@@ -34,6 +44,10 @@
 typedef struct {
     gint n_frames;
     gchar *filename;
+    gboolean mapped;
+    gboolean stream;
+    gint n_buffers;
+    gboolean stats;
 #ifdef HAVE_LIBTIFF
     gboolean write_tiff;
 #endif
@@ -68,51 +82,75 @@ count_format_specifiers (const gchar *template)
 }
 
 #ifdef HAVE_LIBTIFF
-static void
-write_tiff (UcaRingBuffer *buffer,
-            Options *opts,
-            guint width,
-            guint height,
-            guint bits_per_pixel)
+static TIFF *
+open_tiff (Options *opts)
 {
     TIFF *tif;
-    guint32 rows_per_strip;
-    guint n_frames;
-    guint bits_per_sample;
-    gsize bytes_per_pixel;
 
     if (count_format_specifiers (opts->filename) > 0)
         g_warning ("Can only write multi-page TIFF, format specifier is ignored.\n");
 
     tif = TIFFOpen (opts->filename, "w");
-    n_frames = uca_ring_buffer_get_num_blocks (buffer);
+
+    /* Write multi page TIFF file */
+    if (tif != NULL)
+        TIFFSetField (tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+
+    return tif;
+}
+
+static void
+write_tiff_page (TIFF *tif,
+                 gpointer data,
+                 guint index,
+                 guint n_frames,
+                 guint width,
+                 guint height,
+                 guint bits_per_pixel)
+{
+    guint32 rows_per_strip;
+    guint bits_per_sample;
+    gsize bytes_per_pixel;
+    gsize offset = 0;
+
     rows_per_strip = TIFFDefaultStripSize (tif, (guint32) - 1);
     bytes_per_pixel = get_bytes_per_pixel (bits_per_pixel);
     bits_per_sample = bits_per_pixel > 8 ? 16 : 8;
 
-    /* Write multi page TIFF file */
-    TIFFSetField (tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+    TIFFSetField (tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField (tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField (tif, TIFFTAG_BITSPERSAMPLE, bits_per_sample);
+    TIFFSetField (tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+    TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
+    TIFFSetField (tif, TIFFTAG_PAGENUMBER, index, n_frames);
 
-    for (guint i = 0; i < n_frames; i++) {
-        gpointer data;
-        gsize offset = 0;
+    for (guint y = 0; y < height; y++, offset += width * bytes_per_pixel)
+        TIFFWriteScanline (tif, (guint8*)data + offset, y, 0);
 
-        data = uca_ring_buffer_get_read_pointer (buffer);
+    TIFFWriteDirectory (tif);
+}
 
-        TIFFSetField (tif, TIFFTAG_IMAGEWIDTH, width);
-        TIFFSetField (tif, TIFFTAG_IMAGELENGTH, height);
-        TIFFSetField (tif, TIFFTAG_BITSPERSAMPLE, bits_per_sample);
-        TIFFSetField (tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-        TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, 1);
-        TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
-        TIFFSetField (tif, TIFFTAG_PAGENUMBER, i, n_frames);
+static void
+write_tiff (UcaRingBuffer *buffer,
+            Options *opts,
+            guint width,
+            guint height,
+            guint bits_per_pixel)
+{
+    TIFF *tif;
+    guint n_frames;
 
-        for (guint y = 0; y < height; y++, offset += width * bytes_per_pixel)
-            TIFFWriteScanline (tif, (guint8*)data + offset, y, 0);
+    tif = open_tiff (opts);
 
-        TIFFWriteDirectory (tif);
-    }
+    if (tif == NULL)
+        return;
+
+    n_frames = uca_ring_buffer_get_num_blocks (buffer);
+
+    for (guint i = 0; i < n_frames; i++)
+        write_tiff_page (tif, uca_ring_buffer_get_read_pointer (buffer), i, n_frames, width, height, bits_per_pixel);
 
     TIFFClose (tif);
 }
@@ -163,6 +201,311 @@ write_raw (UcaRingBuffer *buffer,
         fclose (fp);
 }
 
+static void
+print_buffer_statistics (UcaCamera *camera)
+{
+    gboolean buffered;
+    guint num_buffers;
+    guint high_water;
+    guint64 produced;
+    guint64 consumed;
+    guint64 dropped;
+
+    g_object_get (G_OBJECT (camera),
+                  "buffered", &buffered,
+                  "num-buffers", &num_buffers,
+                  "frames-produced", &produced,
+                  "frames-consumed", &consumed,
+                  "frames-dropped", &dropped,
+                  "buffer-high-water", &high_water,
+                  NULL);
+
+    if (!buffered)
+        return;
+
+    g_print ("Frames     = %" G_GUINT64_FORMAT " produced, %" G_GUINT64_FORMAT " consumed, %"
+             G_GUINT64_FORMAT " dropped\n", produced, consumed, dropped);
+    g_print ("Buffer     = %u/%u maximum fill\n", high_water, num_buffers);
+}
+
+static void
+print_frame_statistics (gint index, gconstpointer frame, gsize n_pixels, guint pixel_size)
+{
+    UcaStatistics stats;
+
+    uca_statistics_compute (&stats, NULL, 0, 0, frame, n_pixels, pixel_size, g_get_num_processors ());
+
+    g_print ("\33[2K\rFrame %i: min = %u, max = %u, mean = %.2f, sigma = %.2f\n",
+             index, stats.min, stats.max,
+             uca_statistics_get_mean (&stats), uca_statistics_get_sigma (&stats));
+}
+
+#ifdef HAVE_LIBTIFF
+static gboolean
+is_tiff_filename (const gchar *filename)
+{
+    return g_str_has_suffix (filename, ".tif") || g_str_has_suffix (filename, ".tiff");
+}
+#endif
+
+/*
+ * A single raw output file has exactly the layout of the ring buffer, so it
+ * can be mapped directly and nothing has to be written after acquisition.
+ */
+static gboolean
+is_mapped_output (Options *opts)
+{
+    gboolean tiff = FALSE;
+
+#ifdef HAVE_LIBTIFF
+    tiff = is_tiff_filename (opts->filename);
+#endif
+
+    return opts->mapped && !tiff && count_format_specifiers (opts->filename) == 0;
+}
+
+/*
+ * Streaming output: a writer thread drains the ring buffer while frames are
+ * acquired. Raw output is collected into large, aligned chunks so that it can
+ * bypass the page cache with O_DIRECT where the file system supports it.
+ */
+#define STREAM_CHUNK_SIZE   (16 * 1024 * 1024)
+#define STREAM_ALIGNMENT    4096
+
+typedef struct {
+    UcaRingBuffer *buffer;
+    Options *opts;
+    guint width;
+    guint height;
+    guint bits;
+    guint n_frames;
+
+    GMutex lock;
+    GCond cond;
+    gboolean done;
+
+    guint n_written;
+    guint64 n_bytes;
+    gdouble elapsed;
+    GError *error;
+} Writer;
+
+typedef struct {
+    gint fd;
+    guchar *chunk;
+    gsize fill;
+    guint64 total;
+    gboolean direct;
+} RawStream;
+
+static gboolean
+raw_stream_open (RawStream *stream, const gchar *filename, GError **error)
+{
+    stream->fill = 0;
+    stream->total = 0;
+    stream->direct = FALSE;
+    stream->fd = -1;
+
+#ifdef O_DIRECT
+    stream->fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    stream->direct = stream->fd >= 0;
+#endif
+
+    /* Not all file systems support O_DIRECT, large writes still help */
+    if (stream->fd < 0)
+        stream->fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (stream->fd < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not open `%s': %s", filename, g_strerror (errno));
+        return FALSE;
+    }
+
+    if (posix_memalign ((void **) &stream->chunk, STREAM_ALIGNMENT, STREAM_CHUNK_SIZE) != 0) {
+        close (stream->fd);
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+                     "Could not allocate write buffer");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+raw_stream_flush (RawStream *stream, gsize size, GError **error)
+{
+    gsize written = 0;
+
+    while (written < size) {
+        gssize result = write (stream->fd, stream->chunk + written, size - written);
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+
+            g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                         "Could not write: %s", g_strerror (errno));
+            return FALSE;
+        }
+
+        written += result;
+    }
+
+    stream->fill = 0;
+    return TRUE;
+}
+
+static gboolean
+raw_stream_write (RawStream *stream, const guchar *data, gsize size, GError **error)
+{
+    while (size > 0) {
+        gsize n = MIN (size, STREAM_CHUNK_SIZE - stream->fill);
+
+        memcpy (stream->chunk + stream->fill, data, n);
+        stream->fill += n;
+        stream->total += n;
+        data += n;
+        size -= n;
+
+        if (stream->fill == STREAM_CHUNK_SIZE && !raw_stream_flush (stream, STREAM_CHUNK_SIZE, error))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+raw_stream_close (RawStream *stream, GError **error)
+{
+    gboolean success = TRUE;
+
+    if (stream->fill > 0) {
+        gsize size = stream->fill;
+
+        /* O_DIRECT needs aligned sizes, pad and cut the file afterwards */
+        if (stream->direct) {
+            size = (size + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+            memset (stream->chunk + stream->fill, 0, size - stream->fill);
+        }
+
+        success = raw_stream_flush (stream, size, error);
+    }
+
+    if (success && stream->direct && ftruncate (stream->fd, (off_t) stream->total) != 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not truncate: %s", g_strerror (errno));
+        success = FALSE;
+    }
+
+    close (stream->fd);
+    free (stream->chunk);
+    return success;
+}
+
+/* Returns the next frame or NULL once acquisition has finished */
+static gpointer
+writer_next_frame (Writer *writer)
+{
+    gpointer data = NULL;
+
+    g_mutex_lock (&writer->lock);
+
+    while (!uca_ring_buffer_available (writer->buffer) && !writer->done)
+        g_cond_wait (&writer->cond, &writer->lock);
+
+    if (uca_ring_buffer_available (writer->buffer))
+        data = uca_ring_buffer_get_read_pointer (writer->buffer);
+
+    g_mutex_unlock (&writer->lock);
+
+    return data;
+}
+
+static gpointer
+writer_thread (Writer *writer)
+{
+    gsize size;
+    gpointer data;
+    GTimer *timer;
+    gboolean multiple_files = FALSE;
+    RawStream stream;
+#ifdef HAVE_LIBTIFF
+    TIFF *tif = NULL;
+#endif
+
+    size = uca_ring_buffer_get_block_size (writer->buffer);
+    timer = g_timer_new ();
+    g_timer_stop (timer);
+
+#ifdef HAVE_LIBTIFF
+    if (is_tiff_filename (writer->opts->filename)) {
+        tif = open_tiff (writer->opts);
+
+        if (tif == NULL) {
+            g_set_error (&writer->error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         "Could not open `%s'", writer->opts->filename);
+            goto writer_done;
+        }
+    }
+    else
+#endif
+    {
+        multiple_files = count_format_specifiers (writer->opts->filename) > 0;
+
+        if (!multiple_files && !raw_stream_open (&stream, writer->opts->filename, &writer->error))
+            goto writer_done;
+    }
+
+    while ((data = writer_next_frame (writer)) != NULL) {
+        if (writer->error != NULL)
+            continue;
+
+        g_timer_continue (timer);
+
+#ifdef HAVE_LIBTIFF
+        if (tif != NULL)
+            write_tiff_page (tif, data, writer->n_written, writer->n_frames,
+                             writer->width, writer->height, writer->bits);
+        else
+#endif
+        if (multiple_files) {
+            gchar *filename;
+
+            filename = g_strdup_printf (writer->opts->filename, writer->n_written);
+            g_file_set_contents (filename, data, size, &writer->error);
+            g_free (filename);
+        }
+        else
+            raw_stream_write (&stream, data, size, &writer->error);
+
+        g_timer_stop (timer);
+        writer->n_written++;
+        writer->n_bytes += size;
+    }
+
+    g_timer_continue (timer);
+
+#ifdef HAVE_LIBTIFF
+    if (tif != NULL)
+        TIFFClose (tif);
+    else
+#endif
+    if (!multiple_files)
+        raw_stream_close (&stream, writer->error == NULL ? &writer->error : NULL);
+
+    g_timer_stop (timer);
+
+writer_done:
+    writer->elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    /* Keep draining so that the acquisition does not stall on errors */
+    while (writer_next_frame (writer) != NULL)
+        ;
+
+    return NULL;
+}
+
 static GError *
 record_frames (UcaCamera *camera, Options *opts)
 {
@@ -179,6 +522,11 @@ record_frames (UcaCamera *camera, Options *opts)
     GTimer *frame_timer;
     gdouble elapsed;
     UcaRingBuffer *buffer;
+    gchar *ring_filename = NULL;
+    Writer writer;
+    GThread *thread = NULL;
+    gpointer scratch = NULL;
+    guint n_dropped = 0;
     GError *error = NULL;
 
     g_object_get (G_OBJECT (camera),
@@ -190,7 +538,27 @@ record_frames (UcaCamera *camera, Options *opts)
     pixel_size = get_bytes_per_pixel (bits);
     size = roi_width * roi_height * pixel_size;
     n_allocated = opts->n_frames > 0 ? opts->n_frames : 256;
-    buffer = uca_ring_buffer_new (size, n_allocated);
+
+    /* Bounded memory, frames only stay in the ring until written */
+    if (opts->stream)
+        n_allocated = MAX (MIN (n_allocated, (guint) opts->n_buffers), 2);
+
+    if (opts->mapped) {
+        if (is_mapped_output (opts))
+            ring_filename = g_strdup (opts->filename);
+        else
+            ring_filename = g_strconcat (opts->filename, ".ring", NULL);
+
+        buffer = uca_ring_buffer_new_mapped (ring_filename, size, n_allocated, UCA_RING_BUFFER_ALLOC_DEFAULT, &error);
+
+        if (buffer == NULL) {
+            g_free (ring_filename);
+            return error;
+        }
+    }
+    else
+        buffer = uca_ring_buffer_new (size, n_allocated);
+
     total_timer = g_timer_new();
     frame_timer = g_timer_new();
     g_timer_stop (frame_timer);
@@ -201,7 +569,26 @@ record_frames (UcaCamera *camera, Options *opts)
     uca_camera_start_recording (camera, &error);
 
     if (error != NULL)
-        return error;
+        goto cleanup_buffer;
+
+    if (opts->stream) {
+        writer.buffer = buffer;
+        writer.opts = opts;
+        writer.width = roi_width;
+        writer.height = roi_height;
+        writer.bits = bits;
+        writer.n_frames = opts->n_frames;
+        writer.done = FALSE;
+        writer.n_written = 0;
+        writer.n_bytes = 0;
+        writer.elapsed = 0.0;
+        writer.error = NULL;
+        g_mutex_init (&writer.lock);
+        g_cond_init (&writer.cond);
+
+        scratch = g_malloc (size);
+        thread = g_thread_new ("writer", (GThreadFunc) writer_thread, &writer);
+    }
 
     n_frames = 0;
     n_digits = floor (log10 (abs (opts->n_frames))) + 1;
@@ -209,13 +596,33 @@ record_frames (UcaCamera *camera, Options *opts)
     g_timer_start (total_timer);
 
     while (1) {
+        gboolean drop;
+        gpointer frame;
+
+        /* If the disk cannot keep up, keep the camera going and lose frames */
+        drop = opts->stream && uca_ring_buffer_full (buffer);
+        frame = drop ? scratch : uca_ring_buffer_get_write_pointer (buffer);
+
         g_timer_continue (frame_timer);
-        uca_camera_grab (camera, uca_ring_buffer_get_write_pointer (buffer), &error);
+        uca_camera_grab (camera, frame, &error);
         g_timer_stop (frame_timer);
-        uca_ring_buffer_write_advance (buffer);
 
         if (error != NULL)
-            return error;
+            break;
+
+        if (opts->stats)
+            print_frame_statistics (n_frames + 1, frame, (gsize) roi_width * roi_height, pixel_size);
+
+        if (drop)
+            n_dropped++;
+        else if (opts->stream) {
+            g_mutex_lock (&writer.lock);
+            uca_ring_buffer_write_advance (buffer);
+            g_cond_signal (&writer.cond);
+            g_mutex_unlock (&writer.lock);
+        }
+        else
+            uca_ring_buffer_write_advance (buffer);
 
         g_print (fmt_string, ++n_frames, opts->n_frames);
 
@@ -223,23 +630,55 @@ record_frames (UcaCamera *camera, Options *opts)
             break;
     }
 
+    if (thread != NULL) {
+        g_mutex_lock (&writer.lock);
+        writer.done = TRUE;
+        g_cond_signal (&writer.cond);
+        g_mutex_unlock (&writer.lock);
+    }
+
     g_free (fmt_string);
     elapsed = g_timer_elapsed (total_timer, NULL);
 
-    g_print ("\nTime total = %3.2f s => %3.2f f/s = %3.2f ms/f = %.4f MB/s\n",
-             elapsed,
-             n_frames / elapsed, elapsed / n_frames * 1000.,
-             n_frames * size / 1024. / 1024. / elapsed);
-    g_print ("Time mean  = %3.2f ms\n",
-             g_timer_elapsed (frame_timer, NULL) / n_frames * 1000.);
+    if (n_frames > 0) {
+        g_print ("\nTime total = %3.2f s => %3.2f f/s = %3.2f ms/f = %.4f MB/s\n",
+                 elapsed,
+                 n_frames / elapsed, elapsed / n_frames * 1000.,
+                 n_frames * size / 1024. / 1024. / elapsed);
+        g_print ("Time mean  = %3.2f ms\n",
+                 g_timer_elapsed (frame_timer, NULL) / n_frames * 1000.);
+    }
+
+    /* A failed grab is the error to report, stopping is still necessary */
+    uca_camera_stop_recording (camera, error == NULL ? &error : NULL);
+    print_buffer_statistics (camera);
 
-    uca_camera_stop_recording (camera, &error);
+    if (thread != NULL) {
+        g_thread_join (thread);
+        elapsed = g_timer_elapsed (total_timer, NULL);
 
-    if (opts->filename == NULL)
+        g_print ("Disk       = %.2f MB/s sustained, %u frames written, %u dropped, done after %3.2f s\n",
+                 writer.elapsed > 0.0 ? writer.n_bytes / 1024. / 1024. / writer.elapsed : 0.0,
+                 writer.n_written, n_dropped, elapsed);
+
+        if (writer.error != NULL) {
+            g_printerr ("Error writing %s: %s\n", opts->filename, writer.error->message);
+            g_error_free (writer.error);
+        }
+
+        g_mutex_clear (&writer.lock);
+        g_cond_clear (&writer.cond);
+        g_free (scratch);
+    }
+    else if (error != NULL)
+        g_print ("\nNot writing data after the error.\n");
+    else if (opts->filename == NULL)
         g_print ("No filename given, not writing data.\n");
+    else if (is_mapped_output (opts))
+        g_print ("Frames written to %s during acquisition.\n", opts->filename);
     else {
 #ifdef HAVE_LIBTIFF
-        if (g_str_has_suffix (opts->filename, ".tif") || g_str_has_suffix (opts->filename, ".tiff"))
+        if (is_tiff_filename (opts->filename))
             write_tiff (buffer, opts, roi_width, roi_height, bits);
         else
             write_raw (buffer, opts);
@@ -248,7 +687,14 @@ record_frames (UcaCamera *camera, Options *opts)
 #endif
     }
 
+cleanup_buffer:
     g_object_unref (buffer);
+
+    /* The ring of a TIFF or templated output is only needed while recording */
+    if (ring_filename != NULL && !is_mapped_output (opts))
+        g_unlink (ring_filename);
+
+    g_free (ring_filename);
     g_timer_destroy (total_timer);
     g_timer_destroy (frame_timer);
 
@@ -266,11 +712,19 @@ main (int argc, char *argv[])
     static Options opts = {
         .n_frames = -1,
         .filename = NULL,
+        .mapped = FALSE,
+        .stream = FALSE,
+        .n_buffers = 64,
+        .stats = FALSE,
     };
 
     static GOptionEntry entries[] = {
         { "num-frames", 'n', 0, G_OPTION_ARG_INT, &opts.n_frames, "Number of frames to acquire", "N" },
         { "output", 'o', 0, G_OPTION_ARG_STRING, &opts.filename, "Output file name template", "FILE" },
+        { "mmap", 0, 0, G_OPTION_ARG_NONE, &opts.mapped, "Keep frames in a memory-mapped file instead of RAM", NULL },
+        { "stream", 0, 0, G_OPTION_ARG_NONE, &opts.stream, "Write frames to disk while acquiring", NULL },
+        { "stream-buffers", 0, 0, G_OPTION_ARG_INT, &opts.n_buffers, "Number of frames buffered while streaming", "N" },
+        { "stats", 0, 0, G_OPTION_ARG_NONE, &opts.stats, "Print pixel statistics of each frame", NULL },
         { NULL }
     };
 
@@ -297,6 +751,16 @@ main (int argc, char *argv[])
         goto cleanup_manager;
     }
 
+    if ((opts.mapped || opts.stream) && opts.filename == NULL) {
+        g_printerr ("--mmap and --stream require an output file name with -o/--output.\n");
+        goto cleanup_manager;
+    }
+
+    if (opts.mapped && opts.stream) {
+        g_printerr ("--mmap and --stream cannot be combined.\n");
+        goto cleanup_manager;
+    }
+
     camera = uca_common_get_camera (manager, argv[argc - 1], &error);
 
     if (camera == NULL) {
@@ -17,9 +17,18 @@
 
 #include <gmodule.h>
 #include <gio/gio.h>
+#include <stdio.h>
 #include <string.h>
 #include <tiffio.h>
+#include <glib/gstdio.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #include "uca-file-camera.h"
+#include "uca-pacing.h"
+
+#define INDEX_FILENAME ".uca-file-index"
 
 #define UCA_FILE_CAMERA_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UCA_TYPE_FILE_CAMERA, UcaFileCameraPrivate))
 
@@ -31,6 +40,16 @@ G_DEFINE_TYPE_WITH_CODE (UcaFileCamera, uca_file_camera, UCA_TYPE_CAMERA,
 
 enum {
     PROP_PATH = N_BASE_PROPERTIES,
+    PROP_PREFETCH_THREADS,
+    PROP_PREFETCH_DEPTH,
+    PROP_PRELOAD,
+    PROP_RAW_WIDTH,
+    PROP_RAW_HEIGHT,
+    PROP_RAW_BITDEPTH,
+    PROP_PERSIST_INDEX,
+    PROP_LOOP,
+    PROP_FREE_RUN,
+    PROP_ACHIEVED_FRAMES_PER_SECOND,
     N_PROPERTIES
 };
 
@@ -46,18 +65,89 @@ static const gint file_overrideables[] = {
     PROP_ROI_HEIGHT,
     PROP_HAS_STREAMING,
     PROP_HAS_CAMRAM_RECORDING,
+    PROP_RECORDED_FRAMES,
     0,
 };
 
 static GParamSpec *file_properties[N_PROPERTIES] = { NULL, };
 
+typedef struct {
+    gchar *filename;
+    GMappedFile *mapped;    /* only set for raw stacks */
+} Source;
+
+/*
+ * A frame is located by the offset of its image file directory in TIFF files
+ * and by its byte offset in raw stacks, so any frame can be reached without
+ * walking the frames in front of it.
+ */
+typedef struct {
+    guint source;
+    guint64 offset;
+} Frame;
+
+/* Keeps the last TIFF file open so consecutive pages do not reopen it */
+typedef struct {
+    TIFF *file;
+    guint source;
+} Reader;
+
+typedef struct {
+    guint8 *data;
+    guint64 index;
+    gboolean ready;
+    gboolean failed;
+} PrefetchSlot;
+
 struct _UcaFileCameraPrivate {
     gchar *path;
     guint width;
     guint height;
     guint bitdepth;
-    GList *fnames;
-    GList *current;
+    guint raw_width;
+    guint raw_height;
+    guint raw_bitdepth;
+    GPtrArray *fnames;
+    gboolean persist_index;
+
+    /* Built on demand from fnames and dropped whenever fnames changes */
+    GArray *sources;
+    GArray *frames;
+    Reader reader;
+
+    /* Readout may run while the replay thread grabs through reader */
+    Reader readout_reader;
+
+    /*
+     * While recording with prefetch threads, frame i is decoded into slot
+     * i % n_slots once the frame previously held by that slot was grabbed.
+     * When preloading, there is one slot per frame and slots are never reused.
+     */
+    guint prefetch_threads;
+    guint prefetch_depth;
+    gboolean preload;
+    PrefetchSlot *slots;
+    guint n_slots;
+    GThread **readers;
+    guint n_readers;
+    guint64 next_fetch;
+    guint64 next_grab;
+    gboolean stopping;
+    GMutex prefetch_lock;
+    GCond prefetch_cond;
+
+    /* Replay */
+    gboolean loop;
+    gboolean free_run;
+    gdouble exposure_time;
+    gboolean paced;
+    UcaPacing pacing;
+    guint64 n_delivered;
+    gint64 first_delivery;
+    gint64 last_delivery;
+    GThread *grab_thread;
+    gboolean thread_running;
+    gpointer async_frame;
 };
 
 static gboolean
@@ -79,21 +169,72 @@ read_tiff_meta_data (UcaFileCameraPrivate *priv, const gchar *fname)
     return TRUE;
 }
 
+static gsize
+get_frame_size (UcaFileCameraPrivate *priv)
+{
+    return (gsize) priv->width * priv->height * (priv->bitdepth / 8);
+}
+
+/* Decode whole strips, which avoids the per-row overhead of scanline reads */
 static gboolean
-read_tiff_data (UcaFileCameraPrivate *priv, const gchar *fname, gpointer buffer)
+read_strips (TIFF *file, guint8 *buffer, gsize size)
+{
+    tstrip_t n_strips;
+    gsize offset = 0;
+
+    n_strips = TIFFNumberOfStrips (file);
+
+    for (tstrip_t strip = 0; strip < n_strips && offset < size; strip++) {
+        tsize_t n_read;
+
+        n_read = TIFFReadEncodedStrip (file, strip, buffer + offset, (tsize_t) (size - offset));
+
+        if (n_read < 0)
+            return FALSE;
+
+        offset += n_read;
+    }
+
+    return offset == size;
+}
+
+static gboolean
+read_tiles (TIFF *file, guint8 *buffer, guint width, guint height, gsize pixel_size)
+{
+    guint32 tile_width;
+    guint32 tile_height;
+    guint8 *tile;
+    gboolean result = TRUE;
+
+    TIFFGetField (file, TIFFTAG_TILEWIDTH, &tile_width);
+    TIFFGetField (file, TIFFTAG_TILELENGTH, &tile_height);
+    tile = g_malloc (TIFFTileSize (file));
+
+    for (guint32 y = 0; y < height && result; y += tile_height) {
+        for (guint32 x = 0; x < width && result; x += tile_width) {
+            guint32 n_rows = MIN (tile_height, height - y);
+            gsize row_size = MIN (tile_width, width - x) * pixel_size;
+
+            if (TIFFReadTile (file, tile, x, y, 0, 0) < 0) {
+                result = FALSE;
+                break;
+            }
+
+            for (guint32 row = 0; row < n_rows; row++)
+                memcpy (buffer + ((y + row) * width + x) * pixel_size, tile + row * tile_width * pixel_size, row_size);
+        }
+    }
+
+    g_free (tile);
+    return result;
+}
+
+static gboolean
+read_tiff_page (UcaFileCameraPrivate *priv, TIFF *file, gpointer buffer)
 {
-    TIFF *file;
     guint16 bitdepth;
     guint width;
     guint height;
-    tsize_t result;
-    int offset = 0;
-    int step = priv->width;
-
-    file = TIFFOpen (fname, "r");
-    if (!file) {
-        return FALSE;
-    }
 
     TIFFGetField (file, TIFFTAG_BITSPERSAMPLE, &bitdepth);
     TIFFGetField (file, TIFFTAG_IMAGEWIDTH, &width);
@@ -102,25 +243,651 @@ read_tiff_data (UcaFileCameraPrivate *priv, const gchar *fname, gpointer buffer)
     if (priv->bitdepth != bitdepth || priv->width != width || priv->height != height) {
         g_warning ("Data format not compatible: %ux%u@%u [expected %ux%u@%u]",
                    width, height, bitdepth, priv->width, priv->height, priv->bitdepth);
-        TIFFClose (file);
         return FALSE;
     }
 
-    step *= priv->bitdepth / 8;
+    if (TIFFIsTiled (file))
+        return read_tiles (file, buffer, width, height, priv->bitdepth / 8);
+
+    return read_strips (file, buffer, get_frame_size (priv));
+}
 
-    for (guint32 i = 0; i < priv->height; i++) {
-        result = TIFFReadScanline (file, ((gchar *) buffer) + offset, i, 0);
+static void
+reader_close (Reader *reader)
+{
+    if (reader->file != NULL) {
+        TIFFClose (reader->file);
+        reader->file = NULL;
+    }
+}
 
-        if (result == -1)
+static gboolean
+read_frame (UcaFileCameraPrivate *priv, Reader *reader, guint index, gpointer buffer)
+{
+    Frame *frame;
+    Source *source;
+
+    frame = &g_array_index (priv->frames, Frame, index);
+    source = &g_array_index (priv->sources, Source, frame->source);
+
+    if (source->mapped != NULL) {
+        memcpy (buffer, g_mapped_file_get_contents (source->mapped) + frame->offset, get_frame_size (priv));
+        return TRUE;
+    }
+
+    if (reader->file == NULL || reader->source != frame->source) {
+        reader_close (reader);
+        reader->file = TIFFOpen (source->filename, "r");
+
+        if (reader->file == NULL)
             return FALSE;
 
-        offset += step;
+        reader->source = frame->source;
+
+#ifdef POSIX_FADV_WILLNEED
+        /* Let the kernel read the whole file ahead while we decode */
+        posix_fadvise (TIFFFileno (reader->file), 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    }
+
+    if (!TIFFSetSubDirectory (reader->file, frame->offset))
+        return FALSE;
+
+    return read_tiff_page (priv, reader->file, buffer);
+}
+
+static void
+add_tiff_frames (UcaFileCameraPrivate *priv, const gchar *fname)
+{
+    TIFF *file;
+    Source source;
+
+    file = TIFFOpen (fname, "r");
+
+    if (file == NULL) {
+        g_warning ("Cannot read %s", fname);
+        return;
     }
 
+    do {
+        guint16 bitdepth = 0;
+        guint width = 0;
+        guint height = 0;
+
+        TIFFGetField (file, TIFFTAG_BITSPERSAMPLE, &bitdepth);
+        TIFFGetField (file, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField (file, TIFFTAG_IMAGELENGTH, &height);
+
+        if (priv->bitdepth == bitdepth && priv->width == width && priv->height == height) {
+            Frame frame = { priv->sources->len, TIFFCurrentDirOffset (file) };
+            g_array_append_val (priv->frames, frame);
+        }
+        else {
+            g_warning ("Skipping page %u of %s: %ux%u@%u [expected %ux%u@%u]",
+                       TIFFCurrentDirectory (file), fname,
+                       width, height, bitdepth, priv->width, priv->height, priv->bitdepth);
+        }
+    } while (TIFFReadDirectory (file));
+
     TIFFClose (file);
+
+    source.filename = g_strdup (fname);
+    source.mapped = NULL;
+    g_array_append_val (priv->sources, source);
+}
+
+static void
+add_raw_frames (UcaFileCameraPrivate *priv, const gchar *fname)
+{
+    GMappedFile *mapped;
+    Source source;
+    gsize frame_size;
+    gsize n_frames;
+    GError *error = NULL;
+
+    if (priv->raw_width != priv->width || priv->raw_height != priv->height ||
+        priv->raw_bitdepth != priv->bitdepth) {
+        g_warning ("Skipping %s: raw format %ux%u@%u [expected %ux%u@%u]", fname,
+                   priv->raw_width, priv->raw_height, priv->raw_bitdepth,
+                   priv->width, priv->height, priv->bitdepth);
+        return;
+    }
+
+    mapped = g_mapped_file_new (fname, FALSE, &error);
+
+    if (mapped == NULL) {
+        g_warning ("%s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    frame_size = get_frame_size (priv);
+    n_frames = g_mapped_file_get_length (mapped) / frame_size;
+
+#ifdef MADV_SEQUENTIAL
+    if (n_frames > 0)
+        madvise (g_mapped_file_get_contents (mapped), n_frames * frame_size, MADV_SEQUENTIAL);
+#endif
+
+    for (gsize i = 0; i < n_frames; i++) {
+        Frame frame = { priv->sources->len, i * frame_size };
+        g_array_append_val (priv->frames, frame);
+    }
+
+    source.filename = g_strdup (fname);
+    source.mapped = mapped;
+    g_array_append_val (priv->sources, source);
+}
+
+static gboolean
+is_raw_file (const gchar *fname)
+{
+    return g_str_has_suffix (fname, ".raw");
+}
+
+static void
+clear_source (Source *source)
+{
+    g_free (source->filename);
+
+    if (source->mapped != NULL)
+        g_mapped_file_unref (source->mapped);
+}
+
+static void
+free_index (UcaFileCameraPrivate *priv)
+{
+    reader_close (&priv->reader);
+    reader_close (&priv->readout_reader);
+
+    if (priv->frames == NULL)
+        return;
+
+    for (guint i = 0; i < priv->sources->len; i++)
+        clear_source (&g_array_index (priv->sources, Source, i));
+
+    g_array_free (priv->sources, TRUE);
+    g_array_free (priv->frames, TRUE);
+    priv->sources = NULL;
+    priv->frames = NULL;
+}
+
+static gchar *
+get_index_filename (UcaFileCameraPrivate *priv)
+{
+    return g_build_filename (priv->path, INDEX_FILENAME, NULL);
+}
+
+static void
+get_file_stamp (const gchar *fname, guint64 *size, guint64 *mtime)
+{
+    GStatBuf buf;
+
+    *size = 0;
+    *mtime = 0;
+
+    if (g_stat (fname, &buf) != 0)
+        return;
+
+    *size = (guint64) buf.st_size;
+#ifdef __linux__
+    *mtime = (guint64) buf.st_mtim.tv_sec * G_USEC_PER_SEC + buf.st_mtim.tv_nsec / 1000;
+#else
+    *mtime = (guint64) buf.st_mtime * G_USEC_PER_SEC;
+#endif
+}
+
+/*
+ * The index file lists every data file with the offsets of its frames, raw
+ * stacks are mapped again when loading. A header line records the format it
+ * was built for:
+ *
+ *   uca-file-index 2
+ *   <width> <height> <bitdepth> <raw-width> <raw-height> <raw-bitdepth>
+ *   T<tab>frame-0.tif<tab><size> <mtime><tab><offset> <offset> ...
+ *   R<tab>stack.raw<tab><size> <mtime>
+ *
+ * Size and modification time in microseconds tell if a file was replaced or
+ * changed since the index was written.
+ */
+static void
+save_index (UcaFileCameraPrivate *priv)
+{
+    GString *contents;
+    gchar *filename;
+    guint source = 0;
+    guint frame = 0;
+    GError *error = NULL;
+
+    contents = g_string_new ("uca-file-index 2\n");
+    g_string_append_printf (contents, "%u %u %u %u %u %u\n",
+                            priv->width, priv->height, priv->bitdepth,
+                            priv->raw_width, priv->raw_height, priv->raw_bitdepth);
+
+    for (guint i = 0; i < priv->fnames->len; i++) {
+        const gchar *fname = g_ptr_array_index (priv->fnames, i);
+        gchar *basename = g_path_get_basename (fname);
+        gboolean has_source;
+        guint64 size;
+        guint64 mtime;
+
+        /* Files that could not be read have no source but keep their line */
+        has_source = source < priv->sources->len &&
+                     g_strcmp0 (g_array_index (priv->sources, Source, source).filename, fname) == 0;
+
+        get_file_stamp (fname, &size, &mtime);
+        g_string_append_printf (contents, "%c\t%s\t%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                                is_raw_file (fname) ? 'R' : 'T', basename, size, mtime);
+
+        if (!is_raw_file (fname))
+            g_string_append_c (contents, '\t');
+
+        for (; has_source && frame < priv->frames->len; frame++) {
+            Frame *f = &g_array_index (priv->frames, Frame, frame);
+
+            if (f->source != source)
+                break;
+
+            if (!is_raw_file (fname))
+                g_string_append_printf (contents, "%" G_GUINT64_FORMAT " ", f->offset);
+        }
+
+        g_string_append_c (contents, '\n');
+
+        if (has_source)
+            source++;
+
+        g_free (basename);
+    }
+
+    filename = get_index_filename (priv);
+
+    if (!g_file_set_contents (filename, contents->str, contents->len, &error)) {
+        g_warning ("Could not write index: %s", error->message);
+        g_error_free (error);
+    }
+
+    g_free (filename);
+    g_string_free (contents, TRUE);
+}
+
+static void
+add_indexed_tiff_frames (UcaFileCameraPrivate *priv, const gchar *fname, const gchar *offsets)
+{
+    Source source;
+    gchar *end;
+
+    while (TRUE) {
+        guint64 offset = g_ascii_strtoull (offsets, &end, 10);
+
+        if (end == offsets)
+            break;
+
+        Frame frame = { priv->sources->len, offset };
+        g_array_append_val (priv->frames, frame);
+        offsets = end;
+    }
+
+    source.filename = g_strdup (fname);
+    source.mapped = NULL;
+    g_array_append_val (priv->sources, source);
+}
+
+static gboolean
+is_unchanged (const gchar *fname, const gchar *stamp)
+{
+    guint64 size;
+    guint64 mtime;
+    guint64 indexed_size;
+    guint64 indexed_mtime;
+
+    if (stamp == NULL ||
+        sscanf (stamp, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &indexed_size, &indexed_mtime) != 2)
+        return FALSE;
+
+    get_file_stamp (fname, &size, &mtime);
+    return size == indexed_size && mtime == indexed_mtime;
+}
+
+/*
+ * Restore the frame index from the index file if it lists exactly the files
+ * found in the directory, none of them changed and it was built for the
+ * format read from the files by update_format().
+ */
+static gboolean
+load_index (UcaFileCameraPrivate *priv)
+{
+    gchar *filename;
+    gchar *contents;
+    gchar **lines;
+    guint format[6];
+    guint n_lines;
+    gboolean valid;
+
+    filename = get_index_filename (priv);
+    valid = g_file_get_contents (filename, &contents, NULL, NULL);
+    g_free (filename);
+
+    if (!valid)
+        return FALSE;
+
+    lines = g_strsplit (contents, "\n", -1);
+    g_free (contents);
+    n_lines = g_strv_length (lines);
+
+    /* The last line is empty because every line ends with a newline */
+    valid = n_lines == priv->fnames->len + 3 &&
+            g_strcmp0 (lines[0], "uca-file-index 2") == 0 &&
+            sscanf (lines[1], "%u %u %u %u %u %u", &format[0], &format[1], &format[2],
+                    &format[3], &format[4], &format[5]) == 6 &&
+            format[0] == priv->width && format[1] == priv->height &&
+            format[2] == priv->bitdepth && format[3] == priv->raw_width &&
+            format[4] == priv->raw_height && format[5] == priv->raw_bitdepth;
+
+    for (guint i = 0; valid && i < priv->fnames->len; i++) {
+        const gchar *fname = g_ptr_array_index (priv->fnames, i);
+        gchar *basename = g_path_get_basename (fname);
+        gchar **fields = g_strsplit (lines[i + 2], "\t", 4);
+
+        valid = fields[0] != NULL && fields[1] != NULL &&
+                g_strcmp0 (fields[1], basename) == 0 &&
+                is_unchanged (fname, fields[2]);
+        g_strfreev (fields);
+        g_free (basename);
+    }
+
+    if (valid) {
+        priv->sources = g_array_new (FALSE, FALSE, sizeof (Source));
+        priv->frames = g_array_new (FALSE, FALSE, sizeof (Frame));
+
+        for (guint i = 0; i < priv->fnames->len; i++) {
+            const gchar *fname = g_ptr_array_index (priv->fnames, i);
+            gchar **fields = g_strsplit (lines[i + 2], "\t", 4);
+
+            if (fields[0][0] == 'R')
+                add_raw_frames (priv, fname);
+            else if (fields[3] != NULL && fields[3][0] != '\0')
+                add_indexed_tiff_frames (priv, fname, fields[3]);
+
+            g_strfreev (fields);
+        }
+    }
+
+    g_strfreev (lines);
+    return valid;
+}
+
+static gboolean
+ensure_index (UcaFileCameraPrivate *priv, GError **error)
+{
+    if (priv->frames == NULL) {
+        priv->sources = g_array_new (FALSE, FALSE, sizeof (Source));
+        priv->frames = g_array_new (FALSE, FALSE, sizeof (Frame));
+
+        for (guint i = 0; i < priv->fnames->len; i++) {
+            const gchar *fname = g_ptr_array_index (priv->fnames, i);
+
+            if (is_raw_file (fname))
+                add_raw_frames (priv, fname);
+            else
+                add_tiff_frames (priv, fname);
+        }
+
+        if (priv->persist_index)
+            save_index (priv);
+    }
+
+    if (priv->frames->len == 0) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
+                     "No frames found in %s", priv->path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Preloaded frames are decoded once, even when replaying them in a loop */
+static guint64
+get_num_fetches (UcaFileCameraPrivate *priv)
+{
+    return priv->loop && !priv->preload ? G_MAXUINT64 : priv->frames->len;
+}
+
+static gpointer
+prefetch_thread (UcaFileCameraPrivate *priv)
+{
+    Reader reader = { NULL, 0 };
+
+    g_mutex_lock (&priv->prefetch_lock);
+
+    while (!priv->stopping && priv->next_fetch < get_num_fetches (priv)) {
+        guint64 index = priv->next_fetch;
+        PrefetchSlot *slot = &priv->slots[index % priv->n_slots];
+        gboolean success;
+
+        /* The slot still holds a frame that was not grabbed yet */
+        if (index >= priv->next_grab + priv->n_slots) {
+            g_cond_wait (&priv->prefetch_cond, &priv->prefetch_lock);
+            continue;
+        }
+
+        priv->next_fetch++;
+        g_mutex_unlock (&priv->prefetch_lock);
+
+        success = read_frame (priv, &reader, (guint) (index % priv->frames->len), slot->data);
+
+        g_mutex_lock (&priv->prefetch_lock);
+        slot->index = index;
+        slot->failed = !success;
+        slot->ready = TRUE;
+        g_cond_broadcast (&priv->prefetch_cond);
+    }
+
+    g_mutex_unlock (&priv->prefetch_lock);
+    reader_close (&reader);
+    return NULL;
+}
+
+static void
+start_prefetch (UcaFileCameraPrivate *priv)
+{
+    gsize frame_size;
+    guint n_frames;
+    guint i;
+
+    frame_size = get_frame_size (priv);
+    n_frames = priv->frames->len;
+    priv->n_slots = priv->preload ? n_frames : MIN (MAX (priv->prefetch_depth, 1), n_frames);
+    priv->slots = g_new0 (PrefetchSlot, priv->n_slots);
+
+    for (i = 0; i < priv->n_slots; i++)
+        priv->slots[i].data = g_malloc (frame_size);
+
+    priv->next_fetch = 0;
+    priv->next_grab = 0;
+    priv->stopping = FALSE;
+    priv->n_readers = MAX (priv->prefetch_threads, 1);
+    priv->readers = g_new (GThread *, priv->n_readers);
+
+    for (i = 0; i < priv->n_readers; i++)
+        priv->readers[i] = g_thread_new ("prefetch", (GThreadFunc) prefetch_thread, priv);
+
+    if (priv->preload) {
+        g_mutex_lock (&priv->prefetch_lock);
+
+        for (i = 0; i < priv->n_slots; i++) {
+            while (!priv->slots[i].ready)
+                g_cond_wait (&priv->prefetch_cond, &priv->prefetch_lock);
+        }
+
+        g_mutex_unlock (&priv->prefetch_lock);
+    }
+}
+
+static void
+stop_prefetch (UcaFileCameraPrivate *priv)
+{
+    if (priv->readers == NULL)
+        return;
+
+    g_mutex_lock (&priv->prefetch_lock);
+    priv->stopping = TRUE;
+    g_cond_broadcast (&priv->prefetch_cond);
+    g_mutex_unlock (&priv->prefetch_lock);
+
+    for (guint i = 0; i < priv->n_readers; i++)
+        g_thread_join (priv->readers[i]);
+
+    for (guint i = 0; i < priv->n_slots; i++)
+        g_free (priv->slots[i].data);
+
+    g_free (priv->readers);
+    g_free (priv->slots);
+    priv->readers = NULL;
+    priv->slots = NULL;
+}
+
+static gboolean
+grab_prefetched (UcaFileCameraPrivate *priv, gpointer data, GError **error)
+{
+    PrefetchSlot *slot;
+    guint64 index;
+    gboolean failed;
+
+    if (!priv->loop && priv->next_grab >= priv->frames->len) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
+                     "End of stream");
+        return FALSE;
+    }
+
+    slot = &priv->slots[priv->next_grab % priv->n_slots];
+    index = priv->preload ? priv->next_grab % priv->n_slots : priv->next_grab;
+
+    g_mutex_lock (&priv->prefetch_lock);
+
+    while (!slot->ready || slot->index != index)
+        g_cond_wait (&priv->prefetch_cond, &priv->prefetch_lock);
+
+    g_mutex_unlock (&priv->prefetch_lock);
+
+    /* No reader touches the slot before next_grab moves past it */
+    failed = slot->failed;
+
+    if (!failed)
+        memcpy (data, slot->data, get_frame_size (priv));
+
+    g_mutex_lock (&priv->prefetch_lock);
+
+    if (!priv->preload)
+        slot->ready = FALSE;
+
+    priv->next_grab++;
+    g_cond_broadcast (&priv->prefetch_cond);
+    g_mutex_unlock (&priv->prefetch_lock);
+
+    if (failed) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
+                     "Error reading frame %u", (guint) (index % priv->frames->len));
+        return FALSE;
+    }
+
     return TRUE;
 }
 
+static gboolean
+has_raw_format (UcaFileCameraPrivate *priv)
+{
+    return priv->raw_width > 0 && priv->raw_height > 0 && priv->raw_bitdepth > 0;
+}
+
+/*
+ * Compare names like strcmp() but order embedded numbers by value, so that
+ * frame-9.tif comes before frame-10.tif.
+ */
+static gint
+compare_natural (gconstpointer a, gconstpointer b)
+{
+    const gchar *s = *(const gchar **) a;
+    const gchar *t = *(const gchar **) b;
+
+    while (*s != '\0' && *t != '\0') {
+        if (g_ascii_isdigit (*s) && g_ascii_isdigit (*t)) {
+            gsize s_digits = 0;
+            gsize t_digits = 0;
+            gint result;
+
+            while (*s == '0')
+                s++;
+
+            while (*t == '0')
+                t++;
+
+            while (g_ascii_isdigit (s[s_digits]))
+                s_digits++;
+
+            while (g_ascii_isdigit (t[t_digits]))
+                t_digits++;
+
+            if (s_digits != t_digits)
+                return s_digits < t_digits ? -1 : 1;
+
+            result = strncmp (s, t, s_digits);
+
+            if (result != 0)
+                return result;
+
+            s += s_digits;
+            t += t_digits;
+        }
+        else if (*s != *t) {
+            return (guchar) *s - (guchar) *t;
+        }
+        else {
+            s++;
+            t++;
+        }
+    }
+
+    if (*s != *t)
+        return (guchar) *s - (guchar) *t;
+
+    /* Numbers that only differ in leading zeros */
+    return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* The first usable file determines the frame format */
+static void
+update_format (UcaFileCameraPrivate *priv)
+{
+    guint i;
+
+    free_index (priv);
+
+    for (i = 0; i < priv->fnames->len; i++) {
+        const gchar *fname = g_ptr_array_index (priv->fnames, i);
+
+        if (is_raw_file (fname)) {
+            if (has_raw_format (priv)) {
+                priv->width = priv->raw_width;
+                priv->height = priv->raw_height;
+                priv->bitdepth = priv->raw_bitdepth;
+                break;
+            }
+
+            g_warning ("Cannot read %s without raw-width, raw-height and raw-bitdepth", fname);
+        }
+        else if (read_tiff_meta_data (priv, fname)) {
+            break;
+        }
+        else {
+            g_warning ("Cannot read %s", fname);
+        }
+    }
+
+    if (priv->fnames->len > 0 && i == priv->fnames->len)
+        g_warning ("No valid tif or raw files found");
+}
+
 static gboolean
 update_fnames (UcaFileCameraPrivate *priv)
 {
@@ -128,13 +895,14 @@ update_fnames (UcaFileCameraPrivate *priv)
     const gchar *fname;
     GError *error = NULL;
 
-    g_list_free_full (priv->fnames, g_free);
-    priv->fnames = NULL;
+    free_index (priv);
+    g_ptr_array_set_size (priv->fnames, 0);
 
     dir = g_dir_open (priv->path, 0, &error);
 
     if (dir == NULL) {
         g_warning ("%s", error->message);
+        g_error_free (error);
         return FALSE;
     }
 
@@ -144,51 +912,184 @@ update_fnames (UcaFileCameraPrivate *priv)
         if (fname == NULL)
             break;
 
-        if (g_str_has_suffix (fname, ".tiff") || g_str_has_suffix (fname, ".tif"))
-            priv->fnames = g_list_append (priv->fnames, g_build_filename (priv->path, fname, NULL));
+        if (g_str_has_suffix (fname, ".tiff") || g_str_has_suffix (fname, ".tif") || is_raw_file (fname))
+            g_ptr_array_add (priv->fnames, g_build_filename (priv->path, fname, NULL));
     }
 
-    priv->fnames = g_list_sort (priv->fnames, (GCompareFunc) g_strcmp0);
-    priv->current = priv->fnames;
+    g_dir_close (dir);
+    g_ptr_array_sort (priv->fnames, compare_natural);
 
-    if (priv->current != NULL) {
-        while (TRUE) {
-            fname = (const gchar *) priv->current->data;
-            if (read_tiff_meta_data (priv, fname)) {
-                break;
-            } else {
-                g_warning ("Cannot read %s", fname);
-            }
-            priv->current = g_list_next (priv->current);
-            if (!priv->current) {
-                g_error ("No valid tif files found");
-            }
-        }
+    /* The format is always read from the files, the index must match it */
+    update_format (priv);
+
+    if (priv->persist_index)
+        load_index (priv);
+
+    return TRUE;
+}
+
+static gboolean
+grab_next (UcaFileCameraPrivate *priv, gpointer data, GError **error)
+{
+    guint index;
+
+    if (priv->readers != NULL)
+        return grab_prefetched (priv, data, error);
+
+    if (!priv->loop && priv->next_grab >= priv->frames->len) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
+                     "End of stream");
+        return FALSE;
     }
 
-    g_dir_close (dir);
+    index = (guint) (priv->next_grab % priv->frames->len);
+
+    if (!read_frame (priv, &priv->reader, index, data)) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
+                     "Error reading frame %u", index);
+        return FALSE;
+    }
+
+    priv->next_grab++;
     return TRUE;
 }
 
+static void
+wait_for_next_frame (UcaFileCameraPrivate *priv)
+{
+    if (priv->paced)
+        uca_pacing_wait_next (&priv->pacing, priv->exposure_time, 0, 0.0);
+}
+
+static void
+count_delivered_frame (UcaFileCameraPrivate *priv)
+{
+    gint64 now = g_get_monotonic_time ();
+
+    if (priv->n_delivered == 0)
+        priv->first_delivery = now;
+
+    priv->last_delivery = now;
+    priv->n_delivered++;
+}
+
+static gdouble
+get_achieved_rate (UcaFileCameraPrivate *priv)
+{
+    if (priv->n_delivered < 2 || priv->last_delivery == priv->first_delivery)
+        return 0.0;
+
+    return (priv->n_delivered - 1) * (gdouble) G_USEC_PER_SEC / (priv->last_delivery - priv->first_delivery);
+}
+
+static gpointer
+file_grab_func (UcaCamera *camera)
+{
+    UcaFileCameraPrivate *priv;
+    GError *error = NULL;
+
+    priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
+
+    while (priv->thread_running) {
+        if (!priv->loop && priv->next_grab >= priv->frames->len)
+            break;
+
+        /* Callbacks cannot report errors, so a broken file ends the stream */
+        if (!grab_next (priv, priv->async_frame, &error)) {
+            g_warning ("%s", error->message);
+            g_error_free (error);
+            break;
+        }
+
+        wait_for_next_frame (priv);
+        count_delivered_frame (priv);
+        camera->grab_func (priv->async_frame, camera->user_data);
+    }
+
+    return NULL;
+}
+
 static void
 uca_file_camera_start_recording(UcaCamera *camera, GError **error)
 {
     UcaFileCameraPrivate *priv;
+    gboolean transfer_async = FALSE;
+
     g_return_if_fail (UCA_IS_FILE_CAMERA (camera));
 
     priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
 
-    if (priv->fnames == NULL) {
-        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
-                     "No files found");
-    }
+    if (!ensure_index (priv, error))
+        return;
 
-    priv->current = priv->fnames;
+    g_object_get (G_OBJECT (camera), "transfer-asynchronously", &transfer_async, NULL);
+
+    priv->next_grab = 0;
+    priv->paced = !priv->free_run;
+    uca_pacing_reset (&priv->pacing);
+    priv->n_delivered = 0;
+
+    if (priv->prefetch_threads > 0 || priv->preload)
+        start_prefetch (priv);
+
+    if (transfer_async) {
+        priv->async_frame = g_malloc (get_frame_size (priv));
+        priv->thread_running = TRUE;
+        priv->grab_thread = g_thread_new ("replay", (GThreadFunc) file_grab_func, camera);
+    }
 }
 
 static void
 uca_file_camera_stop_recording(UcaCamera *camera, GError **error)
 {
+    UcaFileCameraPrivate *priv;
+    g_return_if_fail (UCA_IS_FILE_CAMERA (camera));
+
+    priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
+
+    /* The replay thread may wait for a prefetched frame, so stop it first */
+    if (priv->grab_thread != NULL) {
+        priv->thread_running = FALSE;
+        g_thread_join (priv->grab_thread);
+        g_free (priv->async_frame);
+        priv->grab_thread = NULL;
+        priv->async_frame = NULL;
+    }
+
+    stop_prefetch (priv);
+    reader_close (&priv->reader);
+
+    g_debug ("Replayed %" G_GUINT64_FORMAT " frames at %.2f frames/s [target %.2f frames/s]",
+             priv->n_delivered, get_achieved_rate (priv),
+             priv->paced ? 1.0 / priv->exposure_time : 0.0);
+}
+
+static void
+uca_file_camera_start_readout (UcaCamera *camera, GError **error)
+{
+    UcaFileCameraPrivate *priv;
+    g_return_if_fail (UCA_IS_FILE_CAMERA (camera));
+
+    priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
+
+    if (ensure_index (priv, error)) {
+        priv->next_grab = 0;
+        priv->paced = FALSE;
+    }
+}
+
+static void
+uca_file_camera_stop_readout (UcaCamera *camera, GError **error)
+{
+    UcaFileCameraPrivate *priv;
+    g_return_if_fail (UCA_IS_FILE_CAMERA (camera));
+
+    priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
+    reader_close (&priv->readout_reader);
+
+    /* Grabbing during readout goes through reader, unless it is replaying */
+    if (priv->grab_thread == NULL)
+        reader_close (&priv->reader);
 }
 
 static void
@@ -204,22 +1105,49 @@ uca_file_camera_grab (UcaCamera *camera, gpointer data, GError **error)
 
     priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
 
-    if (priv->current == NULL) {
+    if (!grab_next (priv, data, error))
+        return FALSE;
+
+    wait_for_next_frame (priv);
+    count_delivered_frame (priv);
+    return TRUE;
+}
+
+/*
+ * Frames are counted from 1 like frames recorded into camera memory, so that
+ * clients can read out the file camera the same way as a camRAM.
+ */
+static gboolean
+uca_file_camera_readout (UcaCamera *camera, gpointer data, guint index, GError **error)
+{
+    UcaFileCameraPrivate *priv;
+    g_return_val_if_fail (UCA_IS_FILE_CAMERA (camera), FALSE);
+
+    priv = UCA_FILE_CAMERA_GET_PRIVATE (camera);
+
+    if (index == 0 || index > priv->frames->len) {
         g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
-                     "End of stream");
+                     "Frame %u out of range [1, %u]", index, priv->frames->len);
         return FALSE;
     }
 
-    if (!read_tiff_data (priv, (const gchar *) priv->current->data, data)) {
+    if (!read_frame (priv, &priv->readout_reader, index - 1, data)) {
         g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
-                     "Error reading file");
+                     "Error reading frame %u", index);
         return FALSE;
     }
 
-    priv->current = g_list_next (priv->current);
     return TRUE;
 }
 
+static void
+notify_format (GObject *object)
+{
+    g_object_notify (object, "roi-width");
+    g_object_notify (object, "roi-height");
+    g_object_notify (object, "sensor-bitdepth");
+}
+
 static void
 uca_file_camera_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
 {
@@ -238,10 +1166,48 @@ uca_file_camera_set_property (GObject *object, guint property_id, const GValue *
             priv->path = g_strdup (g_value_get_string (value));
             priv->path = g_strstrip (priv->path);
             update_fnames (priv);
+            notify_format (object);
+            break;
+        case PROP_PREFETCH_THREADS:
+            priv->prefetch_threads = g_value_get_uint (value);
+            break;
+        case PROP_PREFETCH_DEPTH:
+            priv->prefetch_depth = g_value_get_uint (value);
+            break;
+        case PROP_PRELOAD:
+            priv->preload = g_value_get_boolean (value);
+            break;
+        case PROP_RAW_WIDTH:
+            priv->raw_width = g_value_get_uint (value);
+            update_format (priv);
+            notify_format (object);
+            break;
+        case PROP_RAW_HEIGHT:
+            priv->raw_height = g_value_get_uint (value);
+            update_format (priv);
+            notify_format (object);
+            break;
+        case PROP_RAW_BITDEPTH:
+            priv->raw_bitdepth = g_value_get_uint (value);
+            update_format (priv);
+            notify_format (object);
+            break;
+        case PROP_PERSIST_INDEX:
+            priv->persist_index = g_value_get_boolean (value);
 
-            g_object_notify (object, "roi-width");
-            g_object_notify (object, "roi-height");
-            g_object_notify (object, "sensor-bitdepth");
+            if (priv->persist_index) {
+                update_fnames (priv);
+                notify_format (object);
+            }
+            break;
+        case PROP_EXPOSURE_TIME:
+            priv->exposure_time = g_value_get_double (value);
+            break;
+        case PROP_LOOP:
+            priv->loop = g_value_get_boolean (value);
+            break;
+        case PROP_FREE_RUN:
+            priv->free_run = g_value_get_boolean (value);
             break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -281,7 +1247,7 @@ uca_file_camera_get_property(GObject *object, guint property_id, GValue *value,
             g_value_set_uint (value, priv->height);
             break;
         case PROP_EXPOSURE_TIME:
-            g_value_set_double (value, 0.1);
+            g_value_set_double (value, priv->exposure_time);
             break;
         case PROP_HAS_STREAMING:
             g_value_set_boolean (value, TRUE);
@@ -289,9 +1255,42 @@ uca_file_camera_get_property(GObject *object, guint property_id, GValue *value,
         case PROP_HAS_CAMRAM_RECORDING:
             g_value_set_boolean (value, FALSE);
             break;
+        case PROP_RECORDED_FRAMES:
+            g_value_set_uint (value, priv->frames != NULL ? priv->frames->len : 0);
+            break;
         case PROP_PATH:
             g_value_set_string (value, priv->path);
             break;
+        case PROP_PREFETCH_THREADS:
+            g_value_set_uint (value, priv->prefetch_threads);
+            break;
+        case PROP_PREFETCH_DEPTH:
+            g_value_set_uint (value, priv->prefetch_depth);
+            break;
+        case PROP_PRELOAD:
+            g_value_set_boolean (value, priv->preload);
+            break;
+        case PROP_RAW_WIDTH:
+            g_value_set_uint (value, priv->raw_width);
+            break;
+        case PROP_RAW_HEIGHT:
+            g_value_set_uint (value, priv->raw_height);
+            break;
+        case PROP_RAW_BITDEPTH:
+            g_value_set_uint (value, priv->raw_bitdepth);
+            break;
+        case PROP_PERSIST_INDEX:
+            g_value_set_boolean (value, priv->persist_index);
+            break;
+        case PROP_LOOP:
+            g_value_set_boolean (value, priv->loop);
+            break;
+        case PROP_FREE_RUN:
+            g_value_set_boolean (value, priv->free_run);
+            break;
+        case PROP_ACHIEVED_FRAMES_PER_SECOND:
+            g_value_set_double (value, get_achieved_rate (priv));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
             break;
@@ -305,7 +1304,12 @@ uca_file_camera_finalize(GObject *object)
 
     priv = UCA_FILE_CAMERA_GET_PRIVATE(object);
 
-    g_list_free_full (priv->fnames, g_free);
+    stop_prefetch (priv);
+    g_mutex_clear (&priv->prefetch_lock);
+    g_cond_clear (&priv->prefetch_cond);
+
+    free_index (priv);
+    g_ptr_array_free (priv->fnames, TRUE);
     priv->fnames = NULL;
 
     G_OBJECT_CLASS(uca_file_camera_parent_class)->finalize(object);
@@ -338,6 +1342,9 @@ uca_file_camera_class_init(UcaFileCameraClass *klass)
     camera_class->start_recording = uca_file_camera_start_recording;
     camera_class->stop_recording = uca_file_camera_stop_recording;
     camera_class->grab = uca_file_camera_grab;
+    camera_class->readout = uca_file_camera_readout;
+    camera_class->start_readout = uca_file_camera_start_readout;
+    camera_class->stop_readout = uca_file_camera_stop_readout;
     camera_class->trigger = uca_file_camera_trigger;
 
     for (guint i = 0; file_overrideables[i] != 0; i++)
@@ -345,11 +1352,81 @@ uca_file_camera_class_init(UcaFileCameraClass *klass)
 
     file_properties[PROP_PATH] =
         g_param_spec_string ("path",
-                "Path to directory containing TIFF files",
-                "Path to directory containing TIFF files",
+                "Path to directory containing TIFF and raw files",
+                "Path to directory containing TIFF and raw files",
                 ".",
                 G_PARAM_READWRITE);
 
+    file_properties[PROP_PREFETCH_THREADS] =
+        g_param_spec_uint ("prefetch-threads",
+                "Number of threads decoding files ahead",
+                "Number of threads decoding files ahead of grabbing, 0 decodes on grab",
+                0, 64, 2,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_PREFETCH_DEPTH] =
+        g_param_spec_uint ("prefetch-depth",
+                "Number of frames decoded ahead",
+                "Number of frames decoded ahead of grabbing",
+                1, G_MAXUINT, 8,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_PRELOAD] =
+        g_param_spec_boolean ("preload",
+                "Decode all files when recording starts",
+                "Decode all files into memory when recording starts",
+                FALSE,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_RAW_WIDTH] =
+        g_param_spec_uint ("raw-width",
+                "Width of frames in raw files",
+                "Width of frames in raw files, 0 ignores raw files",
+                0, G_MAXUINT, 0,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_RAW_HEIGHT] =
+        g_param_spec_uint ("raw-height",
+                "Height of frames in raw files",
+                "Height of frames in raw files, 0 ignores raw files",
+                0, G_MAXUINT, 0,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_RAW_BITDEPTH] =
+        g_param_spec_uint ("raw-bitdepth",
+                "Bits per pixel in raw files",
+                "Bits per pixel as stored in raw files, 0 ignores raw files",
+                0, 32, 0,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_PERSIST_INDEX] =
+        g_param_spec_boolean ("persist-index",
+                "Keep the frame index in the data directory",
+                "Keep the frame index in " INDEX_FILENAME " to reopen the directory without reading all files",
+                FALSE,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_LOOP] =
+        g_param_spec_boolean ("loop",
+                "Replay frames endlessly",
+                "Start again with the first frame instead of ending the stream",
+                FALSE,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_FREE_RUN] =
+        g_param_spec_boolean ("free-run",
+                "Deliver frames as fast as possible",
+                "Deliver frames as fast as possible instead of one per exposure time",
+                TRUE,
+                G_PARAM_READWRITE);
+
+    file_properties[PROP_ACHIEVED_FRAMES_PER_SECOND] =
+        g_param_spec_double ("achieved-frames-per-second",
+                "Achieved frame rate",
+                "Frame rate delivered since recording started",
+                0.0, G_MAXDOUBLE, 0.0,
+                G_PARAM_READABLE);
+
     for (guint id = N_BASE_PROPERTIES; id < N_PROPERTIES; id++)
         g_object_class_install_property (gobject_class, id, file_properties[id]);
 
@@ -366,9 +1443,34 @@ uca_file_camera_init(UcaFileCamera *self)
     priv->width = 512;
     priv->height = 512;
     priv->bitdepth = 8;
-
-    priv->fnames = NULL;
+    priv->prefetch_threads = 2;
+    priv->prefetch_depth = 8;
+    priv->preload = FALSE;
+    priv->raw_width = 0;
+    priv->raw_height = 0;
+    priv->raw_bitdepth = 0;
+    priv->sources = NULL;
+    priv->frames = NULL;
+    priv->reader.file = NULL;
+    priv->readout_reader.file = NULL;
+    priv->slots = NULL;
+    priv->readers = NULL;
+    priv->loop = FALSE;
+    priv->free_run = TRUE;
+    priv->exposure_time = 0.1;
+    priv->paced = FALSE;
+    priv->n_delivered = 0;
+    priv->grab_thread = NULL;
+    priv->thread_running = FALSE;
+    priv->async_frame = NULL;
+    g_mutex_init (&priv->prefetch_lock);
+    g_cond_init (&priv->prefetch_cond);
+
+    priv->fnames = g_ptr_array_new_with_free_func (g_free);
+    priv->persist_index = FALSE;
     update_fnames (priv);
+
+    uca_camera_register_unit (UCA_CAMERA (self), "achieved-frames-per-second", UCA_UNIT_COUNT);
 }
 
 G_MODULE_EXPORT GType
@@ -19,7 +19,12 @@
 #include <gio/gio.h>
 #include <string.h>
 #include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "uca-mock-camera.h"
+#include "uca-ring-buffer.h"
+#include "uca-pacing.h"
 
 #define UCA_MOCK_CAMERA_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UCA_TYPE_MOCK_CAMERA, UcaMockCameraPrivate))
 
@@ -33,6 +38,21 @@ enum {
     PROP_FILL_DATA = N_BASE_PROPERTIES,
     PROP_DEGREE_VALUE,
     PROP_TEST_ENUM,
+    PROP_FREE_RUN,
+    PROP_SPIN_TIME,
+    PROP_CONTENT,
+    PROP_POOL_SIZE,
+    PROP_CAMRAM_SIZE,
+    PROP_CAMRAM_FILE,
+    PROP_CAMRAM_BANDWIDTH,
+    PROP_FAULT_SEED,
+    PROP_JITTER,
+    PROP_JITTER_DISTRIBUTION,
+    PROP_STALL_PERIOD,
+    PROP_STALL_TIME,
+    PROP_DROP_PROBABILITY,
+    PROP_ERROR_PROBABILITY,
+    PROP_TRIGGER_DELAY,
     N_PROPERTIES
 };
 
@@ -48,6 +68,7 @@ static const gint mock_overrideables[] = {
     PROP_ROI_HEIGHT,
     PROP_HAS_STREAMING,
     PROP_HAS_CAMRAM_RECORDING,
+    PROP_RECORDED_FRAMES,
     0,
 };
 
@@ -56,6 +77,17 @@ static GParamSpec *mock_properties[N_PROPERTIES] = { NULL, };
 static GMutex signal_mutex;
 static GCond signal_cond;
 
+#define NOISE_LANES 4
+
+/*
+ * Independent xorshift128+ generators, stored so that SSE2 can advance two of
+ * them with one register.
+ */
+typedef struct {
+    guint64 s0[NOISE_LANES];
+    guint64 s1[NOISE_LANES];
+} NoiseState;
+
 struct _UcaMockCameraPrivate {
     guint width;
     guint height;
@@ -67,11 +99,58 @@ struct _UcaMockCameraPrivate {
     gdouble exposure_time;
     guint8 *dummy_data;
     guint current_frame;
+    gint64 frame_timestamp;
     guint readout_index;
     gboolean fill_data;
     gdouble degree_value;
     GRand *rand;
 
+    /*
+     * Pool frames are generated in start_recording, only their frame counter
+     * is redrawn when they are delivered.
+     */
+    UcaMockCameraContent content;
+    guint pool_size;
+    guint8 *pool;
+    NoiseState noise;
+    gint32 *noise_row;
+
+    gboolean free_run;
+    gdouble spin_time;
+    UcaPacing pacing;
+
+    /*
+     * Frames recorded during acquisition are kept in camram, which wraps
+     * around like a camera in ring buffer mode. camram_lock protects writing
+     * frames against reading them while recording.
+     */
+    guint camram_size;
+    gchar *camram_file;
+    gdouble camram_bandwidth;
+    UcaRingBuffer *camram;
+    guint64 n_recorded;
+    GMutex camram_lock;
+    GCond camram_cond;
+    gboolean is_readout;
+    guint readout_next;
+    gint64 transfer_deadline;
+
+    /*
+     * Injected faults are drawn from fault_rand, which is seeded with
+     * fault_seed at the start of each recording to make them reproducible.
+     */
+    guint fault_seed;
+    GRand *fault_rand;
+    gdouble jitter;
+    UcaMockCameraJitter jitter_distribution;
+    guint stall_period;
+    gdouble stall_time;
+    gdouble drop_probability;
+    gdouble error_probability;
+    gdouble trigger_delay;
+    guint64 n_produced;
+
+    gboolean transfer_async;
     gboolean thread_running;
 
     GThread *grab_thread;
@@ -205,17 +284,146 @@ print_number (guint8 *buffer, guint number, guint x, guint y, guint n_bytes, gui
     }
 }
 
+static inline gsize
+frame_size (UcaMockCameraPrivate *priv)
+{
+    return (gsize) priv->roi_width * priv->roi_height * priv->bytes;
+}
+
+static inline guint64
+xorshift128plus (guint64 *s0, guint64 *s1)
+{
+    guint64 x = *s0;
+    const guint64 y = *s1;
+
+    *s0 = y;
+    x ^= x << 23;
+    *s1 = x ^ y ^ (x >> 17) ^ (y >> 26);
+    return *s1 + y;
+}
+
+#ifdef __SSE2__
+static inline __m128i
+xorshift128plus_sse2 (__m128i *s0, __m128i *s1)
+{
+    __m128i x = *s0;
+    const __m128i y = *s1;
+
+    *s0 = y;
+    x = _mm_xor_si128 (x, _mm_slli_epi64 (x, 23));
+    *s1 = _mm_xor_si128 (_mm_xor_si128 (x, y),
+                         _mm_xor_si128 (_mm_srli_epi64 (x, 17), _mm_srli_epi64 (y, 26)));
+    return _mm_add_epi64 (*s1, y);
+}
+#endif
+
 static void
-print_current_frame (UcaMockCameraPrivate *priv, guint8 *buffer, gboolean prefix)
+seed_noise (NoiseState *state, GRand *rand)
+{
+    for (guint i = 0; i < NOISE_LANES; i++) {
+        state->s0[i] = ((guint64) g_rand_int (rand) << 32) | g_rand_int (rand);
+        /* xorshift128+ must not start from an all-zero state */
+        state->s1[i] = ((guint64) g_rand_int (rand) << 32) | g_rand_int (rand) | 1;
+    }
+}
+
+/*
+ * Write n samples of approximately normal noise to out, n must be a multiple of
+ * NOISE_LANES. Instead of Box-Muller, a sample is the sum of the four signed
+ * 16-bit parts of one random number. This has mean -2 and standard deviation
+ * 2^16 / sqrt(3), is close enough to a Gaussian for test images and needs no
+ * transcendental functions. The SSE2 and the scalar path produce the same
+ * numbers.
+ */
+static void
+generate_noise (NoiseState *state, gint32 *out, guint n, gfloat mean, gfloat std)
+{
+    const gfloat scale = std * 1.7320508f / 65536.0f;
+    const gfloat offset = mean + 2.0f * scale;
+
+#ifdef __SSE2__
+    const __m128i ones = _mm_set1_epi16 (1);
+    const __m128 vscale = _mm_set1_ps (scale);
+    const __m128 voffset = _mm_set1_ps (offset);
+    __m128i a0 = _mm_loadu_si128 ((__m128i *) &state->s0[0]);
+    __m128i b0 = _mm_loadu_si128 ((__m128i *) &state->s1[0]);
+    __m128i a1 = _mm_loadu_si128 ((__m128i *) &state->s0[2]);
+    __m128i b1 = _mm_loadu_si128 ((__m128i *) &state->s1[2]);
+
+    for (guint i = 0; i < n; i += NOISE_LANES) {
+        __m128i r0 = xorshift128plus_sse2 (&a0, &b0);
+        __m128i r1 = xorshift128plus_sse2 (&a1, &b1);
+        __m128i sums;
+
+        /* Add up the 16-bit parts in the lower half of each 64-bit lane */
+        r0 = _mm_madd_epi16 (r0, ones);
+        r1 = _mm_madd_epi16 (r1, ones);
+        r0 = _mm_add_epi32 (r0, _mm_srli_epi64 (r0, 32));
+        r1 = _mm_add_epi32 (r1, _mm_srli_epi64 (r1, 32));
+        sums = _mm_unpacklo_epi64 (_mm_shuffle_epi32 (r0, _MM_SHUFFLE (3, 1, 2, 0)),
+                                   _mm_shuffle_epi32 (r1, _MM_SHUFFLE (3, 1, 2, 0)));
+
+        _mm_storeu_si128 ((__m128i *) &out[i],
+                          _mm_cvtps_epi32 (_mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (sums), vscale), voffset)));
+    }
+
+    _mm_storeu_si128 ((__m128i *) &state->s0[0], a0);
+    _mm_storeu_si128 ((__m128i *) &state->s1[0], b0);
+    _mm_storeu_si128 ((__m128i *) &state->s0[2], a1);
+    _mm_storeu_si128 ((__m128i *) &state->s1[2], b1);
+#else
+    for (guint i = 0; i < n; i += NOISE_LANES) {
+        for (guint j = 0; j < NOISE_LANES; j++) {
+            guint64 r = xorshift128plus (&state->s0[j], &state->s1[j]);
+            gint32 sum = (gint16) r + (gint16) (r >> 16) + (gint16) (r >> 32) + (gint16) (r >> 48);
+
+            out[i + j] = (gint32) lrintf ((gfloat) sum * scale + offset);
+        }
+    }
+#endif
+}
+
+static void
+fill_noise (UcaMockCameraPrivate *priv, guint8 *buffer)
+{
+    const gfloat mean = (gfloat) ceil (priv->max_val / 2.);
+    const gfloat std = (gfloat) ceil (priv->max_val / 8.);
+    const guint x_start = priv->roi_width / 3;
+    const guint n_pixels = (priv->roi_width * 2) / 3 - x_start;
+    const guint n_samples = (n_pixels + NOISE_LANES - 1) / NOISE_LANES * NOISE_LANES;
+
+    for (guint y = (priv->roi_height / 3); y < ((priv->roi_height * 2) / 3); y++) {
+        gsize offset = (gsize) y * priv->roi_width + x_start;
+        const gint32 *noise = priv->noise_row;
+
+        generate_noise (&priv->noise, priv->noise_row, n_samples, mean, std);
+
+        if (priv->bytes == 1) {
+            guint8 *dst = buffer + offset;
+
+            for (guint x = 0; x < n_pixels; x++)
+                dst[x] = (guint8) (noise[x] & priv->max_val);
+        }
+        else if (priv->bytes == 2) {
+            guint16 *dst = ((guint16 *) buffer) + offset;
+
+            for (guint x = 0; x < n_pixels; x++)
+                dst[x] = GUINT16_TO_LE ((guint16) (noise[x] & priv->max_val));
+        }
+        else {
+            for (guint x = 0; x < n_pixels; x++)
+                set_pixel (buffer, x_start + x, y, noise[x], priv->bytes, priv->max_val, priv->roi_width);
+        }
+    }
+}
+
+static void
+print_counter (UcaMockCameraPrivate *priv, guint8 *buffer, gboolean prefix)
 {
-    const double mean = (double) ceil (priv->max_val / 2.);
-    const double std = (double) ceil (priv->max_val / 8.);
     guint divisor = 10000000;
     guint number = priv->current_frame;
     int x = 2;
 
-    memset(buffer, 0, 15 * priv->roi_width * priv->bytes);
-
     if (prefix) {
         number = priv->readout_index;
         print_number(buffer, 11, x, 1, priv->bytes, priv->max_val, priv->roi_width);
@@ -230,15 +438,217 @@ print_current_frame (UcaMockCameraPrivate *priv, guint8 *buffer, gboolean prefix
         divisor = divisor / 10;
         x += DIGIT_WIDTH + 1;
     }
+}
 
-    for (guint y = (priv->roi_height / 3); y < ((priv->roi_height * 2) / 3); y++) {
-        for (guint x = (priv->roi_width / 3); x < ((priv->roi_width * 2) / 3); x++) {
-            double u1 = g_rand_double (priv->rand);
-            double u2 = g_rand_double (priv->rand);
-            double r = sqrt (-2 * log(u1)) * cos(2 * G_PI * u2);
-            set_pixel (buffer, x, y, round (r * std + mean), priv->bytes, priv->max_val, priv->roi_width);
+static void
+print_current_frame (UcaMockCameraPrivate *priv, guint8 *buffer, gboolean prefix)
+{
+    memset(buffer, 0, 15 * priv->roi_width * priv->bytes);
+    print_counter (priv, buffer, prefix);
+    fill_noise (priv, buffer);
+}
+
+/*
+ * Return the frame to deliver for the current content mode. Pool and constant
+ * frames are prepared in start_recording, only the noise mode draws new pixels
+ * here.
+ */
+static guint8 *
+render_frame (UcaMockCameraPrivate *priv, gboolean prefix)
+{
+    guint8 *frame;
+
+    switch (priv->content) {
+        case UCA_MOCK_CAMERA_CONTENT_POOL:
+            frame = priv->pool + (priv->current_frame % priv->pool_size) * frame_size (priv);
+            print_counter (priv, frame, prefix);
+            return frame;
+        case UCA_MOCK_CAMERA_CONTENT_CONSTANT:
+            return priv->dummy_data;
+        default:
+            print_current_frame (priv, priv->dummy_data, prefix);
+            return priv->dummy_data;
+    }
+}
+
+static void
+prepare_content (UcaMockCameraPrivate *priv)
+{
+    gsize size = frame_size (priv);
+
+    priv->dummy_data = (guint8 *) g_malloc0 (size);
+    priv->noise_row = g_new (gint32, priv->roi_width / 3 + NOISE_LANES);
+    seed_noise (&priv->noise, priv->rand);
+
+    if (priv->content == UCA_MOCK_CAMERA_CONTENT_POOL) {
+        priv->pool = (guint8 *) g_malloc0 (priv->pool_size * size);
+
+        for (guint i = 0; i < priv->pool_size; i++)
+            fill_noise (priv, priv->pool + i * size);
+    }
+    else if (priv->content == UCA_MOCK_CAMERA_CONTENT_CONSTANT) {
+        print_current_frame (priv, priv->dummy_data, FALSE);
+    }
+}
+
+static void
+free_content (UcaMockCameraPrivate *priv)
+{
+    g_free (priv->dummy_data);
+    g_free (priv->pool);
+    g_free (priv->noise_row);
+    priv->dummy_data = NULL;
+    priv->pool = NULL;
+    priv->noise_row = NULL;
+}
+
+static gboolean
+inject_fault (UcaMockCameraPrivate *priv, gdouble probability)
+{
+    return probability > 0.0 && g_rand_double (priv->fault_rand) < probability;
+}
+
+/* Time in seconds by which the next frame is late because of jitter and stalls */
+static gdouble
+sample_delay (UcaMockCameraPrivate *priv)
+{
+    gdouble delay = 0.0;
+
+    if (priv->jitter > 0.0) {
+        switch (priv->jitter_distribution) {
+            case UCA_MOCK_CAMERA_JITTER_UNIFORM:
+                delay = g_rand_double_range (priv->fault_rand, -priv->jitter, priv->jitter);
+                break;
+            case UCA_MOCK_CAMERA_JITTER_GAUSSIAN:
+                {
+                    gdouble u1 = 1.0 - g_rand_double (priv->fault_rand);
+                    gdouble u2 = g_rand_double (priv->fault_rand);
+                    delay = priv->jitter * sqrt (-2 * log (u1)) * cos (2 * G_PI * u2);
+                }
+                break;
+            case UCA_MOCK_CAMERA_JITTER_EXPONENTIAL:
+                delay = -priv->jitter * log (1.0 - g_rand_double (priv->fault_rand));
+                break;
         }
     }
+
+    priv->n_produced++;
+
+    if (priv->stall_period > 0 && priv->n_produced % priv->stall_period == 0)
+        delay += priv->stall_time;
+
+    return delay;
+}
+
+static void
+wait_for_next_frame (UcaMockCameraPrivate *priv)
+{
+    gint64 delay;
+
+    delay = (gint64) (sample_delay (priv) * G_USEC_PER_SEC);
+
+    if (priv->free_run) {
+        if (delay > 0)
+            uca_pacing_wait_until (g_get_monotonic_time () + delay, priv->spin_time);
+
+        return;
+    }
+
+    uca_pacing_wait_next (&priv->pacing, priv->exposure_time, delay, priv->spin_time);
+}
+
+/* Return the recorded frame at index, counted from the oldest one */
+static guint8 *
+get_recorded_frame (UcaMockCameraPrivate *priv, guint index)
+{
+    return uca_ring_buffer_get_pointer (priv->camram, index);
+}
+
+static guint
+get_num_recorded (UcaMockCameraPrivate *priv)
+{
+    return priv->camram != NULL ? uca_ring_buffer_get_num_blocks (priv->camram) : 0;
+}
+
+static void
+record_frame (UcaMockCameraPrivate *priv, const guint8 *frame)
+{
+    g_mutex_lock (&priv->camram_lock);
+    memcpy (uca_ring_buffer_get_write_pointer (priv->camram), frame, frame_size (priv));
+    uca_ring_buffer_write_advance (priv->camram);
+    priv->n_recorded++;
+    g_cond_broadcast (&priv->camram_cond);
+    g_mutex_unlock (&priv->camram_lock);
+}
+
+/*
+ * Simulate transferring a frame out of the camera memory. Idle time between
+ * two transfers does not make the following ones faster.
+ */
+static void
+limit_bandwidth (UcaMockCameraPrivate *priv)
+{
+    gint64 duration;
+
+    if (priv->camram_bandwidth <= 0.0)
+        return;
+
+    duration = (gint64) (frame_size (priv) / priv->camram_bandwidth * G_USEC_PER_SEC);
+    priv->transfer_deadline = MAX (priv->transfer_deadline, g_get_monotonic_time ()) + duration;
+    uca_pacing_wait_until (priv->transfer_deadline, priv->spin_time);
+}
+
+static gboolean
+read_recorded_frame (UcaMockCameraPrivate *priv, gpointer data, guint index, GError **error)
+{
+    guint n_recorded;
+
+    if (frame_size (priv) != uca_ring_buffer_get_block_size (priv->camram)) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_DEVICE,
+                     "Region of interest changed since the frames were recorded");
+        return FALSE;
+    }
+
+    g_mutex_lock (&priv->camram_lock);
+    n_recorded = get_num_recorded (priv);
+
+    /* Like pco cameras, the oldest recorded frame has index 1 */
+    if (index == 0 || index > n_recorded) {
+        g_mutex_unlock (&priv->camram_lock);
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
+                     "Frame %u not in camera memory holding %u frames", index, n_recorded);
+        return FALSE;
+    }
+
+    memcpy (data, get_recorded_frame (priv, index - 1), frame_size (priv));
+    g_mutex_unlock (&priv->camram_lock);
+
+    limit_bandwidth (priv);
+    return TRUE;
+}
+
+/* Wait for the recorder thread to record a new frame and copy it */
+static gboolean
+grab_recorded_frame (UcaMockCameraPrivate *priv, gpointer data, GError **error)
+{
+    guint64 n_recorded;
+
+    g_mutex_lock (&priv->camram_lock);
+    n_recorded = priv->n_recorded;
+
+    while (priv->n_recorded == n_recorded && priv->thread_running)
+        g_cond_wait (&priv->camram_cond, &priv->camram_lock);
+
+    if (priv->n_recorded == n_recorded) {
+        g_mutex_unlock (&priv->camram_lock);
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING,
+                     "Recording stopped while waiting for a frame");
+        return FALSE;
+    }
+
+    memcpy (data, get_recorded_frame (priv, get_num_recorded (priv) - 1), frame_size (priv));
+    g_mutex_unlock (&priv->camram_lock);
+    return TRUE;
 }
 
 static gpointer
@@ -249,18 +659,55 @@ mock_grab_func(gpointer data)
 
     UcaMockCameraPrivate *priv = UCA_MOCK_CAMERA_GET_PRIVATE(mock_camera);
     UcaCamera *camera = UCA_CAMERA(mock_camera);
-    gdouble fps = 0;
-    g_object_get (G_OBJECT (data), "frames-per-second", &fps, NULL);
-    const gulong sleep_time = (gulong) G_USEC_PER_SEC / fps;
 
     while (priv->thread_running) {
-        camera->grab_func(priv->dummy_data, camera->user_data);
-        g_usleep(sleep_time);
+        guint8 *frame = priv->fill_data ? render_frame (priv, FALSE) : priv->dummy_data;
+        /* Asynchronous callbacks cannot fail, so errors lose the frame as well */
+        gboolean lost = inject_fault (priv, priv->drop_probability) ||
+                        inject_fault (priv, priv->error_probability);
+
+        priv->frame_timestamp = g_get_monotonic_time ();
+        priv->current_frame++;
+
+        if (priv->camram != NULL)
+            record_frame (priv, frame);
+
+        if (priv->transfer_async && !lost)
+            camera->grab_func(frame, camera->user_data);
+
+        wait_for_next_frame (priv);
     }
 
     return NULL;
 }
 
+static gboolean
+allocate_camram (UcaMockCameraPrivate *priv, GError **error)
+{
+    if (priv->camram != NULL) {
+        g_object_unref (priv->camram);
+        priv->camram = NULL;
+    }
+
+    priv->n_recorded = 0;
+
+    if (priv->camram_size == 0)
+        return TRUE;
+
+    if (priv->camram_file != NULL) {
+        priv->camram = uca_ring_buffer_new_mapped (priv->camram_file, frame_size (priv), priv->camram_size,
+                                                   UCA_RING_BUFFER_ALLOC_DEFAULT, error);
+
+        if (priv->camram == NULL)
+            return FALSE;
+    }
+    else {
+        priv->camram = uca_ring_buffer_new (frame_size (priv), priv->camram_size);
+    }
+
+    return TRUE;
+}
+
 
 static void
 uca_mock_camera_start_recording(UcaCamera *camera, GError **error)
@@ -272,15 +719,28 @@ uca_mock_camera_start_recording(UcaCamera *camera, GError **error)
     priv = UCA_MOCK_CAMERA_GET_PRIVATE(camera);
 
     /* TODO: check that roi_x + roi_width < priv->width */
-    priv->dummy_data = (guint8 *) g_malloc0(priv->roi_width * priv->roi_height * priv->bytes);
+    if (!allocate_camram (priv, error))
+        return;
+
+    prepare_content (priv);
 
     g_object_get(G_OBJECT(camera), "transfer-asynchronously", &transfer_async, NULL);
 
+    priv->transfer_async = transfer_async;
+    uca_pacing_reset (&priv->pacing);
+    priv->n_produced = 0;
+
+    if (priv->fault_rand != NULL)
+        g_rand_free (priv->fault_rand);
+
+    priv->fault_rand = g_rand_new_with_seed (priv->fault_seed);
+
     /*
-     * In case asynchronous transfer is requested, we start a new thread that
-     * invokes the grab callback, otherwise nothing will be done here.
+     * In case asynchronous transfer is requested or frames are recorded into
+     * camera memory, we start a new thread that produces frames at the frame
+     * rate, otherwise nothing will be done here.
      */
-    if (transfer_async) {
+    if (transfer_async || priv->camram != NULL) {
         GError *tmp_error = NULL;
         priv->thread_running = TRUE;
 #if GLIB_CHECK_VERSION (2, 32, 0)
@@ -299,22 +759,49 @@ uca_mock_camera_start_recording(UcaCamera *camera, GError **error)
 static void
 uca_mock_camera_stop_recording(UcaCamera *camera, GError **error)
 {
-    gboolean transfer_async = FALSE;
     UcaMockCameraPrivate *priv;
     g_return_if_fail(UCA_IS_MOCK_CAMERA(camera));
 
     priv = UCA_MOCK_CAMERA_GET_PRIVATE(camera);
-    g_free(priv->dummy_data);
-    priv->dummy_data = NULL;
 
-    g_object_get(G_OBJECT(camera),
-            "transfer-asynchronously", &transfer_async,
-            NULL);
-
-    if (transfer_async) {
+    if (priv->thread_running) {
+        g_mutex_lock (&priv->camram_lock);
         priv->thread_running = FALSE;
+        g_cond_broadcast (&priv->camram_cond);
+        g_mutex_unlock (&priv->camram_lock);
         g_thread_join(priv->grab_thread);
     }
+
+    free_content (priv);
+}
+
+static void
+uca_mock_camera_start_readout (UcaCamera *camera, GError **error)
+{
+    UcaMockCameraPrivate *priv;
+
+    g_return_if_fail (UCA_IS_MOCK_CAMERA (camera));
+    priv = UCA_MOCK_CAMERA_GET_PRIVATE (camera);
+
+    if (get_num_recorded (priv) == 0) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING,
+                     "No frames recorded into camera memory");
+        return;
+    }
+
+    priv->is_readout = TRUE;
+    priv->readout_next = 1;
+    priv->transfer_deadline = 0;
+}
+
+static void
+uca_mock_camera_stop_readout (UcaCamera *camera, GError **error)
+{
+    UcaMockCameraPrivate *priv;
+
+    g_return_if_fail (UCA_IS_MOCK_CAMERA (camera));
+    priv = UCA_MOCK_CAMERA_GET_PRIVATE (camera);
+    priv->is_readout = FALSE;
 }
 
 static void
@@ -328,6 +815,59 @@ uca_mock_camera_trigger (UcaCamera *camera, GError **error)
     g_async_queue_push (priv->trigger_queue, g_malloc0 (1));
 }
 
+static gboolean
+grab_frame (UcaMockCameraPrivate *priv, gpointer data, gdouble exposure_time, UcaCameraTriggerSource trigger_source, GError **error)
+{
+    /* Read out camera memory frame by frame */
+    if (priv->is_readout) {
+        if (!read_recorded_frame (priv, data, priv->readout_next, error))
+            return FALSE;
+
+        priv->readout_next++;
+        return TRUE;
+    }
+
+    /* The recorder thread produces frames, deliver the next one */
+    if (priv->camram != NULL && priv->thread_running)
+        return grab_recorded_frame (priv, data, error);
+
+    if (trigger_source == UCA_CAMERA_TRIGGER_SOURCE_SOFTWARE) {
+        gdouble delay = priv->trigger_delay + sample_delay (priv);
+
+        g_free (g_async_queue_pop (priv->trigger_queue));
+
+        if (!priv->free_run)
+            delay += exposure_time;
+
+        if (delay > 0.0)
+            uca_pacing_wait_until (g_get_monotonic_time () + (gint64) (G_USEC_PER_SEC * delay), priv->spin_time);
+    }
+    else {
+        wait_for_next_frame (priv);
+
+        /* Dropped frames never arrive, wait for the next one */
+        while (inject_fault (priv, priv->drop_probability)) {
+            priv->current_frame++;
+            wait_for_next_frame (priv);
+        }
+    }
+
+    priv->frame_timestamp = g_get_monotonic_time ();
+
+    if (inject_fault (priv, priv->error_probability)) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_DEVICE,
+                     "Injected error while transferring frame %u", priv->current_frame);
+        priv->current_frame++;
+        return FALSE;
+    }
+
+    if (priv->fill_data)
+        memcpy (data, render_frame (priv, FALSE), frame_size (priv));
+
+    priv->current_frame++;
+    return TRUE;
+}
+
 static gboolean
 uca_mock_camera_grab (UcaCamera *camera, gpointer data, GError **error)
 {
@@ -344,20 +884,44 @@ uca_mock_camera_grab (UcaCamera *camera, gpointer data, GError **error)
                   "exposure-time", &exposure_time,
                   "trigger-source", &trigger_source, NULL);
 
-    if (trigger_source == UCA_CAMERA_TRIGGER_SOURCE_SOFTWARE)
-        g_free (g_async_queue_pop (priv->trigger_queue));
+    return grab_frame (priv, data, exposure_time, trigger_source, error);
+}
+
+static guint
+uca_mock_camera_grab_n (UcaCamera *camera, gpointer *frames, guint n_frames, GError **error)
+{
+    UcaMockCameraPrivate *priv;
+    UcaCameraTriggerSource trigger_source;
+    gdouble exposure_time;
 
+    g_return_val_if_fail (UCA_IS_MOCK_CAMERA(camera), 0);
 
-    g_usleep (G_USEC_PER_SEC * exposure_time);
+    priv = UCA_MOCK_CAMERA_GET_PRIVATE (camera);
 
-    if (priv->fill_data) {
-        print_current_frame (priv, priv->dummy_data, FALSE);
-        g_memmove (data, priv->dummy_data, priv->roi_width * priv->roi_height * priv->bytes);
+    /* Look up the properties once per batch instead of once per frame */
+    g_object_get (G_OBJECT (camera),
+                  "exposure-time", &exposure_time,
+                  "trigger-source", &trigger_source, NULL);
+
+    for (guint i = 0; i < n_frames; i++) {
+        if (!grab_frame (priv, frames[i], exposure_time, trigger_source, error))
+            return i;
     }
 
-    priv->current_frame++;
+    return n_frames;
+}
 
-    return TRUE;
+static void
+uca_mock_camera_get_frame_metadata (UcaCamera *camera, UcaFrameMetadata *metadata)
+{
+    UcaMockCameraPrivate *priv;
+
+    priv = UCA_MOCK_CAMERA_GET_PRIVATE (camera);
+
+    /* The frame counter was already advanced for the frame just delivered */
+    metadata->timestamp = priv->frame_timestamp;
+    metadata->frame_number = priv->current_frame - 1;
+    metadata->exposure_time = priv->exposure_time;
 }
 
 static gboolean
@@ -367,13 +931,21 @@ uca_mock_camera_readout (UcaCamera *camera, gpointer data, guint index, GError *
 
     UcaMockCameraPrivate *priv = UCA_MOCK_CAMERA_GET_PRIVATE (camera);
 
-    priv->readout_index = index;
+    if (priv->camram != NULL)
+        return read_recorded_frame (priv, data, index, error);
 
-    if (priv->fill_data) {
-        print_current_frame (priv, priv->dummy_data, TRUE);
-        g_memmove (data, priv->dummy_data, priv->roi_width * priv->roi_height * priv->bytes);
+    if (priv->dummy_data == NULL) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING,
+                     "Camera memory is disabled, set camram-size to record frames");
+        return FALSE;
     }
 
+    /* Without camera memory, synthesize a frame showing the index */
+    priv->readout_index = index;
+
+    if (priv->fill_data)
+        memcpy (data, render_frame (priv, TRUE), frame_size (priv));
+
     return TRUE;
 }
 
@@ -413,6 +985,52 @@ uca_mock_camera_set_property (GObject *object, guint property_id, const GValue *
         case PROP_TEST_ENUM:
             g_debug ("Set test-enum to `%i'", g_value_get_enum (value));
             break;
+        case PROP_FREE_RUN:
+            priv->free_run = g_value_get_boolean (value);
+            break;
+        case PROP_SPIN_TIME:
+            priv->spin_time = g_value_get_double (value);
+            break;
+        case PROP_CONTENT:
+            priv->content = g_value_get_enum (value);
+            break;
+        case PROP_POOL_SIZE:
+            priv->pool_size = g_value_get_uint (value);
+            break;
+        case PROP_CAMRAM_SIZE:
+            priv->camram_size = g_value_get_uint (value);
+            break;
+        case PROP_CAMRAM_FILE:
+            g_free (priv->camram_file);
+            priv->camram_file = g_value_dup_string (value);
+            break;
+        case PROP_CAMRAM_BANDWIDTH:
+            priv->camram_bandwidth = g_value_get_double (value);
+            break;
+        case PROP_FAULT_SEED:
+            priv->fault_seed = g_value_get_uint (value);
+            break;
+        case PROP_JITTER:
+            priv->jitter = g_value_get_double (value);
+            break;
+        case PROP_JITTER_DISTRIBUTION:
+            priv->jitter_distribution = g_value_get_enum (value);
+            break;
+        case PROP_STALL_PERIOD:
+            priv->stall_period = g_value_get_uint (value);
+            break;
+        case PROP_STALL_TIME:
+            priv->stall_time = g_value_get_double (value);
+            break;
+        case PROP_DROP_PROBABILITY:
+            priv->drop_probability = g_value_get_double (value);
+            break;
+        case PROP_ERROR_PROBABILITY:
+            priv->error_probability = g_value_get_double (value);
+            break;
+        case PROP_TRIGGER_DELAY:
+            priv->trigger_delay = g_value_get_double (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
             return;
@@ -456,7 +1074,10 @@ uca_mock_camera_get_property(GObject *object, guint property_id, GValue *value,
             g_value_set_boolean(value, TRUE);
             break;
         case PROP_HAS_CAMRAM_RECORDING:
-            g_value_set_boolean(value, FALSE);
+            g_value_set_boolean(value, priv->camram_size > 0);
+            break;
+        case PROP_RECORDED_FRAMES:
+            g_value_set_uint (value, get_num_recorded (priv));
             break;
         case PROP_FILL_DATA:
             g_value_set_boolean (value, priv->fill_data);
@@ -467,6 +1088,51 @@ uca_mock_camera_get_property(GObject *object, guint property_id, GValue *value,
         case PROP_TEST_ENUM:
             g_value_set_enum (value, 0);
             break;
+        case PROP_FREE_RUN:
+            g_value_set_boolean (value, priv->free_run);
+            break;
+        case PROP_SPIN_TIME:
+            g_value_set_double (value, priv->spin_time);
+            break;
+        case PROP_CONTENT:
+            g_value_set_enum (value, priv->content);
+            break;
+        case PROP_POOL_SIZE:
+            g_value_set_uint (value, priv->pool_size);
+            break;
+        case PROP_CAMRAM_SIZE:
+            g_value_set_uint (value, priv->camram_size);
+            break;
+        case PROP_CAMRAM_FILE:
+            g_value_set_string (value, priv->camram_file);
+            break;
+        case PROP_CAMRAM_BANDWIDTH:
+            g_value_set_double (value, priv->camram_bandwidth);
+            break;
+        case PROP_FAULT_SEED:
+            g_value_set_uint (value, priv->fault_seed);
+            break;
+        case PROP_JITTER:
+            g_value_set_double (value, priv->jitter);
+            break;
+        case PROP_JITTER_DISTRIBUTION:
+            g_value_set_enum (value, priv->jitter_distribution);
+            break;
+        case PROP_STALL_PERIOD:
+            g_value_set_uint (value, priv->stall_period);
+            break;
+        case PROP_STALL_TIME:
+            g_value_set_double (value, priv->stall_time);
+            break;
+        case PROP_DROP_PROBABILITY:
+            g_value_set_double (value, priv->drop_probability);
+            break;
+        case PROP_ERROR_PROBABILITY:
+            g_value_set_double (value, priv->error_probability);
+            break;
+        case PROP_TRIGGER_DELAY:
+            g_value_set_double (value, priv->trigger_delay);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
             break;
@@ -480,12 +1146,21 @@ uca_mock_camera_finalize(GObject *object)
 
     g_rand_free (priv->rand);
 
+    if (priv->fault_rand != NULL)
+        g_rand_free (priv->fault_rand);
+
     if (priv->thread_running) {
         priv->thread_running = FALSE;
         g_thread_join (priv->grab_thread);
     }
 
-    g_free (priv->dummy_data);
+    free_content (priv);
+    if (priv->camram != NULL)
+        g_object_unref (priv->camram);
+
+    g_free (priv->camram_file);
+    g_mutex_clear (&priv->camram_lock);
+    g_cond_clear (&priv->camram_cond);
     g_async_queue_unref (priv->trigger_queue);
 
     G_OBJECT_CLASS (uca_mock_camera_parent_class)->finalize(object);
@@ -529,6 +1204,20 @@ uca_mock_camera_class_init(UcaMockCameraClass *klass)
         { 0, }
     };
 
+    static GEnumValue content_values[] = {
+        { UCA_MOCK_CAMERA_CONTENT_NOISE, "UCA_MOCK_CAMERA_CONTENT_NOISE", "noise" },
+        { UCA_MOCK_CAMERA_CONTENT_POOL, "UCA_MOCK_CAMERA_CONTENT_POOL", "pool" },
+        { UCA_MOCK_CAMERA_CONTENT_CONSTANT, "UCA_MOCK_CAMERA_CONTENT_CONSTANT", "constant" },
+        { 0, }
+    };
+
+    static GEnumValue jitter_values[] = {
+        { UCA_MOCK_CAMERA_JITTER_UNIFORM, "UCA_MOCK_CAMERA_JITTER_UNIFORM", "uniform" },
+        { UCA_MOCK_CAMERA_JITTER_GAUSSIAN, "UCA_MOCK_CAMERA_JITTER_GAUSSIAN", "gaussian" },
+        { UCA_MOCK_CAMERA_JITTER_EXPONENTIAL, "UCA_MOCK_CAMERA_JITTER_EXPONENTIAL", "exponential" },
+        { 0, }
+    };
+
     gobject_class = G_OBJECT_CLASS(klass);
     gobject_class->set_property = uca_mock_camera_set_property;
     gobject_class->get_property = uca_mock_camera_get_property;
@@ -538,7 +1227,11 @@ uca_mock_camera_class_init(UcaMockCameraClass *klass)
     camera_class->start_recording = uca_mock_camera_start_recording;
     camera_class->stop_recording = uca_mock_camera_stop_recording;
     camera_class->grab = uca_mock_camera_grab;
+    camera_class->grab_n = uca_mock_camera_grab_n;
+    camera_class->get_frame_metadata = uca_mock_camera_get_frame_metadata;
     camera_class->readout = uca_mock_camera_readout;
+    camera_class->start_readout = uca_mock_camera_start_readout;
+    camera_class->stop_readout = uca_mock_camera_stop_readout;
     camera_class->trigger = uca_mock_camera_trigger;
 
     for (guint i = 0; mock_overrideables[i] != 0; i++)
@@ -566,6 +1259,113 @@ uca_mock_camera_class_init(UcaMockCameraClass *klass)
             0,
             G_PARAM_READWRITE);
 
+    mock_properties[PROP_FREE_RUN] =
+        g_param_spec_boolean ("free-run",
+            "Deliver frames as fast as possible",
+            "Deliver frames as fast as possible instead of one per exposure time",
+            FALSE,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_SPIN_TIME] =
+        g_param_spec_double ("spin-time",
+            "Time busy-waited before a frame is due",
+            "Time in seconds busy-waited instead of sleeping before a frame is due",
+            0.0, 1.0, 0.0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_CONTENT] =
+        g_param_spec_enum ("content",
+            "Image content",
+            "Image content drawn when fill-data is enabled",
+            g_enum_register_static ("UcaMockCameraContent", content_values),
+            UCA_MOCK_CAMERA_CONTENT_NOISE,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_POOL_SIZE] =
+        g_param_spec_uint ("pool-size",
+            "Number of pre-generated frames",
+            "Number of pre-generated frames cycled through in pool content mode",
+            1, 1024, 16,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_CAMRAM_SIZE] =
+        g_param_spec_uint ("camram-size",
+            "Number of frames in camera memory",
+            "Number of frames recorded into camera memory, 0 disables camera memory",
+            0, G_MAXUINT, 0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_CAMRAM_FILE] =
+        g_param_spec_string ("camram-file",
+            "File backing camera memory",
+            "File backing camera memory or NULL to keep it in main memory",
+            NULL,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_CAMRAM_BANDWIDTH] =
+        g_param_spec_double ("camram-bandwidth",
+            "Readout bandwidth of camera memory",
+            "Readout bandwidth of camera memory in bytes per second, 0 for no limit",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_FAULT_SEED] =
+        g_param_spec_uint ("fault-seed",
+            "Seed for injected faults",
+            "Seed for injected jitter, drops and errors, which repeat for the same seed",
+            0, G_MAXUINT, 0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_JITTER] =
+        g_param_spec_double ("jitter",
+            "Frame time jitter",
+            "Scale of the frame time jitter in seconds",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_JITTER_DISTRIBUTION] =
+        g_param_spec_enum ("jitter-distribution",
+            "Distribution of the frame time jitter",
+            "Distribution of the frame time jitter",
+            g_enum_register_static ("UcaMockCameraJitter", jitter_values),
+            UCA_MOCK_CAMERA_JITTER_GAUSSIAN,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_STALL_PERIOD] =
+        g_param_spec_uint ("stall-period",
+            "Number of frames between stalls",
+            "Number of frames between stalls, 0 disables stalls",
+            0, G_MAXUINT, 0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_STALL_TIME] =
+        g_param_spec_double ("stall-time",
+            "Duration of a stall",
+            "Time in seconds by which every stall-period-th frame is late",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_DROP_PROBABILITY] =
+        g_param_spec_double ("drop-probability",
+            "Probability of dropping a frame",
+            "Probability that a frame is lost without notice",
+            0.0, 0.99, 0.0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_ERROR_PROBABILITY] =
+        g_param_spec_double ("error-probability",
+            "Probability of a grab error",
+            "Probability that grabbing a frame fails with a device error",
+            0.0, 1.0, 0.0,
+            G_PARAM_READWRITE);
+
+    mock_properties[PROP_TRIGGER_DELAY] =
+        g_param_spec_double ("trigger-delay",
+            "Delay of software triggers",
+            "Time in seconds by which software triggers arrive late",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READWRITE);
+
     for (guint id = N_BASE_PROPERTIES; id < N_PROPERTIES; id++)
         g_object_class_install_property(gobject_class, id, mock_properties[id]);
 
@@ -585,9 +1385,38 @@ uca_mock_camera_init(UcaMockCamera *self)
     self->priv->max_frame_rate = 100000.0f;
     self->priv->grab_thread = NULL;
     self->priv->current_frame = 0;
+    self->priv->frame_timestamp = 0;
     self->priv->exposure_time = 0.05;
     self->priv->fill_data = TRUE;
     self->priv->degree_value = 1.0;
+    self->priv->free_run = FALSE;
+    self->priv->spin_time = 0.0;
+    self->priv->pacing.start = 0;
+    self->priv->pacing.n_paced = 0;
+    self->priv->content = UCA_MOCK_CAMERA_CONTENT_NOISE;
+    self->priv->pool_size = 16;
+    self->priv->pool = NULL;
+    self->priv->noise_row = NULL;
+    self->priv->camram_size = 0;
+    self->priv->camram_file = NULL;
+    self->priv->camram_bandwidth = 0.0;
+    self->priv->camram = NULL;
+    self->priv->n_recorded = 0;
+    self->priv->is_readout = FALSE;
+    self->priv->fault_seed = 0;
+    self->priv->fault_rand = NULL;
+    self->priv->jitter = 0.0;
+    self->priv->jitter_distribution = UCA_MOCK_CAMERA_JITTER_GAUSSIAN;
+    self->priv->stall_period = 0;
+    self->priv->stall_time = 0.0;
+    self->priv->drop_probability = 0.0;
+    self->priv->error_probability = 0.0;
+    self->priv->trigger_delay = 0.0;
+    self->priv->n_produced = 0;
+    self->priv->transfer_async = FALSE;
+    self->priv->thread_running = FALSE;
+    g_mutex_init (&self->priv->camram_lock);
+    g_cond_init (&self->priv->camram_cond);
 
     self->priv->rand = g_rand_new ();
 
@@ -606,6 +1435,10 @@ uca_mock_camera_init(UcaMockCamera *self)
     self->priv->trigger_queue = g_async_queue_new ();
 
     uca_camera_register_unit (UCA_CAMERA (self), "degree-value", UCA_UNIT_DEGREE_CELSIUS);
+    uca_camera_register_unit (UCA_CAMERA (self), "spin-time", UCA_UNIT_SECOND);
+    uca_camera_register_unit (UCA_CAMERA (self), "jitter", UCA_UNIT_SECOND);
+    uca_camera_register_unit (UCA_CAMERA (self), "stall-time", UCA_UNIT_SECOND);
+    uca_camera_register_unit (UCA_CAMERA (self), "trigger-delay", UCA_UNIT_SECOND);
 }
 
 G_MODULE_EXPORT GType
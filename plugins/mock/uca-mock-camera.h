@@ -34,6 +34,43 @@ typedef struct _UcaMockCamera           UcaMockCamera;
 typedef struct _UcaMockCameraClass      UcaMockCameraClass;
 typedef struct _UcaMockCameraPrivate    UcaMockCameraPrivate;
 
+/**
+ * UcaMockCameraContent:
+ * @UCA_MOCK_CAMERA_CONTENT_NOISE: Draw new noise for every frame
+ * @UCA_MOCK_CAMERA_CONTENT_POOL: Cycle through pre-generated noise frames and
+ *  only update the frame counter
+ * @UCA_MOCK_CAMERA_CONTENT_CONSTANT: Deliver the same frame over and over
+ *
+ * Image content produced by the mock camera when fill-data is enabled.
+ *
+ * Since: 2.5
+ */
+typedef enum {
+    UCA_MOCK_CAMERA_CONTENT_NOISE,
+    UCA_MOCK_CAMERA_CONTENT_POOL,
+    UCA_MOCK_CAMERA_CONTENT_CONSTANT
+} UcaMockCameraContent;
+
+/**
+ * UcaMockCameraJitter:
+ * @UCA_MOCK_CAMERA_JITTER_UNIFORM: Uniformly distributed between -jitter and
+ *  +jitter
+ * @UCA_MOCK_CAMERA_JITTER_GAUSSIAN: Normally distributed with jitter as
+ *  standard deviation
+ * @UCA_MOCK_CAMERA_JITTER_EXPONENTIAL: Exponentially distributed delays with
+ *  jitter as mean, giving a long tail of late frames
+ *
+ * Distribution of the time by which the mock camera delivers frames early or
+ * late.
+ *
+ * Since: 2.5
+ */
+typedef enum {
+    UCA_MOCK_CAMERA_JITTER_UNIFORM,
+    UCA_MOCK_CAMERA_JITTER_GAUSSIAN,
+    UCA_MOCK_CAMERA_JITTER_EXPONENTIAL
+} UcaMockCameraJitter;
+
 /**
  * UcaMockCamera:
  *
@@ -35,6 +35,7 @@
 #include "compat.h"
 #include "uca-camera.h"
 #include "uca-ring-buffer.h"
+#include "uca-transform.h"
 #include "uca-enums.h"
 
 #define G_LOG_LEVEL_DOMAIN "uca"
@@ -56,6 +57,15 @@ G_DEFINE_TYPE(UcaCamera, uca_camera, G_TYPE_OBJECT)
  * @UCA_CAMERA_TRIGGER_TYPE_LEVEL: Trigger during level signal
  */
 
+/**
+ * UcaCameraOverrunPolicy:
+ * @UCA_CAMERA_OVERRUN_POLICY_BLOCK: Wait until the consumer frees a buffer
+ * @UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST: Discard the oldest unread frame
+ *
+ * Defines what the buffer thread does if the ring buffer is full in buffered
+ * mode.
+ */
+
 /**
  * UcaCameraError:
  * @UCA_CAMERA_ERROR_NOT_FOUND: Camera type is unknown
@@ -136,11 +146,22 @@ const gchar *uca_camera_props[N_BASE_PROPERTIES] = {
     "buffered",
     "num-buffers",
     "mirror",
-    "rotate"
+    "rotate",
+    "grab-timeout",
+    "overrun-policy",
+    "frames-produced",
+    "frames-consumed",
+    "frames-dropped",
+    "buffer-high-water",
+    "buffer-alloc-flags",
+    "buffer-numa-node",
+    "dispatch-threads",
+    "dispatch-ordered",
+    "callback-latency-mean",
+    "callback-latency-max"
 };
 
 static GParamSpec *camera_properties[N_BASE_PROPERTIES] = { NULL, };
-static GMutex access_lock;
 static gboolean str_to_boolean (const gchar *s);
 
 #define DEFINE_CAST(suffix, trans_func)                 \
@@ -164,6 +185,24 @@ DEFINE_CAST (enum,      atoi)
 DEFINE_CAST (boolean,   str_to_boolean)
 
 
+/*
+ * In buffered mode each ring buffer block starts with the metadata of its
+ * frame, padded so that the pixel data stays cache line aligned.
+ */
+#define FRAME_HEADER_SIZE 64
+
+G_STATIC_ASSERT (sizeof (UcaFrameMetadata) <= FRAME_HEADER_SIZE);
+
+/*
+ * A frame copied out of the plugin's asynchronous callback, waiting to be
+ * handed to the user callback by a dispatch thread.
+ */
+typedef struct {
+    gpointer data;
+    UcaFrameMetadata metadata;
+    gint64 arrival;
+} DispatchSlot;
+
 struct _UcaCameraPrivate {
     gboolean cancelling_recording;
     gboolean cancelling_grab;
@@ -172,12 +211,101 @@ struct _UcaCameraPrivate {
     gboolean transfer_async;
     gboolean buffered;
     guint num_buffers;
+    UcaRingBufferAllocFlags buffer_alloc_flags;
+    gint buffer_numa_node;
     GThread *read_thread;
     UcaRingBuffer *ring_buffer;
     UcaCameraTriggerSource trigger_source;
     UcaCameraTriggerType trigger_type;
     gboolean mirror;
     guint rotate;
+    gdouble grab_timeout;
+    UcaCameraOverrunPolicy overrun_policy;
+    gboolean frame_borrowed;
+
+    /* Acquisition statistics since start of recording, protected by buffer_lock */
+    guint64 frames_produced;
+    guint64 frames_consumed;
+    guint64 frames_dropped;
+    guint buffer_high_water;
+
+    /*
+     * Metadata bookkeeping, only touched by whoever acquires frames from the
+     * plugin. n_dropped_pending counts ring buffer drops not yet reported to
+     * the consumer and is protected by buffer_lock.
+     */
+    guint64 sequence;
+    guint64 last_frame_number;
+    gboolean have_last_frame_number;
+    guint n_dropped_pending;
+
+    /*
+     * Frame geometry at the start of recording or readout and a scratch frame
+     * for rotations that cannot be applied in place.
+     */
+    guint frame_width;
+    guint frame_height;
+    guint pixel_size;
+    gsize frame_size;
+    gpointer transform_buffer;
+    gsize transform_buffer_size;
+
+    /*
+     * Asynchronous dispatch. With dispatch_threads > 0, the plugin's grab
+     * callback copies each frame into a free slot and queues it, a pool of
+     * threads calls the user's function. queue holds slot indices in arrival
+     * order, free_slots the unused ones. Tickets are drawn when a slot is
+     * dequeued so that ordered dispatch has no gaps even if the oldest
+     * queued frame was dropped. Everything is protected by dispatch_lock.
+     */
+    guint dispatch_threads;
+    gboolean dispatch_ordered;
+    GThread **dispatch_pool;
+    guint n_dispatch_pool;
+    DispatchSlot *slots;
+    guint n_slots;
+    guint *free_slots;
+    guint n_free_slots;
+    guint *queue;
+    guint queue_head;
+    guint queue_length;
+    guint n_dropped_queued;
+    guint64 next_ticket;
+    guint64 current_ticket;
+    gboolean dispatch_stopping;
+    UcaCameraGrabFunc dispatch_func;
+    gpointer dispatch_user_data;
+    gdouble callback_latency_sum;
+    gdouble callback_latency_max;
+    guint64 n_callbacks;
+    GMutex dispatch_lock;
+    GCond dispatch_cond;
+    GCond dispatch_space_cond;
+    GCond dispatch_turn_cond;
+    UcaCameraGrabMetadataFunc metadata_func;
+    gpointer metadata_user_data;
+
+    /*
+     * All locks are per-instance so that independent cameras can be driven in
+     * parallel. state_lock serializes recording and readout state changes,
+     * grab_lock concurrent grab and readout calls, trigger_lock software
+     * triggers and access_lock calls into the plugin.
+     */
+    GMutex state_lock;
+    GMutex grab_lock;
+    GMutex trigger_lock;
+    GMutex access_lock;
+
+    /*
+     * Protects the ring buffer handoff between buffer_thread and grab.
+     * buffer_cond is signalled when a frame was written, space_cond when a
+     * frame was consumed or released. buffer_error is why buffer_thread
+     * stopped acquiring.
+     */
+    GMutex buffer_lock;
+    GError *buffer_error;
+    GCond buffer_cond;
+    GCond space_cond;
 };
 
 static gboolean
@@ -245,6 +373,30 @@ uca_camera_set_property (GObject *object, guint property_id, const GValue *value
             priv->rotate = g_value_get_uint (value);
         break;
 
+        case PROP_GRAB_TIMEOUT:
+            priv->grab_timeout = g_value_get_double (value);
+            break;
+
+        case PROP_OVERRUN_POLICY:
+            priv->overrun_policy = g_value_get_enum (value);
+            break;
+
+        case PROP_BUFFER_ALLOC_FLAGS:
+            priv->buffer_alloc_flags = g_value_get_flags (value);
+            break;
+
+        case PROP_BUFFER_NUMA_NODE:
+            priv->buffer_numa_node = g_value_get_int (value);
+            break;
+
+        case PROP_DISPATCH_THREADS:
+            priv->dispatch_threads = g_value_get_uint (value);
+            break;
+
+        case PROP_DISPATCH_ORDERED:
+            priv->dispatch_ordered = g_value_get_boolean (value);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     }
@@ -333,6 +485,66 @@ uca_camera_get_property(GObject *object, guint property_id, GValue *value, GPara
             g_value_set_uint(value, priv->rotate);
         break;
 
+        case PROP_GRAB_TIMEOUT:
+            g_value_set_double (value, priv->grab_timeout);
+            break;
+
+        case PROP_OVERRUN_POLICY:
+            g_value_set_enum (value, priv->overrun_policy);
+            break;
+
+        case PROP_FRAMES_PRODUCED:
+            g_mutex_lock (&priv->buffer_lock);
+            g_value_set_uint64 (value, priv->frames_produced);
+            g_mutex_unlock (&priv->buffer_lock);
+            break;
+
+        case PROP_FRAMES_CONSUMED:
+            g_mutex_lock (&priv->buffer_lock);
+            g_value_set_uint64 (value, priv->frames_consumed);
+            g_mutex_unlock (&priv->buffer_lock);
+            break;
+
+        case PROP_FRAMES_DROPPED:
+            g_mutex_lock (&priv->buffer_lock);
+            g_value_set_uint64 (value, priv->frames_dropped);
+            g_mutex_unlock (&priv->buffer_lock);
+            break;
+
+        case PROP_BUFFER_HIGH_WATER:
+            g_mutex_lock (&priv->buffer_lock);
+            g_value_set_uint (value, priv->buffer_high_water);
+            g_mutex_unlock (&priv->buffer_lock);
+            break;
+
+        case PROP_BUFFER_ALLOC_FLAGS:
+            g_value_set_flags (value, priv->buffer_alloc_flags);
+            break;
+
+        case PROP_BUFFER_NUMA_NODE:
+            g_value_set_int (value, priv->buffer_numa_node);
+            break;
+
+        case PROP_DISPATCH_THREADS:
+            g_value_set_uint (value, priv->dispatch_threads);
+            break;
+
+        case PROP_DISPATCH_ORDERED:
+            g_value_set_boolean (value, priv->dispatch_ordered);
+            break;
+
+        case PROP_CALLBACK_LATENCY_MEAN:
+            g_mutex_lock (&priv->dispatch_lock);
+            g_value_set_double (value, priv->n_callbacks > 0 ? priv->callback_latency_sum / priv->n_callbacks : 0.0);
+            g_mutex_unlock (&priv->dispatch_lock);
+            break;
+
+        case PROP_CALLBACK_LATENCY_MAX:
+            g_mutex_lock (&priv->dispatch_lock);
+            g_value_set_double (value, priv->callback_latency_max);
+            g_mutex_unlock (&priv->dispatch_lock);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     }
@@ -366,9 +578,24 @@ uca_camera_dispose (GObject *object)
 static void
 uca_camera_finalize (GObject *object)
 {
+    UcaCameraPrivate *priv;
     GParamSpec **props;
     guint n_props;
 
+    priv = UCA_CAMERA_GET_PRIVATE (object);
+    g_mutex_clear (&priv->state_lock);
+    g_mutex_clear (&priv->grab_lock);
+    g_mutex_clear (&priv->trigger_lock);
+    g_mutex_clear (&priv->access_lock);
+    g_mutex_clear (&priv->buffer_lock);
+    g_cond_clear (&priv->buffer_cond);
+    g_cond_clear (&priv->space_cond);
+    g_mutex_clear (&priv->dispatch_lock);
+    g_cond_clear (&priv->dispatch_cond);
+    g_cond_clear (&priv->dispatch_space_cond);
+    g_cond_clear (&priv->dispatch_turn_cond);
+    g_free (priv->transform_buffer);
+
     /* We will reset property units of all subclassed objects  */
     props = g_object_class_list_properties (G_OBJECT_GET_CLASS (object), &n_props);
 
@@ -596,19 +823,221 @@ uca_camera_class_init (UcaCameraClass *klass)
             0, G_MAXUINT, 4,
             G_PARAM_READWRITE);
 
+    /**
+     * UcaCamera:mirror:
+     *
+     * Flip frames horizontally. The transformation is applied to frames
+     * returned by uca_camera_grab(), its variants, uca_camera_borrow_frame()
+     * and uca_camera_readout(). Frames passed to a #UcaCameraGrabFunc are
+     * only transformed if #UcaCamera:dispatch-threads is not 0.
+     */
     camera_properties[PROP_MIRROR] =
         g_param_spec_boolean(uca_camera_props[PROP_MIRROR],
-            "TRUE if frame should be mirrored by receiver",
-            "TRUE if frame should be mirrored by receiver",
+            "TRUE if frames are mirrored horizontally",
+            "TRUE if frames are mirrored horizontally",
             FALSE, G_PARAM_READWRITE);
 
+    /**
+     * UcaCamera:rotate:
+     *
+     * Number of clockwise rotations by 90 degrees applied to frames after
+     * #UcaCamera:mirror. For odd values, frames are #UcaCamera:roi-height
+     * pixels wide and #UcaCamera:roi-width pixels high.
+     */
     camera_properties[PROP_ROTATE] =
         g_param_spec_uint(uca_camera_props[PROP_ROTATE],
-            "Number of rotations by 90 degrees that should be applied by receiver",
-            "Number of rotations by 90 degrees that should be applied by receiver",
+            "Number of clockwise rotations by 90 degrees applied to frames",
+            "Number of clockwise rotations by 90 degrees applied to frames",
             0, 3, 0,
             G_PARAM_READWRITE);
 
+    /**
+     * UcaCamera:grab-timeout:
+     *
+     * Maximum time in seconds that uca_camera_grab() waits for a frame in
+     * buffered mode before failing with #UCA_CAMERA_ERROR_TIMEOUT. A value of
+     * 0 waits indefinitely.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_GRAB_TIMEOUT] =
+        g_param_spec_double(uca_camera_props[PROP_GRAB_TIMEOUT],
+            "Timeout in seconds for buffered grabs",
+            "Timeout in seconds for buffered grabs, 0 waits indefinitely",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READWRITE);
+
+    /**
+     * UcaCamera:overrun-policy:
+     *
+     * Behaviour of the buffer thread if all buffers are occupied in buffered
+     * mode. A frame lent out with uca_camera_borrow_frame() is never
+     * overwritten.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_OVERRUN_POLICY] =
+        g_param_spec_enum("overrun-policy",
+            "Overrun policy",
+            "What to do if the ring buffer is full",
+            UCA_TYPE_CAMERA_OVERRUN_POLICY, UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST,
+            G_PARAM_READWRITE);
+
+    /**
+     * UcaCamera:frames-produced:
+     *
+     * Number of frames acquired from the camera since recording was started.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_FRAMES_PRODUCED] =
+        g_param_spec_uint64(uca_camera_props[PROP_FRAMES_PRODUCED],
+            "Number of acquired frames",
+            "Number of frames acquired since recording was started",
+            0, G_MAXUINT64, 0,
+            G_PARAM_READABLE);
+
+    /**
+     * UcaCamera:frames-consumed:
+     *
+     * Number of frames handed to the caller with uca_camera_grab() or
+     * uca_camera_borrow_frame() since recording was started.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_FRAMES_CONSUMED] =
+        g_param_spec_uint64(uca_camera_props[PROP_FRAMES_CONSUMED],
+            "Number of consumed frames",
+            "Number of frames returned to the caller since recording was started",
+            0, G_MAXUINT64, 0,
+            G_PARAM_READABLE);
+
+    /**
+     * UcaCamera:frames-dropped:
+     *
+     * Number of frames discarded in buffered mode because the ring buffer was
+     * full and #UcaCamera:overrun-policy is
+     * #UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_FRAMES_DROPPED] =
+        g_param_spec_uint64(uca_camera_props[PROP_FRAMES_DROPPED],
+            "Number of dropped frames",
+            "Number of frames overwritten before they were consumed",
+            0, G_MAXUINT64, 0,
+            G_PARAM_READABLE);
+
+    /**
+     * UcaCamera:buffer-high-water:
+     *
+     * Maximum number of unread frames in the ring buffer since recording was
+     * started. If this approaches #UcaCamera:num-buffers, the consumer cannot
+     * keep up with the camera.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_BUFFER_HIGH_WATER] =
+        g_param_spec_uint(uca_camera_props[PROP_BUFFER_HIGH_WATER],
+            "Maximum ring buffer fill level",
+            "Maximum number of unread frames since recording was started",
+            0, G_MAXUINT, 0,
+            G_PARAM_READABLE);
+
+    /**
+     * UcaCamera:buffer-alloc-flags:
+     *
+     * How the ring buffer used in buffered mode is allocated, see
+     * #UcaRingBufferAllocFlags.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_BUFFER_ALLOC_FLAGS] =
+        g_param_spec_flags(uca_camera_props[PROP_BUFFER_ALLOC_FLAGS],
+            "Ring buffer allocation flags",
+            "Ring buffer allocation flags",
+            UCA_TYPE_RING_BUFFER_ALLOC_FLAGS, UCA_RING_BUFFER_ALLOC_DEFAULT,
+            G_PARAM_READWRITE);
+
+    /**
+     * UcaCamera:buffer-numa-node:
+     *
+     * NUMA node the ring buffer used in buffered mode is bound to. Choose the
+     * node closest to the frame grabber. -1 leaves placement to the kernel.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_BUFFER_NUMA_NODE] =
+        g_param_spec_int(uca_camera_props[PROP_BUFFER_NUMA_NODE],
+            "NUMA node of the ring buffer",
+            "NUMA node of the ring buffer, -1 for no binding",
+            -1, G_MAXINT, -1,
+            G_PARAM_READWRITE);
+
+    /**
+     * UcaCamera:dispatch-threads:
+     *
+     * Number of threads calling the #UcaCameraGrabFunc in asynchronous mode.
+     * With 0, the function is called directly from the plugin's acquisition
+     * thread, so a slow function delays acquisition. Otherwise frames are
+     * copied into a queue of #UcaCamera:num-buffers frames and
+     * #UcaCamera:overrun-policy decides whether a full queue blocks the
+     * acquisition or drops the oldest queued frame.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_DISPATCH_THREADS] =
+        g_param_spec_uint(uca_camera_props[PROP_DISPATCH_THREADS],
+            "Number of dispatch threads",
+            "Number of threads calling the grab function, 0 to call it from the acquisition thread",
+            0, 64, 0,
+            G_PARAM_READWRITE);
+
+    /**
+     * UcaCamera:dispatch-ordered:
+     *
+     * If %TRUE, dispatched frames are passed to the #UcaCameraGrabFunc one at
+     * a time and in acquisition order. Otherwise up to
+     * #UcaCamera:dispatch-threads calls run concurrently and may complete in
+     * any order.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_DISPATCH_ORDERED] =
+        g_param_spec_boolean(uca_camera_props[PROP_DISPATCH_ORDERED],
+            "Dispatch frames in order",
+            "Dispatch frames one at a time in acquisition order",
+            TRUE, G_PARAM_READWRITE);
+
+    /**
+     * UcaCamera:callback-latency-mean:
+     *
+     * Mean time in seconds from the arrival of a frame until the dispatched
+     * #UcaCameraGrabFunc returned, since recording was started.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_CALLBACK_LATENCY_MEAN] =
+        g_param_spec_double(uca_camera_props[PROP_CALLBACK_LATENCY_MEAN],
+            "Mean callback latency",
+            "Mean time from frame arrival until the dispatched grab function returned",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READABLE);
+
+    /**
+     * UcaCamera:callback-latency-max:
+     *
+     * Maximum time in seconds from the arrival of a frame until the
+     * dispatched #UcaCameraGrabFunc returned, since recording was started.
+     *
+     * Since: 2.5
+     */
+    camera_properties[PROP_CALLBACK_LATENCY_MAX] =
+        g_param_spec_double(uca_camera_props[PROP_CALLBACK_LATENCY_MAX],
+            "Maximum callback latency",
+            "Maximum time from frame arrival until the dispatched grab function returned",
+            0.0, G_MAXDOUBLE, 0.0,
+            G_PARAM_READABLE);
 
     for (guint id = PROP_0 + 1; id < N_BASE_PROPERTIES; id++)
         g_object_class_install_property(gobject_class, id, camera_properties[id]);
@@ -633,7 +1062,54 @@ uca_camera_init (UcaCamera *camera)
     camera->priv->trigger_type = UCA_CAMERA_TRIGGER_TYPE_EDGE;
     camera->priv->buffered = FALSE;
     camera->priv->num_buffers = 4;
+    camera->priv->buffer_alloc_flags = UCA_RING_BUFFER_ALLOC_DEFAULT;
+    camera->priv->buffer_numa_node = -1;
     camera->priv->ring_buffer = NULL;
+    camera->priv->buffer_error = NULL;
+    camera->priv->grab_timeout = 0.0;
+    camera->priv->overrun_policy = UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST;
+    camera->priv->frame_borrowed = FALSE;
+    camera->priv->frames_produced = 0;
+    camera->priv->frames_consumed = 0;
+    camera->priv->frames_dropped = 0;
+    camera->priv->buffer_high_water = 0;
+    camera->priv->sequence = 0;
+    camera->priv->last_frame_number = 0;
+    camera->priv->have_last_frame_number = FALSE;
+    camera->priv->n_dropped_pending = 0;
+    camera->priv->frame_width = 0;
+    camera->priv->frame_height = 0;
+    camera->priv->pixel_size = 1;
+    camera->priv->frame_size = 0;
+    camera->priv->transform_buffer = NULL;
+    camera->priv->transform_buffer_size = 0;
+    camera->priv->dispatch_threads = 0;
+    camera->priv->dispatch_ordered = TRUE;
+    camera->priv->dispatch_pool = NULL;
+    camera->priv->n_dispatch_pool = 0;
+    camera->priv->slots = NULL;
+    camera->priv->n_slots = 0;
+    camera->priv->free_slots = NULL;
+    camera->priv->queue = NULL;
+    camera->priv->dispatch_func = NULL;
+    camera->priv->dispatch_user_data = NULL;
+    camera->priv->callback_latency_sum = 0.0;
+    camera->priv->callback_latency_max = 0.0;
+    camera->priv->n_callbacks = 0;
+    camera->priv->metadata_func = NULL;
+    camera->priv->metadata_user_data = NULL;
+
+    g_mutex_init (&camera->priv->state_lock);
+    g_mutex_init (&camera->priv->grab_lock);
+    g_mutex_init (&camera->priv->trigger_lock);
+    g_mutex_init (&camera->priv->access_lock);
+    g_mutex_init (&camera->priv->buffer_lock);
+    g_cond_init (&camera->priv->buffer_cond);
+    g_cond_init (&camera->priv->space_cond);
+    g_mutex_init (&camera->priv->dispatch_lock);
+    g_cond_init (&camera->priv->dispatch_cond);
+    g_cond_init (&camera->priv->dispatch_space_cond);
+    g_cond_init (&camera->priv->dispatch_turn_cond);
 
     g_value_init (&val, G_TYPE_UINT);
     g_value_set_uint (&val, 1);
@@ -660,119 +1136,482 @@ uca_camera_init (UcaCamera *camera)
 #endif
 }
 
-static gpointer
-buffer_thread (UcaCamera *camera)
+/*
+ * Fill in what the core knows about the frame that was just acquired and let
+ * the plugin add what the hardware knows.
+ */
+static void
+collect_metadata (UcaCamera *camera, UcaCameraClass *klass, UcaFrameMetadata *metadata)
 {
-    UcaCameraClass *klass;
-    GError *error = NULL;
+    UcaCameraPrivate *priv;
 
-    klass = UCA_CAMERA_GET_CLASS (camera);
+    priv = camera->priv;
+    metadata->timestamp = 0;
+    metadata->frame_number = priv->sequence;
+    metadata->sequence = priv->sequence;
+    metadata->n_dropped = 0;
+    metadata->exposure_time = 0.0;
 
-    while (!camera->priv->cancelling_recording) {
-        gpointer buffer;
+    if (klass->get_frame_metadata != NULL)
+        (*klass->get_frame_metadata) (camera, metadata);
 
-        buffer = uca_ring_buffer_get_write_pointer (camera->priv->ring_buffer);
+    if (metadata->timestamp == 0)
+        metadata->timestamp = g_get_monotonic_time ();
 
-        if (!(*klass->grab) (camera, buffer, &error)) {
-            camera->priv->cancelling_grab = TRUE;
-            break;
-        }
+    if (priv->have_last_frame_number && metadata->frame_number > priv->last_frame_number + 1)
+        metadata->n_dropped = (guint) (metadata->frame_number - priv->last_frame_number - 1);
 
-        uca_ring_buffer_write_advance (camera->priv->ring_buffer);
-    }
+    priv->last_frame_number = metadata->frame_number;
+    priv->have_last_frame_number = TRUE;
+    priv->sequence++;
+}
+
+static void
+update_frame_geometry (UcaCamera *camera)
+{
+    UcaCameraPrivate *priv;
+    guint bitdepth;
 
-    return error;
+    priv = camera->priv;
+
+    g_object_get (camera,
+                  "roi-width", &priv->frame_width,
+                  "roi-height", &priv->frame_height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    priv->pixel_size = bitdepth <= 8 ? 1 : 2;
+    priv->frame_size = (gsize) priv->frame_width * priv->frame_height * priv->pixel_size;
 }
 
-static GEnumValue *
-find_enum_value (GParamSpecEnum *pspec, const gchar *name)
+/*
+ * Return where a frame destined for data has to be acquired so that it can be
+ * transformed into data afterwards. Only rotations by odd multiples of 90
+ * degrees cannot be applied in place.
+ */
+static gpointer
+get_transform_source (UcaCameraPrivate *priv, gpointer data, guint rotate)
 {
-    GEnumValue *result;
-    GEnumClass *enum_class;
+    if (!uca_transform_is_transposed (rotate))
+        return data;
 
-    result = NULL;
-    enum_class = pspec->enum_class;
+    if (priv->transform_buffer_size < priv->frame_size) {
+        g_free (priv->transform_buffer);
+        priv->transform_buffer = g_malloc (priv->frame_size);
+        priv->transform_buffer_size = priv->frame_size;
+    }
 
-    for (guint i = 0; i < enum_class->n_values; i++)
-        if (!g_strcmp0 (enum_class->values[i].value_name, name))
-            result = &enum_class->values[i];
+    return priv->transform_buffer;
+}
 
-    return result;
+static void
+transform_frame (UcaCameraPrivate *priv, gpointer dst, gconstpointer src, gboolean mirror, guint rotate)
+{
+    uca_transform_frame (dst, src, priv->frame_width, priv->frame_height, priv->pixel_size, mirror, rotate);
+}
+
+static void
+cancel_buffered_grab (UcaCameraPrivate *priv)
+{
+    g_mutex_lock (&priv->buffer_lock);
+    priv->cancelling_grab = TRUE;
+    g_cond_broadcast (&priv->buffer_cond);
+    g_mutex_unlock (&priv->buffer_lock);
 }
 
+/*
+ * Wait until the write location of the ring buffer can be used without
+ * overwriting unread or borrowed frames. Returns FALSE if recording is
+ * cancelled in the meantime.
+ */
 static gboolean
-is_a_number (const gchar *s)
+reserve_buffer (UcaCameraPrivate *priv)
 {
-    g_return_val_if_fail (s != NULL, FALSE);
+    gboolean reserved;
 
-    for (; *s != '\0'; s++) {
-        if (!g_ascii_isdigit (*s))
-            return FALSE;
+    g_mutex_lock (&priv->buffer_lock);
+
+    while (uca_ring_buffer_full (priv->ring_buffer) && !priv->cancelling_recording) {
+        /*
+         * The borrowed frame is the one returned by the last read. Dropping
+         * another frame would hand its slot to the writer.
+         */
+        if (priv->overrun_policy == UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST && !priv->frame_borrowed) {
+            UcaFrameMetadata *dropped;
+
+            dropped = uca_ring_buffer_get_read_pointer (priv->ring_buffer);
+            priv->n_dropped_pending += 1 + dropped->n_dropped;
+            priv->frames_dropped++;
+        }
+        else
+            g_cond_wait (&priv->space_cond, &priv->buffer_lock);
     }
 
-    return TRUE;
+    reserved = !priv->cancelling_recording;
+    g_mutex_unlock (&priv->buffer_lock);
+
+    return reserved;
 }
 
-/**
- * uca_camera_parse_arg_props:
- * @camera: A #UcaCamera object
- * @argv: Array of property assignment strings in the form of `prop=value`
- * @argc: Length of @argv
- * @error: Location to store a #UcaCameraError error or %NULL
- *
- * Parses the assignment array @argv and sets the property to the given value.
- * If an error occures, @error is set and %FALSE is returned.
- *
- * Returns: %TRUE on success.
- */
-gboolean
-uca_camera_parse_arg_props (UcaCamera *camera, gchar **argv, guint argc, GError **error)
+static gpointer
+buffer_thread (UcaCamera *camera)
 {
-    GRegex *assignment;
+    UcaCameraClass *klass;
+    UcaCameraPrivate *priv;
+    GError *error = NULL;
 
-    assignment = g_regex_new ("\\s*([A-Za-z0-9-]*)=(.*)\\s*", 0, 0, error);
+    klass = UCA_CAMERA_GET_CLASS (camera);
+    priv = camera->priv;
 
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_UCHAR,   value_transform_uchar);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_INT,     value_transform_int);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_UINT,    value_transform_uint);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_UINT64,  value_transform_uint64);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_LONG,    value_transform_long);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_ULONG,   value_transform_ulong);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_FLOAT,   value_transform_float);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_DOUBLE,  value_transform_double);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_BOOLEAN, value_transform_boolean);
-    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_ENUM,    value_transform_enum);
+    while (!priv->cancelling_recording) {
+        guint8 *block;
 
-    for (guint i = 0; i < argc; i++) {
-        GMatchInfo *match;
-        gboolean success = TRUE;
+        if (!reserve_buffer (priv))
+            break;
 
-        g_regex_match (assignment, argv[i], 0, &match);
+        block = uca_ring_buffer_get_write_pointer (priv->ring_buffer);
 
-        if (g_match_info_matches (match)) {
-            GParamSpec *pspec;
-            GValue value = {0};
+        if (!(*klass->grab) (camera, block + FRAME_HEADER_SIZE, &error)) {
+            /* Consumers get the error once they read all buffered frames */
+            g_mutex_lock (&priv->buffer_lock);
+            priv->buffer_error = error;
+            g_mutex_unlock (&priv->buffer_lock);
+            cancel_buffered_grab (priv);
+            break;
+        }
 
-            gchar *prop = g_match_info_fetch (match, 1);
-            gchar *string_value = g_match_info_fetch (match, 2);
+        collect_metadata (camera, klass, (UcaFrameMetadata *) block);
 
-            pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (camera), prop);
+        g_mutex_lock (&priv->buffer_lock);
+        uca_ring_buffer_write_advance (priv->ring_buffer);
+        priv->frames_produced++;
+        priv->buffer_high_water = uca_ring_buffer_get_high_water_mark (priv->ring_buffer);
+        g_cond_signal (&priv->buffer_cond);
+        g_mutex_unlock (&priv->buffer_lock);
+    }
 
-            if (pspec != NULL) {
-                GValue target_value = {0};
+    return NULL;
+}
 
-                if (g_type_is_a (pspec->value_type, G_TYPE_ENUM)) {
-                    g_value_init (&value, G_TYPE_INT);
+/*
+ * Installed as the grab function while dispatching. Runs on the plugin's
+ * acquisition thread and only copies the frame into a free slot.
+ */
+static void
+dispatch_frame (gpointer data, gpointer user_data)
+{
+    UcaCamera *camera = user_data;
+    UcaCameraPrivate *priv;
+    UcaFrameMetadata metadata = { 0, };
+    DispatchSlot *slot;
+    gint64 arrival;
+    guint index;
+    guint n_dropped = 0;
 
-                    if (!is_a_number (string_value)) {
-                        GEnumValue *enum_value;
+    priv = camera->priv;
+    arrival = g_get_monotonic_time ();
 
-                        enum_value = find_enum_value ((GParamSpecEnum *) pspec, string_value);
+    /* Collected for every frame to keep sequence and gap detection intact */
+    if (priv->metadata_func != NULL)
+        collect_metadata (camera, UCA_CAMERA_GET_CLASS (camera), &metadata);
 
-                        if (enum_value) {
-                            g_value_set_int (&value, enum_value->value);
-                        }
-                        else {
+    g_mutex_lock (&priv->dispatch_lock);
+
+    if (priv->overrun_policy == UCA_CAMERA_OVERRUN_POLICY_BLOCK) {
+        while (priv->n_free_slots == 0 && !priv->dispatch_stopping)
+            g_cond_wait (&priv->dispatch_space_cond, &priv->dispatch_lock);
+    }
+    else if (priv->n_free_slots == 0 && priv->queue_length > 0) {
+        /* Drop the oldest queued frame and report it with the next one */
+        index = priv->queue[priv->queue_head];
+        priv->queue_head = (priv->queue_head + 1) % priv->n_slots;
+        priv->queue_length--;
+        priv->free_slots[priv->n_free_slots++] = index;
+
+        if (priv->queue_length > 0)
+            priv->slots[priv->queue[priv->queue_head]].metadata.n_dropped += 1 + priv->slots[index].metadata.n_dropped;
+        else
+            priv->n_dropped_queued += 1 + priv->slots[index].metadata.n_dropped;
+
+        n_dropped = 1;
+    }
+
+    if (priv->n_free_slots == 0) {
+        /* All frames are in user functions or we are shutting down */
+        priv->n_dropped_queued += 1 + metadata.n_dropped;
+        g_mutex_unlock (&priv->dispatch_lock);
+
+        g_mutex_lock (&priv->buffer_lock);
+        priv->frames_produced++;
+        priv->frames_dropped++;
+        g_mutex_unlock (&priv->buffer_lock);
+        return;
+    }
+
+    index = priv->free_slots[--priv->n_free_slots];
+    slot = &priv->slots[index];
+    g_mutex_unlock (&priv->dispatch_lock);
+
+    slot->arrival = arrival;
+    slot->metadata = metadata;
+
+    if (uca_transform_is_identity (priv->mirror, priv->rotate))
+        memcpy (slot->data, data, priv->frame_size);
+    else
+        transform_frame (priv, slot->data, data, priv->mirror, priv->rotate);
+
+    g_mutex_lock (&priv->dispatch_lock);
+    slot->metadata.n_dropped += priv->n_dropped_queued;
+    priv->n_dropped_queued = 0;
+    priv->queue[(priv->queue_head + priv->queue_length) % priv->n_slots] = index;
+    priv->queue_length++;
+    g_cond_signal (&priv->dispatch_cond);
+    g_mutex_unlock (&priv->dispatch_lock);
+
+    g_mutex_lock (&priv->buffer_lock);
+    priv->frames_produced++;
+    priv->frames_dropped += n_dropped;
+    g_mutex_unlock (&priv->buffer_lock);
+}
+
+static gpointer
+dispatch_thread (UcaCamera *camera)
+{
+    UcaCameraPrivate *priv;
+
+    priv = camera->priv;
+    g_mutex_lock (&priv->dispatch_lock);
+
+    for (;;) {
+        DispatchSlot *slot;
+        guint index;
+        guint64 ticket;
+        gdouble latency;
+
+        while (priv->queue_length == 0 && !priv->dispatch_stopping)
+            g_cond_wait (&priv->dispatch_cond, &priv->dispatch_lock);
+
+        /* Queued frames are still delivered when recording stops */
+        if (priv->queue_length == 0)
+            break;
+
+        index = priv->queue[priv->queue_head];
+        priv->queue_head = (priv->queue_head + 1) % priv->n_slots;
+        priv->queue_length--;
+        slot = &priv->slots[index];
+        ticket = priv->next_ticket++;
+
+        if (priv->dispatch_ordered) {
+            while (priv->current_ticket != ticket)
+                g_cond_wait (&priv->dispatch_turn_cond, &priv->dispatch_lock);
+        }
+
+        g_mutex_unlock (&priv->dispatch_lock);
+
+        if (priv->metadata_func != NULL)
+            priv->metadata_func (slot->data, &slot->metadata, priv->metadata_user_data);
+        else
+            priv->dispatch_func (slot->data, priv->dispatch_user_data);
+
+        latency = (g_get_monotonic_time () - slot->arrival) / ((gdouble) G_USEC_PER_SEC);
+
+        g_mutex_lock (&priv->buffer_lock);
+        priv->frames_consumed++;
+        g_mutex_unlock (&priv->buffer_lock);
+
+        g_mutex_lock (&priv->dispatch_lock);
+
+        if (priv->dispatch_ordered) {
+            priv->current_ticket++;
+            g_cond_broadcast (&priv->dispatch_turn_cond);
+        }
+
+        priv->callback_latency_sum += latency;
+        priv->callback_latency_max = MAX (priv->callback_latency_max, latency);
+        priv->n_callbacks++;
+        priv->free_slots[priv->n_free_slots++] = index;
+        g_cond_signal (&priv->dispatch_space_cond);
+    }
+
+    g_mutex_unlock (&priv->dispatch_lock);
+    return NULL;
+}
+
+/*
+ * Called before the plugin starts recording so that its acquisition thread
+ * only ever sees dispatch_frame as the grab function.
+ */
+static void
+start_dispatch (UcaCamera *camera)
+{
+    UcaCameraPrivate *priv;
+
+    priv = camera->priv;
+
+    priv->n_slots = MAX (priv->num_buffers, 2);
+    priv->slots = g_new0 (DispatchSlot, priv->n_slots);
+    priv->free_slots = g_new (guint, priv->n_slots);
+    priv->queue = g_new (guint, priv->n_slots);
+
+    for (guint i = 0; i < priv->n_slots; i++) {
+        priv->slots[i].data = g_malloc (priv->frame_size);
+        priv->free_slots[i] = i;
+    }
+
+    priv->n_free_slots = priv->n_slots;
+    priv->queue_head = 0;
+    priv->queue_length = 0;
+    priv->n_dropped_queued = 0;
+    priv->next_ticket = 0;
+    priv->current_ticket = 0;
+    priv->dispatch_stopping = FALSE;
+    priv->callback_latency_sum = 0.0;
+    priv->callback_latency_max = 0.0;
+    priv->n_callbacks = 0;
+
+    priv->dispatch_func = camera->grab_func;
+    priv->dispatch_user_data = camera->user_data;
+    camera->grab_func = dispatch_frame;
+    camera->user_data = camera;
+
+    priv->n_dispatch_pool = priv->dispatch_threads;
+    priv->dispatch_pool = g_new (GThread *, priv->n_dispatch_pool);
+
+    for (guint i = 0; i < priv->n_dispatch_pool; i++)
+        priv->dispatch_pool[i] = g_thread_new ("dispatch-thread", (GThreadFunc) dispatch_thread, camera);
+}
+
+/*
+ * Called after the plugin stopped calling dispatch_frame. Delivers the
+ * remaining queued frames and restores the user's grab function.
+ */
+static void
+stop_dispatch (UcaCamera *camera)
+{
+    UcaCameraPrivate *priv;
+
+    priv = camera->priv;
+
+    if (priv->dispatch_pool == NULL)
+        return;
+
+    g_mutex_lock (&priv->dispatch_lock);
+    priv->dispatch_stopping = TRUE;
+    g_cond_broadcast (&priv->dispatch_cond);
+    g_cond_broadcast (&priv->dispatch_space_cond);
+    g_mutex_unlock (&priv->dispatch_lock);
+
+    for (guint i = 0; i < priv->n_dispatch_pool; i++)
+        g_thread_join (priv->dispatch_pool[i]);
+
+    g_free (priv->dispatch_pool);
+    priv->dispatch_pool = NULL;
+    priv->n_dispatch_pool = 0;
+
+    for (guint i = 0; i < priv->n_slots; i++)
+        g_free (priv->slots[i].data);
+
+    g_free (priv->slots);
+    g_free (priv->free_slots);
+    g_free (priv->queue);
+    priv->slots = NULL;
+    priv->free_slots = NULL;
+    priv->queue = NULL;
+    priv->n_slots = 0;
+
+    camera->grab_func = priv->dispatch_func;
+    camera->user_data = priv->dispatch_user_data;
+}
+
+static GEnumValue *
+find_enum_value (GParamSpecEnum *pspec, const gchar *name)
+{
+    GEnumValue *result;
+    GEnumClass *enum_class;
+
+    result = NULL;
+    enum_class = pspec->enum_class;
+
+    for (guint i = 0; i < enum_class->n_values; i++)
+        if (!g_strcmp0 (enum_class->values[i].value_name, name))
+            result = &enum_class->values[i];
+
+    return result;
+}
+
+static gboolean
+is_a_number (const gchar *s)
+{
+    g_return_val_if_fail (s != NULL, FALSE);
+
+    for (; *s != '\0'; s++) {
+        if (!g_ascii_isdigit (*s))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * uca_camera_parse_arg_props:
+ * @camera: A #UcaCamera object
+ * @argv: Array of property assignment strings in the form of `prop=value`
+ * @argc: Length of @argv
+ * @error: Location to store a #UcaCameraError error or %NULL
+ *
+ * Parses the assignment array @argv and sets the property to the given value.
+ * If an error occures, @error is set and %FALSE is returned.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+uca_camera_parse_arg_props (UcaCamera *camera, gchar **argv, guint argc, GError **error)
+{
+    GRegex *assignment;
+
+    assignment = g_regex_new ("\\s*([A-Za-z0-9-]*)=(.*)\\s*", 0, 0, error);
+
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_UCHAR,   value_transform_uchar);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_INT,     value_transform_int);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_UINT,    value_transform_uint);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_UINT64,  value_transform_uint64);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_LONG,    value_transform_long);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_ULONG,   value_transform_ulong);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_FLOAT,   value_transform_float);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_DOUBLE,  value_transform_double);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_BOOLEAN, value_transform_boolean);
+    g_value_register_transform_func (G_TYPE_STRING, G_TYPE_ENUM,    value_transform_enum);
+
+    for (guint i = 0; i < argc; i++) {
+        GMatchInfo *match;
+        gboolean success = TRUE;
+
+        g_regex_match (assignment, argv[i], 0, &match);
+
+        if (g_match_info_matches (match)) {
+            GParamSpec *pspec;
+            GValue value = {0};
+
+            gchar *prop = g_match_info_fetch (match, 1);
+            gchar *string_value = g_match_info_fetch (match, 2);
+
+            pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (camera), prop);
+
+            if (pspec != NULL) {
+                GValue target_value = {0};
+
+                if (g_type_is_a (pspec->value_type, G_TYPE_ENUM)) {
+                    g_value_init (&value, G_TYPE_INT);
+
+                    if (!is_a_number (string_value)) {
+                        GEnumValue *enum_value;
+
+                        enum_value = find_enum_value ((GParamSpecEnum *) pspec, string_value);
+
+                        if (enum_value) {
+                            g_value_set_int (&value, enum_value->value);
+                        }
+                        else {
                             g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_FOUND,
                                          "Enum value `%s' does not exist for `%s'",
                                          string_value, prop);
@@ -831,10 +1670,7 @@ uca_camera_start_recording (UcaCamera *camera, GError **error)
 {
     UcaCameraClass *klass;
     UcaCameraPrivate *priv;
-    static GMutex mutex;
     GError *tmp_error = NULL;
-    guint width, height, bitdepth;
-    guint pixel_size;
 
     g_return_if_fail (UCA_IS_CAMERA (camera));
 
@@ -845,7 +1681,7 @@ uca_camera_start_recording (UcaCamera *camera, GError **error)
 
     priv = camera->priv;
 
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&priv->state_lock);
 
     if (uca_camera_is_recording (camera)) {
         priv->is_recording = TRUE;
@@ -854,15 +1690,7 @@ uca_camera_start_recording (UcaCamera *camera, GError **error)
         goto start_recording_unlock;
     }
 
-    if (priv->buffered) {
-        g_object_get (camera,
-                      "roi-width", &width,
-                      "roi-height", &height,
-                      "sensor-bitdepth", &bitdepth,
-                      NULL);
-
-        pixel_size = bitdepth <= 8 ? 1 : 2;
-    }
+    update_frame_geometry (camera);
 
     if (priv->transfer_async && (camera->grab_func == NULL)) {
         g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NO_GRAB_FUNC,
@@ -870,28 +1698,48 @@ uca_camera_start_recording (UcaCamera *camera, GError **error)
         goto start_recording_unlock;
     }
 
-    g_mutex_lock (&access_lock);
+    /* Reset before the plugin may deliver frames asynchronously */
+    g_mutex_lock (&priv->buffer_lock);
+    priv->frames_produced = 0;
+    priv->frames_consumed = 0;
+    priv->frames_dropped = 0;
+    priv->buffer_high_water = 0;
+    priv->n_dropped_pending = 0;
+    g_mutex_unlock (&priv->buffer_lock);
+
+    priv->sequence = 0;
+    priv->have_last_frame_number = FALSE;
+
+    if (priv->transfer_async && priv->dispatch_threads > 0)
+        start_dispatch (camera);
+
+    g_mutex_lock (&priv->access_lock);
     (*klass->start_recording)(camera, &tmp_error);
-    g_mutex_unlock (&access_lock);
+    g_mutex_unlock (&priv->access_lock);
 
     if (tmp_error == NULL) {
         priv->is_readout = FALSE;
         priv->is_recording = TRUE;
         priv->cancelling_recording = FALSE;
         priv->cancelling_grab = FALSE;
+
         g_object_notify_by_pspec (G_OBJECT (camera), camera_properties[PROP_IS_RECORDING]);
     }
-    else
+    else {
+        stop_dispatch (camera);
         g_propagate_error (error, tmp_error);
+    }
 
     if (priv->buffered) {
-        priv->ring_buffer = uca_ring_buffer_new (width * height * pixel_size, priv->num_buffers);
+        /* One buffer is always reserved for the frame returned last */
+        priv->ring_buffer = uca_ring_buffer_new_full (FRAME_HEADER_SIZE + priv->frame_size, MAX (priv->num_buffers, 2),
+                                                      priv->buffer_alloc_flags, priv->buffer_numa_node);
         /* Let's read out the frames from another thread */
         priv->read_thread = g_thread_new ("read-thread", (GThreadFunc) buffer_thread, camera);
     }
 
 start_recording_unlock:
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->state_lock);
 }
 
 /**
@@ -906,7 +1754,6 @@ uca_camera_stop_recording (UcaCamera *camera, GError **error)
 {
     UcaCameraClass *klass;
     UcaCameraPrivate *priv;
-    static GMutex mutex;
     GError *tmp_error = NULL;
 
     g_return_if_fail (UCA_IS_CAMERA (camera));
@@ -918,7 +1765,7 @@ uca_camera_stop_recording (UcaCamera *camera, GError **error)
 
     priv = camera->priv;
 
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&priv->state_lock);
 
     if (!uca_camera_is_recording (camera)) {
         priv->is_recording = FALSE;
@@ -930,16 +1777,25 @@ uca_camera_stop_recording (UcaCamera *camera, GError **error)
     priv->cancelling_recording = TRUE;
 
     if (priv->buffered) {
+        g_mutex_lock (&priv->buffer_lock);
+        g_cond_broadcast (&priv->space_cond);
+        g_mutex_unlock (&priv->buffer_lock);
+
         g_thread_join (priv->read_thread);
         priv->read_thread = NULL;
+
+        /* Wake up anyone still waiting in uca_camera_grab() */
+        cancel_buffered_grab (priv);
     }
 
-    g_mutex_lock (&access_lock);
+    g_mutex_lock (&priv->access_lock);
 
     (*klass->stop_recording)(camera, &tmp_error);
     priv->cancelling_recording = FALSE;
 
-    g_mutex_unlock (&access_lock);
+    g_mutex_unlock (&priv->access_lock);
+
+    stop_dispatch (camera);
 
     if (tmp_error == NULL) {
         priv->is_recording = FALSE;
@@ -949,13 +1805,20 @@ uca_camera_stop_recording (UcaCamera *camera, GError **error)
     else
         g_propagate_error (error, tmp_error);
 
-    if (camera->priv->ring_buffer != NULL) {
-        g_object_unref (camera->priv->ring_buffer);
-        camera->priv->ring_buffer = NULL;
+    g_mutex_lock (&priv->buffer_lock);
+
+    if (priv->ring_buffer != NULL) {
+        g_object_unref (priv->ring_buffer);
+        priv->ring_buffer = NULL;
     }
 
+    g_clear_error (&priv->buffer_error);
+    priv->frame_borrowed = FALSE;
+
+    g_mutex_unlock (&priv->buffer_lock);
+
 error_stop_recording:
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&priv->state_lock);
 }
 
 /**
@@ -1016,7 +1879,6 @@ void
 uca_camera_start_readout (UcaCamera *camera, GError **error)
 {
     UcaCameraClass *klass;
-    static GMutex mutex;
 
     g_return_if_fail (UCA_IS_CAMERA(camera));
 
@@ -1025,14 +1887,16 @@ uca_camera_start_readout (UcaCamera *camera, GError **error)
     g_return_if_fail (klass != NULL);
     g_return_if_fail (klass->start_readout != NULL);
 
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&camera->priv->state_lock);
 
     if (!already_recording (camera, error)) {
         GError *tmp_error = NULL;
 
-        g_mutex_lock (&access_lock);
+        update_frame_geometry (camera);
+
+        g_mutex_lock (&camera->priv->access_lock);
         (*klass->start_readout) (camera, &tmp_error);
-        g_mutex_unlock (&access_lock);
+        g_mutex_unlock (&camera->priv->access_lock);
 
         if (tmp_error == NULL) {
             camera->priv->is_readout = TRUE;
@@ -1042,7 +1906,7 @@ uca_camera_start_readout (UcaCamera *camera, GError **error)
             g_propagate_error (error, tmp_error);
     }
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&camera->priv->state_lock);
 }
 
 /**
@@ -1058,7 +1922,6 @@ void
 uca_camera_stop_readout (UcaCamera *camera, GError **error)
 {
     UcaCameraClass *klass;
-    static GMutex mutex;
 
     g_return_if_fail (UCA_IS_CAMERA(camera));
 
@@ -1067,14 +1930,14 @@ uca_camera_stop_readout (UcaCamera *camera, GError **error)
     g_return_if_fail (klass != NULL);
     g_return_if_fail (klass->stop_readout != NULL);
 
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&camera->priv->state_lock);
 
     if (!already_recording (camera, error)) {
         GError *tmp_error = NULL;
 
-        g_mutex_lock (&access_lock);
+        g_mutex_lock (&camera->priv->access_lock);
         (*klass->stop_readout) (camera, &tmp_error);
-        g_mutex_unlock (&access_lock);
+        g_mutex_unlock (&camera->priv->access_lock);
 
         if (tmp_error == NULL) {
             camera->priv->is_readout = FALSE;
@@ -1084,7 +1947,7 @@ uca_camera_stop_readout (UcaCamera *camera, GError **error)
             g_propagate_error (error, tmp_error);
     }
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&camera->priv->state_lock);
 }
 
 /**
@@ -1100,6 +1963,40 @@ uca_camera_set_grab_func(UcaCamera *camera, UcaCameraGrabFunc func, gpointer use
 {
     camera->grab_func = func;
     camera->user_data = user_data;
+    camera->priv->metadata_func = NULL;
+    camera->priv->metadata_user_data = NULL;
+}
+
+static void
+grab_metadata_trampoline (gpointer data, gpointer user_data)
+{
+    UcaCamera *camera = user_data;
+    UcaFrameMetadata metadata;
+
+    collect_metadata (camera, UCA_CAMERA_GET_CLASS (camera), &metadata);
+    camera->priv->metadata_func (data, &metadata, camera->priv->metadata_user_data);
+}
+
+/**
+ * uca_camera_set_grab_metadata_func:
+ * @camera: A #UcaCamera object
+ * @func: (scope call): A #UcaCameraGrabMetadataFunc callback function
+ * @user_data: (closure): Data that is passed on to #func
+ *
+ * Like uca_camera_set_grab_func() but @func also receives the metadata of
+ * each frame. This replaces any function set with uca_camera_set_grab_func().
+ *
+ * Since: 2.5
+ */
+void
+uca_camera_set_grab_metadata_func (UcaCamera *camera, UcaCameraGrabMetadataFunc func, gpointer user_data)
+{
+    g_return_if_fail (UCA_IS_CAMERA (camera));
+
+    camera->priv->metadata_func = func;
+    camera->priv->metadata_user_data = user_data;
+    camera->grab_func = func != NULL ? grab_metadata_trampoline : NULL;
+    camera->user_data = camera;
 }
 
 /**
@@ -1116,7 +2013,6 @@ void
 uca_camera_trigger (UcaCamera *camera, GError **error)
 {
     UcaCameraClass *klass;
-    static GMutex mutex;
 
     g_return_if_fail (UCA_IS_CAMERA (camera));
 
@@ -1125,7 +2021,7 @@ uca_camera_trigger (UcaCamera *camera, GError **error)
     g_return_if_fail (klass != NULL);
     g_return_if_fail (klass->trigger != NULL);
 
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&camera->priv->trigger_lock);
 
     if (!camera->priv->is_recording) {
         g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING, "Camera is not recording");
@@ -1134,7 +2030,7 @@ uca_camera_trigger (UcaCamera *camera, GError **error)
         (*klass->trigger) (camera, error);
     }
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&camera->priv->trigger_lock);
 }
 
 /**
@@ -1169,6 +2065,199 @@ uca_camera_write (UcaCamera *camera, const gchar *name, gpointer data, gsize siz
     }
 }
 
+/*
+ * Wait with buffer_lock held until the buffer thread has written a frame,
+ * acquisition is cancelled or the timeout has expired. Returns TRUE if a frame
+ * can be read from the ring buffer.
+ */
+static gboolean
+wait_for_frame (UcaCameraPrivate *priv, GError **error)
+{
+    gint64 end_time = 0;
+
+    if (priv->grab_timeout > 0.0)
+        end_time = g_get_monotonic_time () + (gint64) (priv->grab_timeout * G_TIME_SPAN_SECOND);
+
+    while (priv->ring_buffer != NULL &&
+           !uca_ring_buffer_available (priv->ring_buffer) &&
+           !priv->cancelling_grab) {
+        if (end_time == 0)
+            g_cond_wait (&priv->buffer_cond, &priv->buffer_lock);
+        else if (!g_cond_wait_until (&priv->buffer_cond, &priv->buffer_lock, end_time))
+            break;
+    }
+
+    if (priv->ring_buffer == NULL)
+        return FALSE;
+
+    if (uca_ring_buffer_available (priv->ring_buffer))
+        return TRUE;
+
+    if (!priv->cancelling_grab) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_TIMEOUT,
+                     "No frame available after %.3f s", priv->grab_timeout);
+    }
+    else if (priv->buffer_error != NULL) {
+        g_propagate_error (error, g_error_copy (priv->buffer_error));
+    }
+
+    return FALSE;
+}
+
+/*
+ * Call into the plugin for a batch of frames. Plugins without a native grab_n
+ * are called frame by frame, but still under a single lock acquisition. A
+ * native batch cannot attribute hardware frame counters to single frames, so
+ * gap detection restarts after it. Frames are mirrored and rotated in place
+ * or, for odd rotations, acquired into the scratch frame and transformed
+ * from there.
+ */
+static guint
+call_grab (UcaCamera *camera, UcaCameraClass *klass, gpointer *frames, guint n_frames,
+           UcaFrameMetadata *metadata, GError **error)
+{
+    UcaCameraPrivate *priv;
+    gboolean mirror;
+    guint rotate;
+    guint n_grabbed = 0;
+
+    priv = camera->priv;
+    mirror = priv->mirror;
+    rotate = priv->rotate;
+
+    g_mutex_lock (&priv->access_lock);
+
+    if (klass->grab_n != NULL && n_frames > 1 && metadata == NULL && !uca_transform_is_transposed (rotate)) {
+        n_grabbed = (*klass->grab_n) (camera, frames, n_frames, error);
+        priv->sequence += n_grabbed;
+        priv->have_last_frame_number = FALSE;
+
+        for (guint i = 0; i < n_grabbed && !uca_transform_is_identity (mirror, rotate); i++)
+            transform_frame (priv, frames[i], frames[i], mirror, rotate);
+    }
+    else {
+        while (n_grabbed < n_frames) {
+            UcaFrameMetadata unused;
+            gpointer source;
+
+            source = get_transform_source (priv, frames[n_grabbed], rotate);
+
+            if (!(*klass->grab) (camera, source, error))
+                break;
+
+            collect_metadata (camera, klass, metadata != NULL ? &metadata[n_grabbed] : &unused);
+
+            if (!uca_transform_is_identity (mirror, rotate))
+                transform_frame (priv, frames[n_grabbed], source, mirror, rotate);
+
+            n_grabbed++;
+        }
+    }
+
+    g_mutex_unlock (&priv->access_lock);
+
+    return n_grabbed;
+}
+
+static guint
+grab_unbuffered (UcaCamera *camera, UcaCameraClass *klass, gpointer *frames, guint n_frames,
+                 UcaFrameMetadata *metadata, GError **error)
+{
+    UcaCameraPrivate *priv;
+    guint n_grabbed = 0;
+
+    priv = camera->priv;
+    g_mutex_lock (&priv->grab_lock);
+
+    if (!priv->is_recording && !priv->is_readout) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING,
+                     "Camera is neither recording nor in readout mode");
+    }
+    else {
+#ifdef WITH_PYTHON_MULTITHREADING
+        if (Py_IsInitialized ()) {
+            PyGILState_STATE state = PyGILState_Ensure ();
+            Py_BEGIN_ALLOW_THREADS
+
+            n_grabbed = call_grab (camera, klass, frames, n_frames, metadata, error);
+
+            Py_END_ALLOW_THREADS
+            PyGILState_Release (state);
+        }
+        else {
+            n_grabbed = call_grab (camera, klass, frames, n_frames, metadata, error);
+        }
+#else
+        n_grabbed = call_grab (camera, klass, frames, n_frames, metadata, error);
+#endif
+
+        if (n_grabbed > 0) {
+            g_mutex_lock (&priv->buffer_lock);
+            priv->frames_produced += n_grabbed;
+            priv->frames_consumed += n_grabbed;
+            g_mutex_unlock (&priv->buffer_lock);
+        }
+    }
+
+    g_mutex_unlock (&priv->grab_lock);
+
+    return n_grabbed;
+}
+
+static guint
+grab_buffered (UcaCameraPrivate *priv, gpointer *frames, guint n_frames,
+               UcaFrameMetadata *metadata, GError **error)
+{
+    const gboolean mirror = priv->mirror;
+    const guint rotate = priv->rotate;
+    guint n_grabbed = 0;
+
+    g_mutex_lock (&priv->buffer_lock);
+
+    while (n_grabbed < n_frames && wait_for_frame (priv, error)) {
+        UcaRingBuffer *ring_buffer;
+        guint8 *block;
+
+        /*
+         * Copy without buffer_lock so that the buffer thread keeps running.
+         * Marking the block borrowed keeps DROP_OLDEST away from it and the
+         * reference keeps it alive if recording is stopped meanwhile.
+         */
+        ring_buffer = g_object_ref (priv->ring_buffer);
+        block = uca_ring_buffer_get_read_pointer (ring_buffer);
+        priv->frame_borrowed = TRUE;
+
+        if (metadata != NULL) {
+            metadata[n_grabbed] = *((UcaFrameMetadata *) block);
+            metadata[n_grabbed].n_dropped += priv->n_dropped_pending;
+        }
+
+        priv->n_dropped_pending = 0;
+        priv->frames_consumed++;
+        g_mutex_unlock (&priv->buffer_lock);
+
+        /* Transforming costs about as much as the copy it replaces */
+        if (uca_transform_is_identity (mirror, rotate))
+            memcpy (frames[n_grabbed], block + FRAME_HEADER_SIZE, priv->frame_size);
+        else
+            transform_frame (priv, frames[n_grabbed], block + FRAME_HEADER_SIZE, mirror, rotate);
+
+        n_grabbed++;
+
+        g_mutex_lock (&priv->buffer_lock);
+
+        if (priv->ring_buffer == ring_buffer)
+            priv->frame_borrowed = FALSE;
+
+        g_cond_signal (&priv->space_cond);
+        g_object_unref (ring_buffer);
+    }
+
+    g_mutex_unlock (&priv->buffer_lock);
+
+    return n_grabbed;
+}
+
 /**
  * uca_camera_grab:
  * @camera: A #UcaCamera object
@@ -1179,88 +2268,213 @@ uca_camera_write (UcaCamera *camera, const gchar *name, gpointer data, gsize siz
  * Grab a frame a single frame and store the result in @data.
  *
  * You must have called uca_camera_start_recording() before, otherwise you will
- * get a #UCA_CAMERA_ERROR_NOT_RECORDING error.
+ * get a #UCA_CAMERA_ERROR_NOT_RECORDING error. In buffered mode, the call
+ * blocks until a frame is available or #UcaCamera:grab-timeout expires, in
+ * which case a #UCA_CAMERA_ERROR_TIMEOUT error is set.
  */
 gboolean
 uca_camera_grab (UcaCamera *camera, gpointer data, GError **error)
 {
-    UcaCameraClass *klass;
-    gboolean result = FALSE;
+    g_return_val_if_fail (data != NULL, FALSE);
 
-    /* FIXME: this prevents accessing two independent cameras simultanously. */
-    static GMutex mutex;
+    return uca_camera_grab_scatter (camera, &data, 1, error) == 1;
+}
 
-    g_return_val_if_fail (UCA_IS_CAMERA(camera), FALSE);
+static guint
+grab_frames (UcaCamera *camera, gpointer *frames, guint n_frames, UcaFrameMetadata *metadata, GError **error)
+{
+    UcaCameraClass *klass;
+
+    g_return_val_if_fail (UCA_IS_CAMERA(camera), 0);
 
     klass = UCA_CAMERA_GET_CLASS (camera);
 
-    g_return_val_if_fail (klass != NULL, FALSE);
-    g_return_val_if_fail (klass->grab != NULL, FALSE);
+    g_return_val_if_fail (klass != NULL, 0);
+    g_return_val_if_fail (klass->grab != NULL, 0);
+    g_return_val_if_fail (frames != NULL, 0);
+
+    if (!camera->priv->buffered)
+        return grab_unbuffered (camera, klass, frames, n_frames, metadata, error);
+
+    g_return_val_if_fail (!camera->priv->frame_borrowed, 0);
+
+    return grab_buffered (camera->priv, frames, n_frames, metadata, error);
+}
+
+/**
+ * uca_camera_grab_with_metadata:
+ * @camera: A #UcaCamera object
+ * @data: (type gulong): Pointer to suitably sized data buffer. Must not be
+ *  %NULL.
+ * @metadata: (out caller-allocates): Location to store the frame metadata
+ * @error: Location to store a #UcaCameraError error or %NULL
+ *
+ * Grab a frame like uca_camera_grab() and describe it in @metadata. Gaps in
+ * the sequence of frames, either reported by the camera or caused by the
+ * #UcaCamera:overrun-policy in buffered mode, are accounted in the
+ * @n_dropped field.
+ *
+ * Returns: %TRUE on success.
+ * Since: 2.5
+ */
+gboolean
+uca_camera_grab_with_metadata (UcaCamera *camera, gpointer data, UcaFrameMetadata *metadata, GError **error)
+{
     g_return_val_if_fail (data != NULL, FALSE);
+    g_return_val_if_fail (metadata != NULL, FALSE);
 
-    if (!camera->priv->buffered) {
-        g_mutex_lock (&mutex);
+    return grab_frames (camera, &data, 1, metadata, error) == 1;
+}
 
-        if (!camera->priv->is_recording && !camera->priv->is_readout) {
-            g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING,
-                         "Camera is neither recording nor in readout mode");
-        }
-        else {
-#ifdef WITH_PYTHON_MULTITHREADING
-            if (Py_IsInitialized ()) {
-                PyGILState_STATE state = PyGILState_Ensure ();
-                Py_BEGIN_ALLOW_THREADS
+/**
+ * uca_camera_grab_n:
+ * @camera: A #UcaCamera object
+ * @data: (type gulong): Pointer to a data buffer large enough for @n_frames
+ *  consecutive frames. Must not be %NULL.
+ * @n_frames: Number of frames to grab
+ * @error: Location to store a #UcaCameraError error or %NULL
+ *
+ * Grab @n_frames frames into contiguous memory. This behaves like calling
+ * uca_camera_grab() @n_frames times but acquires the locks only once, which
+ * matters for small frames at high rates.
+ *
+ * Returns: Number of frames grabbed, less than @n_frames if @error is set.
+ * Since: 2.5
+ */
+guint
+uca_camera_grab_n (UcaCamera *camera, gpointer data, guint n_frames, GError **error)
+{
+    gpointer stack_frames[64];
+    gpointer *frames;
+    guint width, height, bitdepth;
+    gsize frame_size;
+    guint n_grabbed;
 
-                g_mutex_lock (&access_lock);
-                result = (*klass->grab) (camera, data, error);
-                g_mutex_unlock (&access_lock);
+    g_return_val_if_fail (UCA_IS_CAMERA (camera), 0);
+    g_return_val_if_fail (data != NULL, 0);
 
-                Py_END_ALLOW_THREADS
-                PyGILState_Release (state);
-            }
-            else {
-                g_mutex_lock (&access_lock);
-                result = (*klass->grab) (camera, data, error);
-                g_mutex_unlock (&access_lock);
-            }
-#else
-            g_mutex_lock (&access_lock);
-            result = (*klass->grab) (camera, data, error);
-            g_mutex_unlock (&access_lock);
-#endif
-        }
+    g_object_get (camera,
+                  "roi-width", &width,
+                  "roi-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    frame_size = (gsize) width * height * (bitdepth <= 8 ? 1 : 2);
+    frames = n_frames <= G_N_ELEMENTS (stack_frames) ? stack_frames : g_new (gpointer, n_frames);
+
+    for (guint i = 0; i < n_frames; i++)
+        frames[i] = ((guint8 *) data) + i * frame_size;
+
+    n_grabbed = uca_camera_grab_scatter (camera, frames, n_frames, error);
+
+    if (frames != stack_frames)
+        g_free (frames);
+
+    return n_grabbed;
+}
+
+/**
+ * uca_camera_grab_scatter:
+ * @camera: A #UcaCamera object
+ * @frames: (array length=n_frames): Array of @n_frames pointers to suitably
+ *  sized data buffers
+ * @n_frames: Number of frames to grab
+ * @error: Location to store a #UcaCameraError error or %NULL
+ *
+ * Like uca_camera_grab_n() but store each frame in its own buffer.
+ *
+ * Returns: Number of frames grabbed, less than @n_frames if @error is set.
+ * Since: 2.5
+ */
+guint
+uca_camera_grab_scatter (UcaCamera *camera, gpointer *frames, guint n_frames, GError **error)
+{
+    return grab_frames (camera, frames, n_frames, NULL, error);
+}
+
+/**
+ * uca_camera_borrow_frame:
+ * @camera: A #UcaCamera object
+ * @error: Location to store a #UcaCameraError error or %NULL
+ *
+ * Wait for the next frame like uca_camera_grab() but instead of copying it,
+ * return a pointer into the internal ring buffer. The frame is not
+ * overwritten until it is handed back with uca_camera_release_frame(), which
+ * must happen before the next call to uca_camera_grab() or
+ * uca_camera_borrow_frame(). This requires #UcaCamera:buffered to be %TRUE.
+ *
+ * Returns: (transfer none): Read-only pointer to the frame data or %NULL.
+ * Since: 2.5
+ */
+gconstpointer
+uca_camera_borrow_frame (UcaCamera *camera, GError **error)
+{
+    UcaCameraPrivate *priv;
+    gpointer frame = NULL;
+    gboolean mirror;
+    guint rotate;
+
+    g_return_val_if_fail (UCA_IS_CAMERA (camera), NULL);
+
+    priv = camera->priv;
+    g_return_val_if_fail (!priv->frame_borrowed, NULL);
 
-        g_mutex_unlock (&mutex);
+    if (!priv->buffered) {
+        g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_IMPLEMENTED,
+                     "Frames can only be borrowed in buffered mode");
+        return NULL;
     }
-    else {
-        gpointer buffer;
 
-        if (camera->priv->ring_buffer == NULL)
-            return FALSE;
+    g_mutex_lock (&priv->buffer_lock);
 
-        /*
-         * Spin-lock until we can read something. This shouldn't happen to
-         * often, as buffering is usually used in those cases when the camera is
-         * faster than the software.
-         */
-        while (!uca_ring_buffer_available (camera->priv->ring_buffer)) {
-            if (camera->priv->cancelling_grab) {
-                return FALSE;
-            }
-        }
+    if (wait_for_frame (priv, error)) {
+        frame = ((guint8 *) uca_ring_buffer_get_read_pointer (priv->ring_buffer)) + FRAME_HEADER_SIZE;
+        priv->n_dropped_pending = 0;
+        priv->frame_borrowed = TRUE;
+        priv->frames_consumed++;
+    }
 
-        buffer = uca_ring_buffer_get_read_pointer (camera->priv->ring_buffer);
+    g_mutex_unlock (&priv->buffer_lock);
 
-        if (buffer == NULL) {
-            g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM,
-                         "Ring buffer is empty");
-        }
-        else {
-            memcpy (data, buffer, uca_ring_buffer_get_block_size (camera->priv->ring_buffer));
-            result = TRUE;
-        }
+    mirror = priv->mirror;
+    rotate = priv->rotate;
+
+    /*
+     * The borrowed slot is not touched by the producer, so it can be
+     * transformed in place unless the rotation swaps width and height.
+     */
+    if (frame != NULL && !uca_transform_is_identity (mirror, rotate)) {
+        gpointer target;
+
+        target = get_transform_source (priv, frame, rotate);
+        transform_frame (priv, target, frame, mirror, rotate);
+        frame = target;
     }
-    return result;
+
+    return frame;
+}
+
+/**
+ * uca_camera_release_frame:
+ * @camera: A #UcaCamera object
+ *
+ * Return the frame obtained with uca_camera_borrow_frame() to the ring buffer.
+ *
+ * Since: 2.5
+ */
+void
+uca_camera_release_frame (UcaCamera *camera)
+{
+    UcaCameraPrivate *priv;
+
+    g_return_if_fail (UCA_IS_CAMERA (camera));
+
+    priv = camera->priv;
+
+    g_mutex_lock (&priv->buffer_lock);
+    priv->frame_borrowed = FALSE;
+    g_cond_signal (&priv->space_cond);
+    g_mutex_unlock (&priv->buffer_lock);
 }
 
 /**
@@ -1282,11 +2496,12 @@ gboolean
 uca_camera_readout (UcaCamera *camera, gpointer data, guint index, GError **error)
 {
     UcaCameraClass *klass;
+    UcaCameraPrivate *priv;
+    gpointer source;
+    gboolean mirror;
+    guint rotate;
     gboolean result = FALSE;
 
-    /* FIXME: this prevents accessing two independent cameras simultanously. */
-    static GMutex mutex;
-
     g_return_val_if_fail (UCA_IS_CAMERA(camera), FALSE);
 
     klass = UCA_CAMERA_GET_CLASS (camera);
@@ -1301,36 +2516,44 @@ uca_camera_readout (UcaCamera *camera, gpointer data, guint index, GError **erro
         return FALSE;
     }
 
-    g_mutex_lock (&mutex);
+    g_mutex_lock (&camera->priv->grab_lock);
 
     if (!camera->priv->is_recording && !camera->priv->is_readout) {
         g_set_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING,
                      "Camera is not in readout or record mode");
     }
     else {
-        g_mutex_lock (&access_lock);
+        priv = camera->priv;
+        mirror = priv->mirror;
+        rotate = priv->rotate;
+        source = get_transform_source (priv, data, rotate);
+
+        g_mutex_lock (&camera->priv->access_lock);
 
 #ifdef WITH_PYTHON_MULTITHREADING
         if (Py_IsInitialized ()) {
             PyGILState_STATE state = PyGILState_Ensure ();
             Py_BEGIN_ALLOW_THREADS
 
-            result = (*klass->readout) (camera, data, index, error);
+            result = (*klass->readout) (camera, source, index, error);
 
             Py_END_ALLOW_THREADS
             PyGILState_Release (state);
         }
         else {
-            result = (*klass->readout) (camera, data, index, error);
+            result = (*klass->readout) (camera, source, index, error);
         }
 #else
-        result = (*klass->readout) (camera, data, index, error);
+        result = (*klass->readout) (camera, source, index, error);
 #endif
 
-        g_mutex_unlock (&access_lock);
+        g_mutex_unlock (&camera->priv->access_lock);
+
+        if (result && !uca_transform_is_identity (mirror, rotate))
+            transform_frame (priv, data, source, mirror, rotate);
     }
 
-    g_mutex_unlock (&mutex);
+    g_mutex_unlock (&camera->priv->grab_lock);
 
     return result;
 }
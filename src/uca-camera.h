@@ -61,6 +61,11 @@ typedef enum {
     UCA_CAMERA_TRIGGER_TYPE_LEVEL
 } UcaCameraTriggerType;
 
+typedef enum {
+    UCA_CAMERA_OVERRUN_POLICY_BLOCK,
+    UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST
+} UcaCameraOverrunPolicy;
+
 typedef enum {
     UCA_UNIT_NA = 0,
     UCA_UNIT_METER,
@@ -107,6 +112,18 @@ enum {
     PROP_NUM_BUFFERS,
     PROP_MIRROR,
     PROP_ROTATE,
+    PROP_GRAB_TIMEOUT,
+    PROP_OVERRUN_POLICY,
+    PROP_FRAMES_PRODUCED,
+    PROP_FRAMES_CONSUMED,
+    PROP_FRAMES_DROPPED,
+    PROP_BUFFER_HIGH_WATER,
+    PROP_BUFFER_ALLOC_FLAGS,
+    PROP_BUFFER_NUMA_NODE,
+    PROP_DISPATCH_THREADS,
+    PROP_DISPATCH_ORDERED,
+    PROP_CALLBACK_LATENCY_MEAN,
+    PROP_CALLBACK_LATENCY_MAX,
     N_BASE_PROPERTIES
 };
 
@@ -121,6 +138,43 @@ UCA_API extern const gchar *uca_camera_props[N_BASE_PROPERTIES];
  */
 typedef void (*UcaCameraGrabFunc) (gpointer data, gpointer user_data);
 
+/**
+ * UcaFrameMetadata:
+ * @timestamp: Monotonic host time in microseconds at which the frame was
+ *  acquired, comparable to g_get_monotonic_time()
+ * @frame_number: Frame counter of the camera or, if the camera has none, the
+ *  number of frames acquired before since recording was started
+ * @sequence: Number of frames libuca acquired before this one since recording
+ *  was started
+ * @n_dropped: Number of frames lost between the previously delivered frame
+ *  and this one
+ * @exposure_time: Exposure time in seconds or 0 if unknown
+ *
+ * Information about a single frame.
+ *
+ * Since: 2.5
+ */
+typedef struct {
+    gint64 timestamp;
+    guint64 frame_number;
+    guint64 sequence;
+    guint n_dropped;
+    gdouble exposure_time;
+} UcaFrameMetadata;
+
+/**
+ * UcaCameraGrabMetadataFunc:
+ * @data: a pointer to the raw data
+ * @metadata: information about the frame
+ * @user_data: user data passed to the function
+ *
+ * A function receiving the data and its metadata when streaming in
+ * asynchronous mode.
+ *
+ * Since: 2.5
+ */
+typedef void (*UcaCameraGrabMetadataFunc) (gpointer data, const UcaFrameMetadata *metadata, gpointer user_data);
+
 struct _UcaCamera {
     /*< private >*/
     GObject parent;
@@ -148,6 +202,8 @@ struct _UcaCameraClass {
     void (*write)           (UcaCamera *camera, const gchar *name, gpointer data, gsize size, GError **error);
     gboolean (*grab)        (UcaCamera *camera, gpointer data, GError **error);
     gboolean (*readout)     (UcaCamera *camera, gpointer data, guint index, GError **error);
+    guint (*grab_n)         (UcaCamera *camera, gpointer *frames, guint n_frames, GError **error);
+    void (*get_frame_metadata) (UcaCamera *camera, UcaFrameMetadata *metadata);
 };
 
 UCA_API UcaCamera * uca_camera_new      (const gchar        *type,
@@ -183,6 +239,26 @@ UCA_API void        uca_camera_write    (UcaCamera          *camera,
 UCA_API gboolean    uca_camera_grab     (UcaCamera          *camera,
                                          gpointer            data,
                                          GError            **error);
+UCA_API gboolean    uca_camera_grab_with_metadata
+                                        (UcaCamera          *camera,
+                                         gpointer            data,
+                                         UcaFrameMetadata   *metadata,
+                                         GError            **error);
+UCA_API guint       uca_camera_grab_n   (UcaCamera          *camera,
+                                         gpointer            data,
+                                         guint               n_frames,
+                                         GError            **error);
+UCA_API guint       uca_camera_grab_scatter
+                                        (UcaCamera          *camera,
+                                         gpointer           *frames,
+                                         guint               n_frames,
+                                         GError            **error);
+UCA_API gconstpointer
+                    uca_camera_borrow_frame
+                                        (UcaCamera          *camera,
+                                         GError            **error);
+UCA_API void        uca_camera_release_frame
+                                        (UcaCamera          *camera);
 UCA_API gboolean    uca_camera_readout  (UcaCamera          *camera,
                                          gpointer            data,
                                          guint               index,
@@ -191,6 +267,10 @@ UCA_API void        uca_camera_set_grab_func
                                         (UcaCamera          *camera,
                                          UcaCameraGrabFunc   func,
                                          gpointer            user_data);
+UCA_API void        uca_camera_set_grab_metadata_func
+                                        (UcaCamera          *camera,
+                                         UcaCameraGrabMetadataFunc func,
+                                         gpointer            user_data);
 UCA_API void        uca_camera_register_unit
                                         (UcaCamera          *camera,
                                          const gchar        *prop_name,
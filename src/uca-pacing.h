@@ -0,0 +1,101 @@
+/* Copyright (C) 2011-2013 Matthias Vogelgesang <matthias.vogelgesang@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA */
+
+/*
+ * Frame pacing shared by the software cameras. This header is internal and
+ * not installed, all functions are inlined into the plugins using them.
+ */
+
+#ifndef UCA_PACING_H
+#define UCA_PACING_H
+
+#include <glib.h>
+#include <errno.h>
+#include <time.h>
+
+typedef struct {
+    gint64  start;
+    guint64 n_paced;
+} UcaPacing;
+
+/*
+ * Sleep until the monotonic time deadline in microseconds. The final
+ * spin_time seconds are busy-waited because waking up from a sleep can take
+ * longer than the period at kHz frame rates.
+ */
+static inline void
+uca_pacing_wait_until (gint64 deadline, gdouble spin_time)
+{
+    gint64 wake_up;
+
+    wake_up = deadline - (gint64) (spin_time * G_USEC_PER_SEC);
+
+#ifdef __linux__
+    /* g_get_monotonic_time() is based on CLOCK_MONOTONIC */
+    if (wake_up > g_get_monotonic_time ()) {
+        struct timespec ts;
+
+        ts.tv_sec = wake_up / G_USEC_PER_SEC;
+        ts.tv_nsec = (wake_up % G_USEC_PER_SEC) * 1000;
+
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+#else
+    {
+        gint64 now = g_get_monotonic_time ();
+
+        if (wake_up > now)
+            g_usleep (wake_up - now);
+    }
+#endif
+
+    while (g_get_monotonic_time () < deadline)
+        ;
+}
+
+static inline void
+uca_pacing_reset (UcaPacing *pacing)
+{
+    pacing->start = g_get_monotonic_time ();
+    pacing->n_paced = 0;
+}
+
+/*
+ * Wait until the next frame is due. Frame n is due n periods after the last
+ * reset, so that the time spent on a frame does not add up over the
+ * acquisition, plus delay microseconds. Like a camera without buffer, frames
+ * missed by more than a period are not delivered in a burst, instead pacing
+ * starts over.
+ */
+static inline void
+uca_pacing_wait_next (UcaPacing *pacing, gdouble period, gint64 delay, gdouble spin_time)
+{
+    gint64 deadline;
+
+    pacing->n_paced++;
+    deadline = pacing->start + (gint64) (pacing->n_paced * period * G_USEC_PER_SEC) + delay;
+
+    if (g_get_monotonic_time () - deadline > (gint64) (period * G_USEC_PER_SEC)) {
+        uca_pacing_reset (pacing);
+        return;
+    }
+
+    uca_pacing_wait_until (deadline, spin_time);
+}
+
+#endif
@@ -15,32 +15,122 @@
    with this library; if not, write to the Free Software Foundation, Inc., 51
    Franklin St, Fifth Floor, Boston, MA 02110, USA */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
 #include <math.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include "uca-ring-buffer.h"
+#include "uca-enums.h"
 
 #define UCA_RING_BUFFER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UCA_TYPE_RING_BUFFER, UcaRingBufferPrivate))
 
 G_DEFINE_TYPE(UcaRingBuffer, uca_ring_buffer, G_TYPE_OBJECT)
 
+/*
+ * The ring buffer is a single-producer/single-consumer queue. write_index and
+ * read_index count the blocks ever written and read. Each is only modified by
+ * its owning side and published with release semantics, the other side reads
+ * it with acquire semantics. The slot cursors are private to their side and
+ * wrap without a division, so num-blocks does not need to be a power of two.
+ */
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(ptr)       __atomic_load_n ((ptr), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(ptr, val) __atomic_store_n ((ptr), (val), __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(ptr)       ((guint) g_atomic_int_get ((gint *) (ptr)))
+#define STORE_RELEASE(ptr, val) g_atomic_int_set ((gint *) (ptr), (gint) (val))
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#define HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
 struct _UcaRingBufferPrivate {
     guchar  *data;
     gsize    block_size;
     guint    n_blocks_total;
+    gsize    mapped_size;
+    gchar   *filename;
+    gint     fd;
+    GError  *map_error;
+    gboolean constructed;
+    UcaRingBufferAllocFlags alloc_flags;
+    gint     numa_node;
+
+    /* Producer side, kept on its own cache line to avoid false sharing */
+    gchar    pad_write[CACHE_LINE_SIZE];
     guint    write_index;
+    guint    write_slot;
+    guint    claim_index;
+    guint    high_water;
+
+    /* Consumer side */
+    gchar    pad_read[CACHE_LINE_SIZE];
     guint    read_index;
-    guint    read;
-    guint    written;
+    guint    read_slot;
+    guint    n_dropped;
+    gchar    pad_end[CACHE_LINE_SIZE];
 };
 
 enum {
     PROP_0,
     PROP_BLOCK_SIZE,
     PROP_NUM_BLOCKS,
+    PROP_ALLOC_FLAGS,
+    PROP_NUMA_NODE,
+    PROP_FILENAME,
     N_PROPERTIES
 };
 
 static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 
+static inline guint
+next_slot (UcaRingBufferPrivate *priv, guint slot)
+{
+    return ++slot == priv->n_blocks_total ? 0 : slot;
+}
+
+static inline guchar *
+slot_pointer (UcaRingBufferPrivate *priv, guint slot)
+{
+    return priv->data + slot * priv->block_size;
+}
+
+/*
+ * Return the index of the oldest block that is still intact. A buffer filled
+ * up to capacity is intact as long as the producer is not writing. Once it
+ * took the write pointer for the next block, that block's slot may be
+ * half-written, so only the n_blocks - 1 most recent blocks are intact.
+ */
+static inline guint
+first_intact (UcaRingBufferPrivate *priv, guint written)
+{
+    guint top;
+
+    /* The claim may already be ahead of the written count we loaded */
+    top = LOAD_ACQUIRE (&priv->claim_index);
+
+    if ((gint) (top - written) <= 0)
+        top = written;
+
+    if (top - priv->read_index > priv->n_blocks_total)
+        return top - priv->n_blocks_total;
+
+    return priv->read_index;
+}
+
 UcaRingBuffer *
 uca_ring_buffer_new (gsize block_size,
                      guint n_blocks)
@@ -54,13 +144,136 @@ uca_ring_buffer_new (gsize block_size,
     return buffer;
 }
 
+/**
+ * uca_ring_buffer_new_full:
+ * @block_size: Number of bytes per block
+ * @n_blocks: Number of blocks
+ * @flags: #UcaRingBufferAllocFlags controlling how the storage is allocated
+ * @numa_node: NUMA node the storage is bound to or -1 for no binding
+ *
+ * Create a new ring buffer like uca_ring_buffer_new() with control over the
+ * allocation of the underlying storage. Flags that are not supported on the
+ * current platform are ignored.
+ *
+ * Return value: A new #UcaRingBuffer.
+ * Since: 2.5
+ */
+UcaRingBuffer *
+uca_ring_buffer_new_full (gsize block_size,
+                          guint n_blocks,
+                          UcaRingBufferAllocFlags flags,
+                          gint numa_node)
+{
+    UcaRingBuffer *buffer;
+
+    buffer = g_object_new (UCA_TYPE_RING_BUFFER,
+                           "block-size", (guint64) block_size,
+                           "num-blocks", n_blocks,
+                           "alloc-flags", flags,
+                           "numa-node", numa_node,
+                           NULL);
+    return buffer;
+}
+
+/**
+ * uca_ring_buffer_new_mapped:
+ * @filename: Path of the file backing the ring buffer
+ * @block_size: Number of bytes per block
+ * @n_blocks: Number of blocks
+ * @flags: #UcaRingBufferAllocFlags, only %UCA_RING_BUFFER_ALLOC_PREFAULT is
+ *  used to populate the mapping up front
+ * @error: Location to store a #GFileError or %NULL
+ *
+ * Create a new ring buffer whose storage is a shared mapping of @filename,
+ * which is created or truncated to hold all blocks. Written blocks are handed
+ * to the kernel for writeback immediately, so acquisitions larger than the
+ * physical memory can be recorded. The file is not removed when the buffer is
+ * destroyed and contains the blocks in slot order.
+ *
+ * Return value: A new #UcaRingBuffer or %NULL on error.
+ * Since: 2.5
+ */
+UcaRingBuffer *
+uca_ring_buffer_new_mapped (const gchar *filename,
+                            gsize block_size,
+                            guint n_blocks,
+                            UcaRingBufferAllocFlags flags,
+                            GError **error)
+{
+    UcaRingBuffer *buffer;
+
+    g_return_val_if_fail (filename != NULL, NULL);
+
+    buffer = g_object_new (UCA_TYPE_RING_BUFFER,
+                           "block-size", (guint64) block_size,
+                           "num-blocks", n_blocks,
+                           "alloc-flags", flags,
+                           "filename", filename,
+                           NULL);
+
+    if (buffer->priv->map_error != NULL) {
+        g_propagate_error (error, buffer->priv->map_error);
+        buffer->priv->map_error = NULL;
+        g_object_unref (buffer);
+        return NULL;
+    }
+
+    return buffer;
+}
+
+/**
+ * uca_ring_buffer_reset:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Discard all blocks. This must not be called while a producer or consumer is
+ * accessing @buffer.
+ */
 void
 uca_ring_buffer_reset (UcaRingBuffer *buffer)
 {
+    UcaRingBufferPrivate *priv;
+
+    g_return_if_fail (UCA_IS_RING_BUFFER (buffer));
+
+    priv = buffer->priv;
+    priv->write_slot = 0;
+    priv->read_slot = 0;
+    priv->high_water = 0;
+    priv->n_dropped = 0;
+    STORE_RELEASE (&priv->claim_index, 0);
+    STORE_RELEASE (&priv->write_index, 0);
+    STORE_RELEASE (&priv->read_index, 0);
+}
+
+/**
+ * uca_ring_buffer_rewind:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Make all intact blocks readable again, including those that were already
+ * read, for example to browse the frames of an acquisition that was streamed
+ * to disk by a consumer. Like uca_ring_buffer_reset(), this must not be
+ * called while a producer or consumer is accessing @buffer.
+ *
+ * Since: 2.5
+ */
+void
+uca_ring_buffer_rewind (UcaRingBuffer *buffer)
+{
+    UcaRingBufferPrivate *priv;
+    guint written;
+    guint n_intact;
+
     g_return_if_fail (UCA_IS_RING_BUFFER (buffer));
 
-    buffer->priv->write_index = 0;
-    buffer->priv->read_index = 0;
+    priv = buffer->priv;
+    written = LOAD_ACQUIRE (&priv->write_index);
+
+    /* Pretend nothing was read, the overwritten blocks are then skipped */
+    priv->read_index = written < priv->n_blocks_total ? 0 : written - priv->n_blocks_total;
+    n_intact = written - first_intact (priv, written);
+
+    priv->read_slot = (priv->write_slot + priv->n_blocks_total - n_intact) % priv->n_blocks_total;
+    STORE_RELEASE (&priv->read_index, written - n_intact);
 }
 
 gsize
@@ -70,11 +283,64 @@ uca_ring_buffer_get_block_size (UcaRingBuffer *buffer)
     return buffer->priv->block_size;
 }
 
+/**
+ * uca_ring_buffer_available:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Check if a block can be read. Must only be called by the consumer.
+ *
+ * Return value: %TRUE if uca_ring_buffer_get_read_pointer() will return data.
+ */
 gboolean
 uca_ring_buffer_available (UcaRingBuffer *buffer)
 {
+    UcaRingBufferPrivate *priv;
+    guint written;
+
     g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), FALSE);
-    return buffer->priv->read_index < buffer->priv->write_index;
+    priv = buffer->priv;
+    written = LOAD_ACQUIRE (&priv->write_index);
+    return written != first_intact (priv, written);
+}
+
+/**
+ * uca_ring_buffer_full:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Check if the producer would overwrite unread data or the block most recently
+ * returned by uca_ring_buffer_get_read_pointer(), which stays valid until the
+ * next read. Must only be called by the producer.
+ *
+ * Return value: %TRUE if no block can be written without overwriting.
+ * Since: 2.5
+ */
+gboolean
+uca_ring_buffer_full (UcaRingBuffer *buffer)
+{
+    UcaRingBufferPrivate *priv;
+
+    g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), TRUE);
+    priv = buffer->priv;
+    return priv->write_index - LOAD_ACQUIRE (&priv->read_index) + 1 >= priv->n_blocks_total;
+}
+
+/*
+ * Skip the blocks the producer has overwritten or is overwriting and account
+ * them as dropped.
+ */
+static void
+skip_overwritten (UcaRingBufferPrivate *priv, guint written)
+{
+    guint n_lost;
+
+    n_lost = first_intact (priv, written) - priv->read_index;
+
+    if (n_lost == 0)
+        return;
+
+    priv->n_dropped += n_lost;
+    priv->read_slot = (guint) ((priv->read_slot + (guint64) n_lost) % priv->n_blocks_total);
+    STORE_RELEASE (&priv->read_index, priv->read_index + n_lost);
 }
 
 /**
@@ -82,7 +348,9 @@ uca_ring_buffer_available (UcaRingBuffer *buffer)
  * @buffer: A #UcaRingBuffer object
  *
  * Get pointer to current read location. If no data is available, %NULL is
- * returned.
+ * returned. If the producer has overwritten unread blocks or is about to, these
+ * are skipped and counted by uca_ring_buffer_get_num_dropped(). Must only be
+ * called by the consumer.
  *
  * Return value: (transfer none): Pointer to current read location
  */
@@ -91,13 +359,22 @@ uca_ring_buffer_get_read_pointer (UcaRingBuffer *buffer)
 {
     UcaRingBufferPrivate *priv;
     gpointer data;
+    guint written;
 
     g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), NULL);
     priv = buffer->priv;
 
-    g_return_val_if_fail (priv->read_index != priv->write_index, NULL);
-    data = priv->data + (priv->read_index % priv->n_blocks_total) * priv->block_size;
-    priv->read_index++;
+    written = LOAD_ACQUIRE (&priv->write_index);
+    g_return_val_if_fail (written != priv->read_index, NULL);
+
+    skip_overwritten (priv, written);
+
+    if (priv->read_index == written)
+        return NULL;
+
+    data = slot_pointer (priv, priv->read_slot);
+    priv->read_slot = next_slot (priv, priv->read_slot);
+    STORE_RELEASE (&priv->read_index, priv->read_index + 1);
     return data;
 }
 
@@ -105,7 +382,13 @@ uca_ring_buffer_get_read_pointer (UcaRingBuffer *buffer)
  * uca_ring_buffer_get_write_pointer:
  * @buffer: A #UcaRingBuffer object
  *
- * Get pointer to current write location.
+ * Get pointer to current write location. Must only be called by the producer.
+ *
+ * Since 2.5, calling this claims the block: from now on until the next
+ * uca_ring_buffer_write_advance() the consumer treats it as overwritten, so
+ * uca_ring_buffer_get_num_blocks() may shrink by one and the block is
+ * skipped by uca_ring_buffer_get_read_pointer() even if no data is written
+ * to it. Previously, this had no effect on the consumer.
  *
  * Return value: (transfer none): Pointer to current write location
  */
@@ -113,21 +396,43 @@ gpointer
 uca_ring_buffer_get_write_pointer (UcaRingBuffer *buffer)
 {
     UcaRingBufferPrivate *priv;
-    gpointer data;
 
     g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), NULL);
-
     priv = buffer->priv;
-    data = priv->data + (priv->write_index % priv->n_blocks_total) * priv->block_size;
-
-    return data;
+    STORE_RELEASE (&priv->claim_index, priv->write_index + 1);
+    return slot_pointer (priv, priv->write_slot);
 }
 
+/**
+ * uca_ring_buffer_write_advance:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Publish the block at the current write location to the consumer. Must only
+ * be called by the producer.
+ */
 void
 uca_ring_buffer_write_advance (UcaRingBuffer *buffer)
 {
+    UcaRingBufferPrivate *priv;
+    guint fill;
+
     g_return_if_fail (UCA_IS_RING_BUFFER (buffer));
-    buffer->priv->write_index++;
+    priv = buffer->priv;
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    /* Start writeback of the finished block without waiting for it */
+    if (priv->fd >= 0)
+        sync_file_range (priv->fd, (off_t) priv->write_slot * priv->block_size,
+                         priv->block_size, SYNC_FILE_RANGE_WRITE);
+#endif
+
+    priv->write_slot = next_slot (priv, priv->write_slot);
+    STORE_RELEASE (&priv->write_index, priv->write_index + 1);
+
+    fill = priv->write_index - LOAD_ACQUIRE (&priv->read_index);
+
+    if (fill > priv->high_water)
+        priv->high_water = MIN (fill, priv->n_blocks_total);
 }
 
 /**
@@ -141,10 +446,8 @@ uca_ring_buffer_write_advance (UcaRingBuffer *buffer)
 gpointer
 uca_ring_buffer_peek_pointer (UcaRingBuffer *buffer)
 {
-    UcaRingBufferPrivate *priv;
     g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), NULL);
-    priv = buffer->priv;
-    return ((guint8 *) priv->data) + ((priv->write_index % priv->n_blocks_total) * priv->block_size);
+    return slot_pointer (buffer->priv, buffer->priv->write_slot);
 }
 
 /**
@@ -152,7 +455,10 @@ uca_ring_buffer_peek_pointer (UcaRingBuffer *buffer)
  * @buffer: A #UcaRingBuffer object
  * @index: Block index of queried pointer
  *
- * Get pointer to read location identified by @index.
+ * Get pointer to read location identified by @index without consuming it.
+ * Blocks are counted from the oldest intact unread block, so all indices
+ * below uca_ring_buffer_get_num_blocks() refer to valid data. Must only be
+ * called by the consumer.
  *
  * Return value: (transfer none): Pointer to indexed read location
  */
@@ -161,28 +467,297 @@ uca_ring_buffer_get_pointer (UcaRingBuffer *buffer,
                              guint          index)
 {
     UcaRingBufferPrivate *priv;
+    guint64 slot;
+
     g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), NULL);
     priv = buffer->priv;
-    return ((guint8 *) priv->data) + (((priv->read_index + index) % priv->n_blocks_total) * priv->block_size);
+
+    slot = (guint64) priv->read_slot + (first_intact (priv, LOAD_ACQUIRE (&priv->write_index)) - priv->read_index) + index;
+    return slot_pointer (priv, (guint) (slot % priv->n_blocks_total));
 }
 
+/**
+ * uca_ring_buffer_get_num_blocks:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Get the number of intact unread blocks. This many calls to
+ * uca_ring_buffer_get_read_pointer() return data unless the producer
+ * overwrites some of them in the meantime. Must only be called by the
+ * consumer.
+ *
+ * Since 2.5, the number shrinks as blocks are read and as the producer claims
+ * blocks with uca_ring_buffer_get_write_pointer(). Previously, it was the
+ * number of written blocks up to the capacity regardless of reads. Call
+ * uca_ring_buffer_rewind() first to count blocks that were already read.
+ *
+ * Return value: Number of readable blocks.
+ */
 guint
 uca_ring_buffer_get_num_blocks (UcaRingBuffer *buffer)
 {
     UcaRingBufferPrivate *priv;
+    guint written;
 
     g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), 0);
     priv = buffer->priv;
-    return priv->write_index < priv->n_blocks_total ? priv->write_index : priv->n_blocks_total;
+    written = LOAD_ACQUIRE (&priv->write_index);
+    return written - first_intact (priv, written);
 }
 
+/**
+ * uca_ring_buffer_get_num_dropped:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Get the number of blocks that were overwritten before they could be read.
+ * Must only be called by the consumer.
+ *
+ * Return value: Number of dropped blocks since construction or the last reset.
+ * Since: 2.5
+ */
+guint
+uca_ring_buffer_get_num_dropped (UcaRingBuffer *buffer)
+{
+    g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), 0);
+    return buffer->priv->n_dropped;
+}
+
+/**
+ * uca_ring_buffer_get_high_water_mark:
+ * @buffer: A #UcaRingBuffer object
+ *
+ * Get the maximum number of unread blocks observed by the producer. Must only
+ * be called by the producer.
+ *
+ * Return value: Maximum fill level since construction or the last reset.
+ * Since: 2.5
+ */
+guint
+uca_ring_buffer_get_high_water_mark (UcaRingBuffer *buffer)
+{
+    g_return_val_if_fail (UCA_IS_RING_BUFFER (buffer), 0);
+    return buffer->priv->high_water;
+}
+
+#ifdef __linux__
+typedef struct {
+    volatile guchar *start;
+    gsize size;
+    gsize page_size;
+} PrefaultRange;
+
+static gpointer
+prefault_range (PrefaultRange *range)
+{
+    for (gsize offset = 0; offset < range->size; offset += range->page_size)
+        range->start[offset] = 0;
+
+    return NULL;
+}
+
+/*
+ * Touch every page so that page faults happen now and not during the
+ * acquisition. The work is split across all cores because a single thread
+ * cannot saturate the kernel's page zeroing for multi-GB buffers.
+ */
 static void
-realloc_mem (UcaRingBufferPrivate *priv)
+prefault_mem (guchar *data, gsize size, gsize page_size)
+{
+    PrefaultRange *ranges;
+    GThread **threads;
+    guint n_threads;
+    gsize n_pages;
+    gsize pages_per_thread;
+
+    n_pages = (size + page_size - 1) / page_size;
+    n_threads = MIN (g_get_num_processors (), MAX (n_pages / 1024, 1));
+    pages_per_thread = (n_pages + n_threads - 1) / n_threads;
+    ranges = g_new0 (PrefaultRange, n_threads);
+    threads = g_new0 (GThread *, n_threads);
+
+    for (guint i = 0; i < n_threads; i++) {
+        gsize first = i * pages_per_thread * page_size;
+
+        ranges[i].start = data + first;
+        ranges[i].size = first < size ? MIN (pages_per_thread * page_size, size - first) : 0;
+        ranges[i].page_size = page_size;
+
+        if (i > 0)
+            threads[i] = g_thread_new ("prefault", (GThreadFunc) prefault_range, &ranges[i]);
+    }
+
+    prefault_range (&ranges[0]);
+
+    for (guint i = 1; i < n_threads; i++)
+        g_thread_join (threads[i]);
+
+    g_free (threads);
+    g_free (ranges);
+}
+
+static gboolean
+bind_mem (guchar *data, gsize size, gint node)
+{
+    gulong mask[16] = { 0, };
+    const guint bits_per_long = sizeof (gulong) * 8;
+
+    if (node >= (gint) (G_N_ELEMENTS (mask) * bits_per_long))
+        return FALSE;
+
+    mask[node / bits_per_long] = 1UL << (node % bits_per_long);
+    return syscall (SYS_mbind, data, size, MPOL_BIND, mask, G_N_ELEMENTS (mask) * bits_per_long + 1, 0) == 0;
+}
+
+static guchar *
+map_mem (UcaRingBufferPrivate *priv, gsize size)
 {
+    gpointer data = MAP_FAILED;
+    gsize page_size;
+
+    page_size = (gsize) sysconf (_SC_PAGESIZE);
+    priv->mapped_size = (size + page_size - 1) / page_size * page_size;
+
+#ifdef MAP_HUGETLB
+    if (priv->alloc_flags & UCA_RING_BUFFER_ALLOC_HUGETLB) {
+        gsize huge_size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+        data = mmap (NULL, huge_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (data != MAP_FAILED) {
+            priv->mapped_size = huge_size;
+            page_size = HUGE_PAGE_SIZE;
+        }
+        else
+            g_warning ("Could not map %" G_GSIZE_FORMAT " bytes of huge pages, falling back to regular pages", huge_size);
+    }
+#endif
+
+    if (data == MAP_FAILED) {
+        data = mmap (NULL, priv->mapped_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (data == MAP_FAILED)
+            g_error ("Could not map %" G_GSIZE_FORMAT " bytes: %s", priv->mapped_size, g_strerror (errno));
+
+#ifdef MADV_HUGEPAGE
+        if (priv->alloc_flags & UCA_RING_BUFFER_ALLOC_HUGE_PAGES)
+            madvise (data, priv->mapped_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    /* Binding must happen before the first touch decides page placement */
+    if (priv->numa_node >= 0 && !bind_mem (data, priv->mapped_size, priv->numa_node))
+        g_warning ("Could not bind ring buffer to NUMA node %i", priv->numa_node);
+
+    if (priv->alloc_flags & UCA_RING_BUFFER_ALLOC_PREFAULT)
+        prefault_mem (data, priv->mapped_size, page_size);
+
+    if ((priv->alloc_flags & UCA_RING_BUFFER_ALLOC_LOCKED) && mlock (data, priv->mapped_size) != 0)
+        g_warning ("Could not lock %" G_GSIZE_FORMAT " bytes: %s", priv->mapped_size, g_strerror (errno));
+
+    return data;
+}
+
+static guchar *
+map_file (UcaRingBufferPrivate *priv, gsize size)
+{
+    gpointer data;
+    gint flags = MAP_SHARED;
+
+    priv->fd = open (priv->filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (priv->fd < 0) {
+        g_set_error (&priv->map_error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not open `%s': %s", priv->filename, g_strerror (errno));
+        return NULL;
+    }
+
+    if (ftruncate (priv->fd, (off_t) size) != 0) {
+        g_set_error (&priv->map_error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not resize `%s' to %" G_GSIZE_FORMAT " bytes: %s",
+                     priv->filename, size, g_strerror (errno));
+        return NULL;
+    }
+
+#ifdef MAP_POPULATE
+    if (priv->alloc_flags & UCA_RING_BUFFER_ALLOC_PREFAULT)
+        flags |= MAP_POPULATE;
+#endif
+
+    data = mmap (NULL, size, PROT_READ | PROT_WRITE, flags, priv->fd, 0);
+
+    if (data == MAP_FAILED) {
+        g_set_error (&priv->map_error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not map `%s': %s", priv->filename, g_strerror (errno));
+        return NULL;
+    }
+
+    priv->mapped_size = size;
+    madvise (data, size, MADV_SEQUENTIAL);
+
+    return data;
+}
+#endif
+
+static void
+free_mem (UcaRingBufferPrivate *priv)
+{
+#ifdef __linux__
     if (priv->data != NULL)
-        g_free (priv->data);
+        munmap (priv->data, priv->mapped_size);
+
+    if (priv->fd >= 0) {
+        close (priv->fd);
+        priv->fd = -1;
+    }
+#else
+    g_free (priv->data);
+#endif
+    priv->data = NULL;
+    priv->mapped_size = 0;
+}
 
-    priv->data = g_malloc0_n (priv->n_blocks_total, priv->block_size);
+/*
+ * Anonymous mappings are zero-filled by the kernel on first touch, so unless
+ * prefaulting is requested the allocation itself is cheap regardless of the
+ * buffer size.
+ */
+static void
+realloc_mem (UcaRingBufferPrivate *priv)
+{
+    gsize size;
+
+    free_mem (priv);
+    g_clear_error (&priv->map_error);
+
+    if (priv->block_size > 0 && priv->n_blocks_total > G_MAXSIZE / priv->block_size)
+        g_error ("Ring buffer of %u blocks of %" G_GSIZE_FORMAT " bytes overflows", priv->n_blocks_total, priv->block_size);
+
+    size = priv->n_blocks_total * priv->block_size;
+
+    if (size == 0)
+        return;
+
+#ifdef __linux__
+    if (priv->filename != NULL)
+        priv->data = map_file (priv, size);
+    else
+        priv->data = map_mem (priv, size);
+#else
+    if (priv->filename != NULL)
+        g_set_error (&priv->map_error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+                     "File-backed ring buffers are not supported on this platform");
+    else
+        priv->data = g_malloc0 (size);
+#endif
+
+    /* During construction the error is reported by uca_ring_buffer_new_mapped */
+    if (priv->map_error != NULL) {
+        if (priv->constructed)
+            g_warning ("%s", priv->map_error->message);
+
+        free_mem (priv);
+    }
 }
 
 static void
@@ -205,6 +780,18 @@ uca_ring_buffer_get_property (GObject *object,
             g_value_set_uint (value, priv->n_blocks_total);
             break;
 
+        case PROP_ALLOC_FLAGS:
+            g_value_set_flags (value, priv->alloc_flags);
+            break;
+
+        case PROP_NUMA_NODE:
+            g_value_set_int (value, priv->numa_node);
+            break;
+
+        case PROP_FILENAME:
+            g_value_set_string (value, priv->filename);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
             break;
@@ -225,12 +812,29 @@ uca_ring_buffer_set_property (GObject *object,
     switch (property_id) {
         case PROP_BLOCK_SIZE:
             priv->block_size = (gsize) g_value_get_uint64 (value);
-            realloc_mem (priv);
+
+            if (priv->constructed)
+                realloc_mem (priv);
             break;
 
         case PROP_NUM_BLOCKS:
             priv->n_blocks_total = g_value_get_uint (value);
-            realloc_mem (priv);
+
+            if (priv->constructed)
+                realloc_mem (priv);
+            break;
+
+        case PROP_ALLOC_FLAGS:
+            priv->alloc_flags = g_value_get_flags (value);
+            break;
+
+        case PROP_NUMA_NODE:
+            priv->numa_node = g_value_get_int (value);
+            break;
+
+        case PROP_FILENAME:
+            g_free (priv->filename);
+            priv->filename = g_value_dup_string (value);
             break;
 
         default:
@@ -239,6 +843,18 @@ uca_ring_buffer_set_property (GObject *object,
     }
 }
 
+static void
+uca_ring_buffer_constructed (GObject *object)
+{
+    UcaRingBufferPrivate *priv;
+
+    priv = UCA_RING_BUFFER_GET_PRIVATE (object);
+    realloc_mem (priv);
+    priv->constructed = TRUE;
+
+    G_OBJECT_CLASS (uca_ring_buffer_parent_class)->constructed (object);
+}
+
 static void
 uca_ring_buffer_dispose (GObject *object)
 {
@@ -251,8 +867,9 @@ uca_ring_buffer_finalize (GObject *object)
     UcaRingBufferPrivate *priv;
 
     priv = UCA_RING_BUFFER_GET_PRIVATE (object);
-    g_free (priv->data);
-    priv->data = NULL;
+    free_mem (priv);
+    g_free (priv->filename);
+    g_clear_error (&priv->map_error);
     G_OBJECT_CLASS (uca_ring_buffer_parent_class)->finalize (object);
 }
 
@@ -265,6 +882,7 @@ uca_ring_buffer_class_init (UcaRingBufferClass *klass)
 
     oclass->get_property = uca_ring_buffer_get_property;
     oclass->set_property = uca_ring_buffer_set_property;
+    oclass->constructed = uca_ring_buffer_constructed;
     oclass->dispose = uca_ring_buffer_dispose;
     oclass->finalize = uca_ring_buffer_finalize;
 
@@ -282,6 +900,27 @@ uca_ring_buffer_class_init (UcaRingBufferClass *klass)
                            0, G_MAXUINT, 0,
                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
 
+    properties[PROP_ALLOC_FLAGS] =
+        g_param_spec_flags ("alloc-flags",
+                            "Allocation flags",
+                            "How the block storage is allocated",
+                            UCA_TYPE_RING_BUFFER_ALLOC_FLAGS, UCA_RING_BUFFER_ALLOC_DEFAULT,
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    properties[PROP_NUMA_NODE] =
+        g_param_spec_int ("numa-node",
+                          "NUMA node",
+                          "NUMA node the block storage is bound to, -1 for no binding",
+                          -1, G_MAXINT, -1,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    properties[PROP_FILENAME] =
+        g_param_spec_string ("filename",
+                             "Backing file",
+                             "File mapped as block storage or NULL for memory",
+                             NULL,
+                             G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
     for (guint i = PROP_0 + 1; i < N_PROPERTIES; i++)
         g_object_class_install_property (oclass, i, properties[i]);
 
@@ -297,4 +936,18 @@ uca_ring_buffer_init (UcaRingBuffer *buffer)
     priv->n_blocks_total = 0;
     priv->block_size = 0;
     priv->data = NULL;
+    priv->mapped_size = 0;
+    priv->filename = NULL;
+    priv->fd = -1;
+    priv->map_error = NULL;
+    priv->constructed = FALSE;
+    priv->alloc_flags = UCA_RING_BUFFER_ALLOC_DEFAULT;
+    priv->numa_node = -1;
+    priv->write_index = 0;
+    priv->write_slot = 0;
+    priv->claim_index = 0;
+    priv->read_index = 0;
+    priv->read_slot = 0;
+    priv->high_water = 0;
+    priv->n_dropped = 0;
 }
@@ -17,6 +17,28 @@ typedef struct _UcaRingBuffer           UcaRingBuffer;
 typedef struct _UcaRingBufferClass      UcaRingBufferClass;
 typedef struct _UcaRingBufferPrivate    UcaRingBufferPrivate;
 
+/**
+ * UcaRingBufferAllocFlags:
+ * @UCA_RING_BUFFER_ALLOC_DEFAULT: Lazily allocate regular pages on first use
+ * @UCA_RING_BUFFER_ALLOC_HUGE_PAGES: Advise the kernel to back the storage
+ *  with transparent huge pages
+ * @UCA_RING_BUFFER_ALLOC_HUGETLB: Allocate explicit huge pages from the
+ *  hugetlbfs pool, falling back to regular pages if none are available
+ * @UCA_RING_BUFFER_ALLOC_LOCKED: Lock the storage in memory so that it cannot
+ *  be swapped out
+ * @UCA_RING_BUFFER_ALLOC_PREFAULT: Touch all pages at construction using one
+ *  thread per core instead of faulting them in during acquisition
+ *
+ * Since: 2.5
+ */
+typedef enum {
+    UCA_RING_BUFFER_ALLOC_DEFAULT       = 0,
+    UCA_RING_BUFFER_ALLOC_HUGE_PAGES    = 1 << 0,
+    UCA_RING_BUFFER_ALLOC_HUGETLB       = 1 << 1,
+    UCA_RING_BUFFER_ALLOC_LOCKED        = 1 << 2,
+    UCA_RING_BUFFER_ALLOC_PREFAULT      = 1 << 3,
+} UcaRingBufferAllocFlags;
+
 struct _UcaRingBuffer {
     /*< private >*/
     GObject parent;
@@ -31,10 +53,21 @@ struct _UcaRingBufferClass {
 
 UCA_API UcaRingBuffer * uca_ring_buffer_new                 (gsize          block_size,
                                                              guint          n_blocks);
+UCA_API UcaRingBuffer * uca_ring_buffer_new_full            (gsize          block_size,
+                                                             guint          n_blocks,
+                                                             UcaRingBufferAllocFlags flags,
+                                                             gint           numa_node);
+UCA_API UcaRingBuffer * uca_ring_buffer_new_mapped          (const gchar   *filename,
+                                                             gsize          block_size,
+                                                             guint          n_blocks,
+                                                             UcaRingBufferAllocFlags flags,
+                                                             GError       **error);
 UCA_API void            uca_ring_buffer_reset               (UcaRingBuffer *buffer);
+UCA_API void            uca_ring_buffer_rewind              (UcaRingBuffer *buffer);
 UCA_API gsize           uca_ring_buffer_get_block_size      (UcaRingBuffer *buffer);
 UCA_API guint           uca_ring_buffer_get_num_blocks      (UcaRingBuffer *buffer);
 UCA_API gboolean        uca_ring_buffer_available           (UcaRingBuffer *buffer);
+UCA_API gboolean        uca_ring_buffer_full                (UcaRingBuffer *buffer);
 UCA_API void            uca_ring_buffer_proceed             (UcaRingBuffer *buffer);
 UCA_API gpointer        uca_ring_buffer_get_read_pointer    (UcaRingBuffer *buffer);
 UCA_API gpointer        uca_ring_buffer_get_write_pointer   (UcaRingBuffer *buffer);
@@ -42,6 +75,8 @@ UCA_API void            uca_ring_buffer_write_advance       (UcaRingBuffer *buff
 UCA_API gpointer        uca_ring_buffer_get_pointer         (UcaRingBuffer *buffer,
                                                              guint          index);
 UCA_API gpointer        uca_ring_buffer_peek_pointer        (UcaRingBuffer *buffer);
+UCA_API guint           uca_ring_buffer_get_num_dropped     (UcaRingBuffer *buffer);
+UCA_API guint           uca_ring_buffer_get_high_water_mark (UcaRingBuffer *buffer);
 
 UCA_API GType           uca_ring_buffer_get_type (void);
 
@@ -0,0 +1,434 @@
+/* Copyright (C) 2011-2013 Matthias Vogelgesang <matthias.vogelgesang@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA */
+
+#include <math.h>
+#include <string.h>
+#include "uca-statistics.h"
+
+/*
+ * Histogram, extrema and sums are accumulated in a single pass over the frame.
+ * Each iteration handles four consecutive pixels in separate lanes with their
+ * own accumulators and, for small histograms, their own sub-histogram so that
+ * runs of equal values do not serialize on a single counter. Bins are found by
+ * a shift instead of a division. Large frames are split into chunks of pixels
+ * or, for regions of a frame, of rows that are processed by the workers of a
+ * shared thread pool and merged afterwards.
+ */
+
+#define N_LANES             4
+
+/* Larger histograms are not replicated per lane to keep them in cache */
+#define MAX_LANE_BINS       4096
+
+/* Smallest number of pixels worth handing to a separate thread */
+#define MIN_CHUNK_PIXELS    (1 << 18)
+
+/* Chunks handed to the pool report to the call that is waiting for them */
+typedef struct {
+    GMutex  lock;
+    GCond   cond;
+    guint   n_pending;
+} Job;
+
+typedef struct {
+    Job            *job;
+    const guint8   *data;
+    gsize           width;
+    gsize           n_rows;
+    gsize           stride;
+    guint           pixel_size;
+    guint32        *histogram;
+    guint           n_bins;
+    guint           shift;
+    UcaStatistics   stats;
+} Chunk;
+
+static inline guint
+load (const guint8 *data, gsize index, guint pixel_size)
+{
+    return pixel_size == 1 ? data[index] : ((const guint16 *) data)[index];
+}
+
+typedef struct {
+    guint   min;
+    guint   max;
+    guint64 sum;
+    guint64 sum_squared;
+} Lane;
+
+static inline void
+lane_init (Lane *lane)
+{
+    lane->min = G_MAXUINT;
+    lane->max = 0;
+    lane->sum = 0;
+    lane->sum_squared = 0;
+}
+
+static inline void
+lane_add (Lane *lane, guint32 *bins, guint v, guint shift, guint last)
+{
+    lane->min = MIN (lane->min, v);
+    lane->max = MAX (lane->max, v);
+    lane->sum += v;
+    lane->sum_squared += v * v;
+
+    if (bins != NULL)
+        bins[MIN (v >> shift, last)]++;
+}
+
+static inline void
+lane_merge (UcaStatistics *stats, const Lane *lane)
+{
+    stats->min = MIN (stats->min, lane->min);
+    stats->max = MAX (stats->max, lane->max);
+    stats->sum += lane->sum;
+    stats->sum_squared += lane->sum_squared;
+}
+
+static inline void
+accumulate (Chunk *chunk, guint32 *bins, guint lane_stride, guint pixel_size)
+{
+    const guint8 *data = chunk->data;
+    const guint shift = chunk->shift;
+    const guint last = chunk->n_bins - 1;
+    guint32 *bins1 = bins != NULL ? bins + lane_stride : NULL;
+    guint32 *bins2 = bins != NULL ? bins + 2 * lane_stride : NULL;
+    guint32 *bins3 = bins != NULL ? bins + 3 * lane_stride : NULL;
+    Lane lane0, lane1, lane2, lane3;
+
+    /* Separate variables instead of an array keep the lanes in registers */
+    lane_init (&lane0);
+    lane_init (&lane1);
+    lane_init (&lane2);
+    lane_init (&lane3);
+
+    for (gsize r = 0; r < chunk->n_rows; r++) {
+        const guint8 *row = data + r * chunk->stride * pixel_size;
+        gsize i = 0;
+
+        for (; i + N_LANES <= chunk->width; i += N_LANES) {
+            lane_add (&lane0, bins, load (row, i, pixel_size), shift, last);
+            lane_add (&lane1, bins1, load (row, i + 1, pixel_size), shift, last);
+            lane_add (&lane2, bins2, load (row, i + 2, pixel_size), shift, last);
+            lane_add (&lane3, bins3, load (row, i + 3, pixel_size), shift, last);
+        }
+
+        for (; i < chunk->width; i++)
+            lane_add (&lane0, bins, load (row, i, pixel_size), shift, last);
+    }
+
+    chunk->stats.min = G_MAXUINT;
+    chunk->stats.max = 0;
+    chunk->stats.sum = 0;
+    chunk->stats.sum_squared = 0;
+    chunk->stats.n_pixels = chunk->width * chunk->n_rows;
+
+    lane_merge (&chunk->stats, &lane0);
+    lane_merge (&chunk->stats, &lane1);
+    lane_merge (&chunk->stats, &lane2);
+    lane_merge (&chunk->stats, &lane3);
+}
+
+static void
+compute_chunk (Chunk *chunk)
+{
+    guint32 *lanes = chunk->histogram;
+    guint n_lanes = 1;
+
+    if (lanes != NULL && chunk->n_bins <= MAX_LANE_BINS) {
+        n_lanes = N_LANES;
+        lanes = g_new0 (guint32, n_lanes * chunk->n_bins);
+    }
+
+    /* Constant pixel sizes let the compiler specialize both loops */
+    if (chunk->pixel_size == 1)
+        accumulate (chunk, lanes, n_lanes > 1 ? chunk->n_bins : 0, 1);
+    else
+        accumulate (chunk, lanes, n_lanes > 1 ? chunk->n_bins : 0, 2);
+
+    if (n_lanes > 1) {
+        for (guint l = 0; l < n_lanes; l++) {
+            const guint32 *lane = lanes + l * chunk->n_bins;
+
+            for (guint b = 0; b < chunk->n_bins; b++)
+                chunk->histogram[b] += lane[b];
+        }
+
+        g_free (lanes);
+    }
+}
+
+static void
+compute_chunk_func (Chunk *chunk, gpointer user_data)
+{
+    Job *job = chunk->job;
+
+    compute_chunk (chunk);
+
+    g_mutex_lock (&job->lock);
+
+    if (--job->n_pending == 0)
+        g_cond_signal (&job->cond);
+
+    g_mutex_unlock (&job->lock);
+}
+
+static gpointer
+create_pool (gpointer data)
+{
+    /* Exclusive threads stay alive, so that per-frame calls do not spawn any */
+    return g_thread_pool_new ((GFunc) compute_chunk_func, NULL,
+                              (gint) g_get_num_processors (), TRUE, NULL);
+}
+
+static GThreadPool *
+get_pool (void)
+{
+    static GOnce once = G_ONCE_INIT;
+
+    return g_once (&once, create_pool, NULL);
+}
+
+/**
+ * uca_statistics_get_shift:
+ * @max_value: Largest pixel value that should get its own bin
+ * @n_bins: Number of histogram bins
+ *
+ * Returns: The smallest right shift that maps all values up to @max_value to
+ * one of @n_bins bins, suitable for uca_statistics_compute().
+ * Since: 2.5
+ */
+guint
+uca_statistics_get_shift (guint max_value, guint n_bins)
+{
+    guint shift = 0;
+
+    while (shift < 32 && (max_value >> shift) >= n_bins)
+        shift++;
+
+    return shift;
+}
+
+/**
+ * uca_statistics_compute:
+ * @stats: Location for the statistics of @data
+ * @histogram: (allow-none): Array of @n_bins counts or %NULL
+ * @n_bins: Number of bins in @histogram
+ * @shift: Right shift mapping a pixel value to its bin
+ * @data: Pixels of a frame
+ * @n_pixels: Number of pixels in @data
+ * @pixel_size: Bytes per pixel, either 1 or 2
+ * @n_threads: Maximum number of threads to use
+ *
+ * Compute minimum, maximum, sum and sum of squares of @data and, unless
+ * @histogram is %NULL, its histogram in a single pass. Pixel value v is
+ * counted in bin v >> @shift, values beyond the last bin are counted in the
+ * last bin. uca_statistics_get_shift() computes a shift that spreads a value
+ * range over all bins. Frames large enough are split among up to @n_threads
+ * threads, which are taken from a thread pool that is shared by all calls and
+ * created on first use.
+ *
+ * Since: 2.5
+ */
+void
+uca_statistics_compute (UcaStatistics *stats,
+                        guint32 *histogram,
+                        guint n_bins,
+                        guint shift,
+                        gconstpointer data,
+                        gsize n_pixels,
+                        guint pixel_size,
+                        guint n_threads)
+{
+    uca_statistics_compute_region (stats, histogram, n_bins, shift, data,
+                                   n_pixels, 1, n_pixels, pixel_size, n_threads);
+}
+
+/**
+ * uca_statistics_compute_region:
+ * @stats: Location for the statistics of the region
+ * @histogram: (allow-none): Array of @n_bins counts or %NULL
+ * @n_bins: Number of bins in @histogram
+ * @shift: Right shift mapping a pixel value to its bin
+ * @data: First pixel of the region
+ * @width: Width of the region in pixels
+ * @height: Height of the region in pixels
+ * @stride: Distance between the starts of two rows in pixels, usually the
+ *  width of the whole frame
+ * @pixel_size: Bytes per pixel, either 1 or 2
+ * @n_threads: Maximum number of threads to use
+ *
+ * Like uca_statistics_compute() but restricted to a rectangular region of a
+ * frame, so that only the pixels within the region are read.
+ *
+ * Since: 2.5
+ */
+void
+uca_statistics_compute_region (UcaStatistics *stats,
+                               guint32 *histogram,
+                               guint n_bins,
+                               guint shift,
+                               gconstpointer data,
+                               gsize width,
+                               gsize height,
+                               gsize stride,
+                               guint pixel_size,
+                               guint n_threads)
+{
+    Chunk *chunks;
+    Job job;
+    gsize n_units;
+    gsize chunk_size;
+    guint n_chunks;
+
+    g_return_if_fail (stats != NULL);
+    g_return_if_fail (histogram == NULL || n_bins > 0);
+    g_return_if_fail (pixel_size == 1 || pixel_size == 2);
+    g_return_if_fail (stride >= width);
+    g_return_if_fail (data != NULL || width == 0 || height == 0);
+
+    if (histogram != NULL)
+        memset (histogram, 0, n_bins * sizeof (guint32));
+
+    /* Consecutive rows are a single long row that can be split anywhere */
+    if (stride == width) {
+        width *= height;
+        stride = width;
+        height = 1;
+    }
+
+    /* Single rows are split into runs of pixels, regions into runs of rows */
+    n_units = height == 1 ? width : height;
+    n_chunks = (guint) CLAMP (width * height / MIN_CHUNK_PIXELS, 1, MIN (MAX (n_threads, 1), MAX (n_units, 1)));
+    chunk_size = n_units / n_chunks;
+    chunks = g_new0 (Chunk, n_chunks);
+
+    for (guint c = 0; c < n_chunks; c++) {
+        Chunk *chunk = &chunks[c];
+        gsize n = c == n_chunks - 1 ? n_units - c * chunk_size : chunk_size;
+
+        if (height == 1) {
+            chunk->data = (const guint8 *) data + c * chunk_size * pixel_size;
+            chunk->width = n;
+            chunk->n_rows = 1;
+        }
+        else {
+            chunk->data = (const guint8 *) data + c * chunk_size * stride * pixel_size;
+            chunk->width = width;
+            chunk->n_rows = n;
+        }
+
+        chunk->job = &job;
+        chunk->stride = stride;
+        chunk->pixel_size = pixel_size;
+        chunk->n_bins = n_bins;
+        chunk->shift = shift;
+        chunk->histogram = c == 0 || histogram == NULL ? histogram : g_new0 (guint32, n_bins);
+    }
+
+    if (n_chunks > 1) {
+        GThreadPool *pool = get_pool ();
+
+        g_mutex_init (&job.lock);
+        g_cond_init (&job.cond);
+        job.n_pending = n_chunks - 1;
+
+        for (guint c = 1; c < n_chunks; c++)
+            g_thread_pool_push (pool, &chunks[c], NULL);
+    }
+
+    /* The calling thread does its share instead of waiting idly */
+    compute_chunk (&chunks[0]);
+    *stats = chunks[0].stats;
+
+    if (n_chunks > 1) {
+        g_mutex_lock (&job.lock);
+
+        while (job.n_pending > 0)
+            g_cond_wait (&job.cond, &job.lock);
+
+        g_mutex_unlock (&job.lock);
+        g_mutex_clear (&job.lock);
+        g_cond_clear (&job.cond);
+    }
+
+    for (guint c = 1; c < n_chunks; c++) {
+        Chunk *chunk = &chunks[c];
+
+        stats->min = MIN (stats->min, chunk->stats.min);
+        stats->max = MAX (stats->max, chunk->stats.max);
+        stats->sum += chunk->stats.sum;
+        stats->sum_squared += chunk->stats.sum_squared;
+        stats->n_pixels += chunk->stats.n_pixels;
+
+        if (histogram != NULL) {
+            for (guint b = 0; b < n_bins; b++)
+                histogram[b] += chunk->histogram[b];
+
+            g_free (chunk->histogram);
+        }
+    }
+
+    if (stats->n_pixels == 0)
+        stats->min = 0;
+
+    g_free (chunks);
+}
+
+/**
+ * uca_statistics_get_mean:
+ * @stats: Statistics computed by uca_statistics_compute()
+ *
+ * Returns: The mean pixel value or 0 if there are no pixels.
+ * Since: 2.5
+ */
+gdouble
+uca_statistics_get_mean (const UcaStatistics *stats)
+{
+    g_return_val_if_fail (stats != NULL, 0.0);
+
+    if (stats->n_pixels == 0)
+        return 0.0;
+
+    return (gdouble) stats->sum / stats->n_pixels;
+}
+
+/**
+ * uca_statistics_get_sigma:
+ * @stats: Statistics computed by uca_statistics_compute()
+ *
+ * Returns: The sample standard deviation of the pixel values or 0 if there
+ * are less than two pixels.
+ * Since: 2.5
+ */
+gdouble
+uca_statistics_get_sigma (const UcaStatistics *stats)
+{
+    gdouble sum;
+    gdouble variance;
+
+    g_return_val_if_fail (stats != NULL, 0.0);
+
+    if (stats->n_pixels < 2)
+        return 0.0;
+
+    sum = (gdouble) stats->sum;
+    variance = ((gdouble) stats->sum_squared - sum * sum / stats->n_pixels) / (stats->n_pixels - 1);
+
+    return sqrt (MAX (variance, 0.0));
+}
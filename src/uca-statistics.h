@@ -0,0 +1,74 @@
+/* Copyright (C) 2011-2013 Matthias Vogelgesang <matthias.vogelgesang@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA */
+
+#ifndef UCA_STATISTICS_H
+#define UCA_STATISTICS_H
+
+#include <glib.h>
+#include "uca-api.h"
+
+G_BEGIN_DECLS
+
+typedef struct _UcaStatistics UcaStatistics;
+
+/**
+ * UcaStatistics:
+ * @min: Smallest pixel value
+ * @max: Largest pixel value
+ * @sum: Sum of all pixel values
+ * @sum_squared: Sum of all squared pixel values
+ * @n_pixels: Number of pixels
+ *
+ * Pixel statistics of a frame as computed by uca_statistics_compute().
+ *
+ * Since: 2.5
+ */
+struct _UcaStatistics {
+    guint   min;
+    guint   max;
+    guint64 sum;
+    guint64 sum_squared;
+    guint64 n_pixels;
+};
+
+UCA_API guint       uca_statistics_get_shift    (guint                 max_value,
+                                                 guint                 n_bins);
+UCA_API void        uca_statistics_compute      (UcaStatistics        *stats,
+                                                 guint32              *histogram,
+                                                 guint                 n_bins,
+                                                 guint                 shift,
+                                                 gconstpointer         data,
+                                                 gsize                 n_pixels,
+                                                 guint                 pixel_size,
+                                                 guint                 n_threads);
+UCA_API void        uca_statistics_compute_region
+                                                (UcaStatistics        *stats,
+                                                 guint32              *histogram,
+                                                 guint                 n_bins,
+                                                 guint                 shift,
+                                                 gconstpointer         data,
+                                                 gsize                 width,
+                                                 gsize                 height,
+                                                 gsize                 stride,
+                                                 guint                 pixel_size,
+                                                 guint                 n_threads);
+UCA_API gdouble     uca_statistics_get_mean     (const UcaStatistics  *stats);
+UCA_API gdouble     uca_statistics_get_sigma    (const UcaStatistics  *stats);
+
+G_END_DECLS
+
+#endif
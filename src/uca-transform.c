@@ -0,0 +1,428 @@
+/* Copyright (C) 2011-2013 Matthias Vogelgesang <matthias.vogelgesang@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA */
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "uca-transform.h"
+
+/*
+ * Every combination of mirror and rotation is either a flip of rows and/or
+ * columns or a transposition followed by such a flip. Flips work row by row
+ * and are limited by memory bandwidth like memcpy. Transpositions walk the
+ * frame in square tiles that fit into L1 for source and destination, each
+ * tile being transposed in 8x8 blocks held in SSE2 registers.
+ */
+
+/* Edge length in pixels of the square tiles that are transposed at once */
+#define TILE_SIZE   64
+
+/* Bytes exchanged per step when flipping in place */
+#define CHUNK_SIZE  512
+
+#ifdef __SSE2__
+static inline __m128i
+reverse_epi16 (__m128i v)
+{
+    v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (0, 1, 2, 3));
+    v = _mm_shufflehi_epi16 (v, _MM_SHUFFLE (0, 1, 2, 3));
+    return _mm_shuffle_epi32 (v, _MM_SHUFFLE (1, 0, 3, 2));
+}
+
+static inline __m128i
+reverse_epi8 (__m128i v)
+{
+    v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+    return reverse_epi16 (v);
+}
+#endif
+
+/* Copy n pixels from src to non-overlapping dst in reverse order */
+static void
+reverse_copy (guint8 *dst, const guint8 *src, gsize n, guint pixel_size)
+{
+    gsize i = 0;
+
+    if (pixel_size == 1) {
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (src + n - i - 16));
+            _mm_storeu_si128 ((__m128i *) (dst + i), reverse_epi8 (v));
+        }
+#endif
+        for (; i < n; i++)
+            dst[i] = src[n - 1 - i];
+    }
+    else {
+        guint16 *d = (guint16 *) dst;
+        const guint16 *s = (const guint16 *) src;
+
+#ifdef __SSE2__
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (s + n - i - 8));
+            _mm_storeu_si128 ((__m128i *) (d + i), reverse_epi16 (v));
+        }
+#endif
+        for (; i < n; i++)
+            d[i] = s[n - 1 - i];
+    }
+}
+
+static void
+swap_rows (guint8 *a, guint8 *b, gsize n, guint pixel_size, gboolean reverse)
+{
+    guint8 tmp[CHUNK_SIZE];
+    const gsize chunk = CHUNK_SIZE / pixel_size;
+
+    for (gsize i = 0; i < n; i += chunk) {
+        const gsize k = MIN (chunk, n - i);
+        guint8 *pa = a + i * pixel_size;
+
+        if (reverse) {
+            guint8 *pb = b + (n - i - k) * pixel_size;
+
+            reverse_copy (tmp, pa, k, pixel_size);
+            reverse_copy (pa, pb, k, pixel_size);
+            memcpy (pb, tmp, k * pixel_size);
+        }
+        else {
+            guint8 *pb = b + i * pixel_size;
+
+            memcpy (tmp, pa, k * pixel_size);
+            memcpy (pa, pb, k * pixel_size);
+            memcpy (pb, tmp, k * pixel_size);
+        }
+    }
+}
+
+static void
+reverse_row (guint8 *row, gsize n, guint pixel_size)
+{
+    guint8 tmp[CHUNK_SIZE];
+    const gsize chunk = CHUNK_SIZE / pixel_size;
+    const gsize half = n / 2;
+
+    for (gsize i = 0; i < half; i += chunk) {
+        const gsize k = MIN (chunk, half - i);
+        guint8 *lo = row + i * pixel_size;
+        guint8 *hi = row + (n - i - k) * pixel_size;
+
+        reverse_copy (tmp, lo, k, pixel_size);
+        reverse_copy (lo, hi, k, pixel_size);
+        memcpy (hi, tmp, k * pixel_size);
+    }
+}
+
+static void
+flip (guint8 *dst, const guint8 *src, guint width, guint height, guint pixel_size,
+      gboolean flip_x, gboolean flip_y)
+{
+    const gsize stride = (gsize) width * pixel_size;
+
+    if (dst != src) {
+        for (guint y = 0; y < height; y++) {
+            const guint8 *s = src + (flip_y ? height - 1 - y : y) * stride;
+
+            if (flip_x)
+                reverse_copy (dst + y * stride, s, width, pixel_size);
+            else
+                memcpy (dst + y * stride, s, stride);
+        }
+
+        return;
+    }
+
+    if (flip_y) {
+        for (guint y = 0; y < height / 2; y++)
+            swap_rows (dst + y * stride, dst + (height - 1 - y) * stride, width, pixel_size, flip_x);
+
+        if (flip_x && (height % 2) == 1)
+            reverse_row (dst + (height / 2) * stride, width, pixel_size);
+    }
+    else if (flip_x) {
+        for (guint y = 0; y < height; y++)
+            reverse_row (dst + y * stride, width, pixel_size);
+    }
+}
+
+/*
+ * Write source pixel (x, y) to row x and column y of the destination, which
+ * is height pixels wide. flip_r and flip_c reverse the destination rows and
+ * columns.
+ */
+static void
+transpose_scalar (guint8 *dst, const guint8 *src, guint width, guint height, guint pixel_size,
+                  gboolean flip_r, gboolean flip_c, guint y0, guint y1, guint x0, guint x1)
+{
+    for (guint y = y0; y < y1; y++) {
+        const gsize c = flip_c ? height - 1 - y : y;
+
+        if (pixel_size == 1) {
+            const guint8 *s = src + (gsize) y * width;
+
+            for (guint x = x0; x < x1; x++)
+                dst[(flip_r ? width - 1 - x : x) * (gsize) height + c] = s[x];
+        }
+        else {
+            const guint16 *s = ((const guint16 *) src) + (gsize) y * width;
+
+            for (guint x = x0; x < x1; x++)
+                ((guint16 *) dst)[(flip_r ? width - 1 - x : x) * (gsize) height + c] = s[x];
+        }
+    }
+}
+
+#ifdef __SSE2__
+/*
+ * The 8x8 block kernels are unrolled by hand, with loops the compiler keeps
+ * the registers in memory at -O2.
+ */
+static inline void
+transpose_block_16 (guint16 *dst, const guint16 *src, guint width, guint height,
+                    gboolean flip_r, gboolean flip_c, guint y, guint x)
+{
+    __m128i r0, r1, r2, r3, r4, r5, r6, r7;
+    __m128i a0, a1, a2, a3, a4, a5, a6, a7;
+    const guint16 *s = src + (gsize) y * width + x;
+    const gsize c = flip_c ? height - y - 8 : y;
+    const gssize step = flip_r ? -((gssize) height) : (gssize) height;
+    guint16 *d = dst + (flip_r ? width - 1 - x : x) * (gsize) height + c;
+
+    r0 = _mm_loadu_si128 ((const __m128i *) (s + 0 * (gsize) width));
+    r1 = _mm_loadu_si128 ((const __m128i *) (s + 1 * (gsize) width));
+    r2 = _mm_loadu_si128 ((const __m128i *) (s + 2 * (gsize) width));
+    r3 = _mm_loadu_si128 ((const __m128i *) (s + 3 * (gsize) width));
+    r4 = _mm_loadu_si128 ((const __m128i *) (s + 4 * (gsize) width));
+    r5 = _mm_loadu_si128 ((const __m128i *) (s + 5 * (gsize) width));
+    r6 = _mm_loadu_si128 ((const __m128i *) (s + 6 * (gsize) width));
+    r7 = _mm_loadu_si128 ((const __m128i *) (s + 7 * (gsize) width));
+
+    a0 = _mm_unpacklo_epi16 (r0, r1);
+    a1 = _mm_unpackhi_epi16 (r0, r1);
+    a2 = _mm_unpacklo_epi16 (r2, r3);
+    a3 = _mm_unpackhi_epi16 (r2, r3);
+    a4 = _mm_unpacklo_epi16 (r4, r5);
+    a5 = _mm_unpackhi_epi16 (r4, r5);
+    a6 = _mm_unpacklo_epi16 (r6, r7);
+    a7 = _mm_unpackhi_epi16 (r6, r7);
+
+    r0 = _mm_unpacklo_epi32 (a0, a2);
+    r1 = _mm_unpackhi_epi32 (a0, a2);
+    r2 = _mm_unpacklo_epi32 (a1, a3);
+    r3 = _mm_unpackhi_epi32 (a1, a3);
+    r4 = _mm_unpacklo_epi32 (a4, a6);
+    r5 = _mm_unpackhi_epi32 (a4, a6);
+    r6 = _mm_unpacklo_epi32 (a5, a7);
+    r7 = _mm_unpackhi_epi32 (a5, a7);
+
+    /* aN now holds source column x + N */
+    a0 = _mm_unpacklo_epi64 (r0, r4);
+    a1 = _mm_unpackhi_epi64 (r0, r4);
+    a2 = _mm_unpacklo_epi64 (r1, r5);
+    a3 = _mm_unpackhi_epi64 (r1, r5);
+    a4 = _mm_unpacklo_epi64 (r2, r6);
+    a5 = _mm_unpackhi_epi64 (r2, r6);
+    a6 = _mm_unpacklo_epi64 (r3, r7);
+    a7 = _mm_unpackhi_epi64 (r3, r7);
+
+    if (flip_c) {
+        a0 = reverse_epi16 (a0);
+        a1 = reverse_epi16 (a1);
+        a2 = reverse_epi16 (a2);
+        a3 = reverse_epi16 (a3);
+        a4 = reverse_epi16 (a4);
+        a5 = reverse_epi16 (a5);
+        a6 = reverse_epi16 (a6);
+        a7 = reverse_epi16 (a7);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (d + 0 * step), a0);
+    _mm_storeu_si128 ((__m128i *) (d + 1 * step), a1);
+    _mm_storeu_si128 ((__m128i *) (d + 2 * step), a2);
+    _mm_storeu_si128 ((__m128i *) (d + 3 * step), a3);
+    _mm_storeu_si128 ((__m128i *) (d + 4 * step), a4);
+    _mm_storeu_si128 ((__m128i *) (d + 5 * step), a5);
+    _mm_storeu_si128 ((__m128i *) (d + 6 * step), a6);
+    _mm_storeu_si128 ((__m128i *) (d + 7 * step), a7);
+}
+
+static inline void
+transpose_block_8 (guint8 *dst, const guint8 *src, guint width, guint height,
+                   gboolean flip_r, gboolean flip_c, guint y, guint x)
+{
+    __m128i r0, r1, r2, r3, r4, r5, r6, r7;
+    __m128i a0, a1, a2, a3;
+    const guint8 *s = src + (gsize) y * width + x;
+    const gsize c = flip_c ? height - y - 8 : y;
+    const gssize step = flip_r ? -((gssize) height) : (gssize) height;
+    guint8 *d = dst + (flip_r ? width - 1 - x : x) * (gsize) height + c;
+
+    r0 = _mm_loadl_epi64 ((const __m128i *) (s + 0 * (gsize) width));
+    r1 = _mm_loadl_epi64 ((const __m128i *) (s + 1 * (gsize) width));
+    r2 = _mm_loadl_epi64 ((const __m128i *) (s + 2 * (gsize) width));
+    r3 = _mm_loadl_epi64 ((const __m128i *) (s + 3 * (gsize) width));
+    r4 = _mm_loadl_epi64 ((const __m128i *) (s + 4 * (gsize) width));
+    r5 = _mm_loadl_epi64 ((const __m128i *) (s + 5 * (gsize) width));
+    r6 = _mm_loadl_epi64 ((const __m128i *) (s + 6 * (gsize) width));
+    r7 = _mm_loadl_epi64 ((const __m128i *) (s + 7 * (gsize) width));
+
+    a0 = _mm_unpacklo_epi8 (r0, r1);
+    a1 = _mm_unpacklo_epi8 (r2, r3);
+    a2 = _mm_unpacklo_epi8 (r4, r5);
+    a3 = _mm_unpacklo_epi8 (r6, r7);
+
+    r0 = _mm_unpacklo_epi16 (a0, a1);
+    r1 = _mm_unpackhi_epi16 (a0, a1);
+    r2 = _mm_unpacklo_epi16 (a2, a3);
+    r3 = _mm_unpackhi_epi16 (a2, a3);
+
+    /* Each register holds two source columns, the lower one first */
+    a0 = _mm_unpacklo_epi32 (r0, r2);
+    a1 = _mm_unpackhi_epi32 (r0, r2);
+    a2 = _mm_unpacklo_epi32 (r1, r3);
+    a3 = _mm_unpackhi_epi32 (r1, r3);
+
+    if (flip_c) {
+        /* Reversing all 16 bytes also swaps the two columns */
+        a0 = reverse_epi8 (a0);
+        a1 = reverse_epi8 (a1);
+        a2 = reverse_epi8 (a2);
+        a3 = reverse_epi8 (a3);
+        a0 = _mm_shuffle_epi32 (a0, _MM_SHUFFLE (1, 0, 3, 2));
+        a1 = _mm_shuffle_epi32 (a1, _MM_SHUFFLE (1, 0, 3, 2));
+        a2 = _mm_shuffle_epi32 (a2, _MM_SHUFFLE (1, 0, 3, 2));
+        a3 = _mm_shuffle_epi32 (a3, _MM_SHUFFLE (1, 0, 3, 2));
+    }
+
+    _mm_storel_epi64 ((__m128i *) (d + 0 * step), a0);
+    _mm_storel_epi64 ((__m128i *) (d + 1 * step), _mm_srli_si128 (a0, 8));
+    _mm_storel_epi64 ((__m128i *) (d + 2 * step), a1);
+    _mm_storel_epi64 ((__m128i *) (d + 3 * step), _mm_srli_si128 (a1, 8));
+    _mm_storel_epi64 ((__m128i *) (d + 4 * step), a2);
+    _mm_storel_epi64 ((__m128i *) (d + 5 * step), _mm_srli_si128 (a2, 8));
+    _mm_storel_epi64 ((__m128i *) (d + 6 * step), a3);
+    _mm_storel_epi64 ((__m128i *) (d + 7 * step), _mm_srli_si128 (a3, 8));
+}
+#endif
+
+static void
+transpose (guint8 *dst, const guint8 *src, guint width, guint height, guint pixel_size,
+           gboolean flip_r, gboolean flip_c)
+{
+    for (guint ty = 0; ty < height; ty += TILE_SIZE) {
+        const guint ty1 = MIN (ty + TILE_SIZE, height);
+
+        for (guint tx = 0; tx < width; tx += TILE_SIZE) {
+            const guint tx1 = MIN (tx + TILE_SIZE, width);
+            guint y0 = ty;
+
+#ifdef __SSE2__
+            const guint by1 = ty + ((ty1 - ty) & ~7u);
+            const guint bx1 = tx + ((tx1 - tx) & ~7u);
+
+            /* Fill destination rows left to right to complete cache lines early */
+            for (guint x = tx; x < bx1; x += 8) {
+                for (guint y = ty; y < by1; y += 8) {
+                    if (pixel_size == 1)
+                        transpose_block_8 (dst, src, width, height, flip_r, flip_c, y, x);
+                    else
+                        transpose_block_16 ((guint16 *) dst, (const guint16 *) src,
+                                            width, height, flip_r, flip_c, y, x);
+                }
+            }
+
+            transpose_scalar (dst, src, width, height, pixel_size, flip_r, flip_c, ty, by1, bx1, tx1);
+            y0 = by1;
+#endif
+            transpose_scalar (dst, src, width, height, pixel_size, flip_r, flip_c, y0, ty1, tx, tx1);
+        }
+    }
+}
+
+/**
+ * uca_transform_is_identity:
+ * @mirror: %TRUE if the frame is mirrored
+ * @rotate: Number of clockwise rotations by 90 degrees
+ *
+ * Returns: %TRUE if uca_transform_frame() would leave a frame unchanged.
+ * Since: 2.5
+ */
+gboolean
+uca_transform_is_identity (gboolean mirror, guint rotate)
+{
+    return !mirror && (rotate % 4) == 0;
+}
+
+/**
+ * uca_transform_is_transposed:
+ * @rotate: Number of clockwise rotations by 90 degrees
+ *
+ * Returns: %TRUE if the rotation swaps width and height of a frame.
+ * Since: 2.5
+ */
+gboolean
+uca_transform_is_transposed (guint rotate)
+{
+    return (rotate % 2) == 1;
+}
+
+/**
+ * uca_transform_frame:
+ * @dst: Destination buffer of @width times @height pixels
+ * @src: Source frame
+ * @width: Width of @src in pixels
+ * @height: Height of @src in pixels
+ * @pixel_size: Bytes per pixel, either 1 or 2
+ * @mirror: %TRUE to flip the frame horizontally
+ * @rotate: Number of clockwise rotations by 90 degrees applied after
+ *  mirroring
+ *
+ * Mirror and rotate @src into @dst as described by the #UcaCamera:mirror and
+ * #UcaCamera:rotate properties. For odd @rotate the result is @height pixels
+ * wide and @width pixels high. @dst may equal @src unless @rotate is odd.
+ *
+ * Since: 2.5
+ */
+void
+uca_transform_frame (gpointer dst,
+                     gconstpointer src,
+                     guint width,
+                     guint height,
+                     guint pixel_size,
+                     gboolean mirror,
+                     guint rotate)
+{
+    g_return_if_fail (dst != NULL && src != NULL);
+    g_return_if_fail (pixel_size == 1 || pixel_size == 2);
+    g_return_if_fail (dst != src || !uca_transform_is_transposed (rotate));
+
+    switch (rotate % 4) {
+        case 0:
+            flip (dst, src, width, height, pixel_size, mirror, FALSE);
+            break;
+        case 1:
+            transpose (dst, src, width, height, pixel_size, mirror, TRUE);
+            break;
+        case 2:
+            flip (dst, src, width, height, pixel_size, !mirror, TRUE);
+            break;
+        case 3:
+            transpose (dst, src, width, height, pixel_size, !mirror, FALSE);
+            break;
+    }
+}
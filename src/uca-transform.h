@@ -0,0 +1,39 @@
+/* Copyright (C) 2011-2013 Matthias Vogelgesang <matthias.vogelgesang@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA */
+
+#ifndef UCA_TRANSFORM_H
+#define UCA_TRANSFORM_H
+
+#include <glib.h>
+#include "uca-api.h"
+
+G_BEGIN_DECLS
+
+UCA_API gboolean    uca_transform_is_identity   (gboolean       mirror,
+                                                 guint          rotate);
+UCA_API gboolean    uca_transform_is_transposed (guint          rotate);
+UCA_API void        uca_transform_frame         (gpointer       dst,
+                                                 gconstpointer  src,
+                                                 guint          width,
+                                                 guint          height,
+                                                 guint          pixel_size,
+                                                 gboolean       mirror,
+                                                 guint          rotate);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,373 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <utime.h>
+#include <tiffio.h>
+#include "uca-camera.h"
+#include "uca-plugin-manager.h"
+
+#define WIDTH   8
+#define HEIGHT  4
+#define N_PIXELS (WIDTH * HEIGHT)
+
+typedef struct {
+    UcaPluginManager *manager;
+    UcaCamera *camera;
+    gchar *dirname;
+} Fixture;
+
+static gchar *
+build_file_plugin_path (void)
+{
+    gchar *cwd;
+    gchar *plugin_path;
+
+    cwd = g_get_current_dir ();
+    plugin_path = g_build_filename (cwd, "plugins", "file", NULL);
+    g_free (cwd);
+    return plugin_path;
+}
+
+static void
+fixture_setup (Fixture *fixture, gconstpointer data)
+{
+    gchar *plugin_path;
+    GError *error = NULL;
+
+    plugin_path = build_file_plugin_path ();
+    g_setenv ("UCA_CAMERA_PATH", plugin_path, TRUE);
+    g_free (plugin_path);
+
+    fixture->dirname = g_dir_make_tmp ("uca-file-XXXXXX", &error);
+    g_assert_no_error (error);
+
+    fixture->manager = uca_plugin_manager_new ();
+    fixture->camera = uca_plugin_manager_get_camera (fixture->manager,
+                                                     "file", &error, NULL);
+    g_assert_no_error (error);
+    g_assert (fixture->camera);
+}
+
+static void
+fixture_teardown (Fixture *fixture, gconstpointer data)
+{
+    GDir *dir;
+    const gchar *name;
+
+    g_object_unref (fixture->camera);
+    g_object_unref (fixture->manager);
+
+    dir = g_dir_open (fixture->dirname, 0, NULL);
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar *filename = g_build_filename (fixture->dirname, name, NULL);
+        g_unlink (filename);
+        g_free (filename);
+    }
+
+    g_dir_close (dir);
+    g_rmdir (fixture->dirname);
+    g_free (fixture->dirname);
+}
+
+/* Every pixel of frame n encodes n and its position */
+static void
+fill_frame (guint16 *frame, guint n)
+{
+    for (guint i = 0; i < N_PIXELS; i++)
+        frame[i] = (guint16) (n * 100 + i);
+}
+
+static void
+assert_frame (const guint16 *frame, guint n)
+{
+    for (guint i = 0; i < N_PIXELS; i++)
+        g_assert_cmpuint (frame[i], ==, n * 100 + i);
+}
+
+static void
+write_tiff (Fixture *fixture, const gchar *name, guint first, guint n_pages)
+{
+    gchar *filename;
+    guint16 frame[N_PIXELS];
+    TIFF *tif;
+
+    filename = g_build_filename (fixture->dirname, name, NULL);
+    tif = TIFFOpen (filename, "w");
+    g_assert (tif != NULL);
+
+    for (guint page = 0; page < n_pages; page++) {
+        fill_frame (frame, first + page);
+
+        TIFFSetField (tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+        TIFFSetField (tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField (tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField (tif, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField (tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, HEIGHT);
+        TIFFSetField (tif, TIFFTAG_PAGENUMBER, page, n_pages);
+
+        for (guint y = 0; y < HEIGHT; y++)
+            g_assert (TIFFWriteScanline (tif, frame + y * WIDTH, y, 0) == 1);
+
+        TIFFWriteDirectory (tif);
+    }
+
+    TIFFClose (tif);
+    g_free (filename);
+}
+
+static void
+write_raw (Fixture *fixture, const gchar *name, guint first, guint n_frames)
+{
+    gchar *filename;
+    guint16 *frames;
+    GError *error = NULL;
+
+    filename = g_build_filename (fixture->dirname, name, NULL);
+    frames = g_new (guint16, N_PIXELS * n_frames);
+
+    for (guint i = 0; i < n_frames; i++)
+        fill_frame (frames + i * N_PIXELS, first + i);
+
+    g_file_set_contents (filename, (const gchar *) frames, N_PIXELS * n_frames * sizeof (guint16), &error);
+    g_assert_no_error (error);
+
+    g_free (frames);
+    g_free (filename);
+}
+
+static guint
+get_recorded_frames (UcaCamera *camera)
+{
+    guint n_frames;
+
+    g_object_get (camera, "recorded-frames", &n_frames, NULL);
+    return n_frames;
+}
+
+static void
+grab_and_check (Fixture *fixture, guint prefetch_threads, guint n_frames)
+{
+    GError *error = NULL;
+    guint16 frame[N_PIXELS];
+
+    g_object_set (fixture->camera,
+                  "prefetch-threads", prefetch_threads,
+                  "path", fixture->dirname,
+                  NULL);
+
+    uca_camera_start_recording (fixture->camera, &error);
+    g_assert_no_error (error);
+
+    for (guint i = 0; i < n_frames; i++) {
+        g_assert (uca_camera_grab (fixture->camera, frame, &error));
+        g_assert_no_error (error);
+        assert_frame (frame, i);
+    }
+
+    g_assert (!uca_camera_grab (fixture->camera, frame, &error));
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM);
+    g_error_free (error);
+    error = NULL;
+
+    uca_camera_stop_recording (fixture->camera, &error);
+    g_assert_no_error (error);
+}
+
+static void
+test_format (Fixture *fixture, gconstpointer data)
+{
+    guint width;
+    guint height;
+    guint bitdepth;
+
+    write_tiff (fixture, "frame.tif", 0, 1);
+    g_object_set (fixture->camera, "path", fixture->dirname, NULL);
+    g_object_get (fixture->camera,
+                  "sensor-width", &width,
+                  "sensor-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    g_assert_cmpuint (width, ==, WIDTH);
+    g_assert_cmpuint (height, ==, HEIGHT);
+    g_assert_cmpuint (bitdepth, ==, 16);
+}
+
+static void
+test_order (Fixture *fixture, gconstpointer data)
+{
+    write_tiff (fixture, "f0.tif", 0, 1);
+    write_tiff (fixture, "f1.tif", 1, 2);
+    write_tiff (fixture, "f3.tif", 3, 1);
+
+    grab_and_check (fixture, 0, 4);
+}
+
+static void
+test_order_prefetch (Fixture *fixture, gconstpointer data)
+{
+    for (guint i = 0; i < 16; i++) {
+        gchar *name = g_strdup_printf ("f%u.tif", i);
+        write_tiff (fixture, name, i, 1);
+        g_free (name);
+    }
+
+    grab_and_check (fixture, 3, 16);
+}
+
+static void
+test_natural_sort (Fixture *fixture, gconstpointer data)
+{
+    write_tiff (fixture, "f10.tif", 2, 1);
+    write_tiff (fixture, "f2.tif", 1, 1);
+    write_tiff (fixture, "f1.tif", 0, 1);
+
+    grab_and_check (fixture, 0, 3);
+}
+
+static void
+test_raw (Fixture *fixture, gconstpointer data)
+{
+    write_raw (fixture, "stack.raw", 0, 3);
+
+    g_object_set (fixture->camera,
+                  "raw-width", WIDTH,
+                  "raw-height", HEIGHT,
+                  "raw-bitdepth", 16,
+                  NULL);
+
+    grab_and_check (fixture, 0, 3);
+    grab_and_check (fixture, 2, 3);
+}
+
+static void
+test_readout_multi_page (Fixture *fixture, gconstpointer data)
+{
+    GError *error = NULL;
+    guint16 frame[N_PIXELS];
+
+    write_tiff (fixture, "stack.tif", 0, 4);
+    g_object_set (fixture->camera, "path", fixture->dirname, NULL);
+
+    uca_camera_start_readout (fixture->camera, &error);
+    g_assert_no_error (error);
+    g_assert_cmpuint (get_recorded_frames (fixture->camera), ==, 4);
+
+    /* Readout counts frames from 1 and allows random access */
+    for (guint index = 4; index > 0; index--) {
+        g_assert (uca_camera_readout (fixture->camera, frame, index, &error));
+        g_assert_no_error (error);
+        assert_frame (frame, index - 1);
+    }
+
+    g_assert (!uca_camera_readout (fixture->camera, frame, 5, &error));
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM);
+    g_error_free (error);
+    error = NULL;
+
+    uca_camera_stop_readout (fixture->camera, &error);
+    g_assert_no_error (error);
+}
+
+static guint
+open_indexed (Fixture *fixture)
+{
+    GError *error = NULL;
+    guint n_indexed;
+
+    g_object_set (fixture->camera,
+                  "persist-index", TRUE,
+                  "path", fixture->dirname,
+                  NULL);
+
+    /* A valid index provides the frames without scanning the files */
+    n_indexed = get_recorded_frames (fixture->camera);
+
+    uca_camera_start_readout (fixture->camera, &error);
+    g_assert_no_error (error);
+    uca_camera_stop_readout (fixture->camera, &error);
+    g_assert_no_error (error);
+
+    return n_indexed;
+}
+
+static void
+test_index (Fixture *fixture, gconstpointer data)
+{
+    gchar *filename;
+    struct utimbuf times;
+    GStatBuf buf;
+    guint16 frame[N_PIXELS];
+    GError *error = NULL;
+
+    write_tiff (fixture, "a.tif", 0, 1);
+    write_tiff (fixture, "b.tif", 1, 2);
+
+    g_assert_cmpuint (open_indexed (fixture), ==, 0);
+    g_assert_cmpuint (open_indexed (fixture), ==, 3);
+
+    /* A file with another number of pages has another size */
+    write_tiff (fixture, "b.tif", 1, 3);
+    g_assert_cmpuint (open_indexed (fixture), ==, 0);
+    g_assert_cmpuint (get_recorded_frames (fixture->camera), ==, 4);
+
+    /* Rewritten in place with the same size, only the time tells */
+    write_tiff (fixture, "b.tif", 5, 3);
+    filename = g_build_filename (fixture->dirname, "b.tif", NULL);
+    g_assert (g_stat (filename, &buf) == 0);
+    times.actime = buf.st_atime;
+    times.modtime = buf.st_mtime + 10;
+    g_assert (g_utime (filename, &times) == 0);
+    g_free (filename);
+
+    g_assert_cmpuint (open_indexed (fixture), ==, 0);
+
+    uca_camera_start_readout (fixture->camera, &error);
+    g_assert_no_error (error);
+    g_assert (uca_camera_readout (fixture->camera, frame, 2, &error));
+    g_assert_no_error (error);
+    assert_frame (frame, 5);
+    uca_camera_stop_readout (fixture->camera, &error);
+    g_assert_no_error (error);
+
+    /* An index built for another format is not used either */
+    g_assert_cmpuint (open_indexed (fixture), ==, 4);
+    g_object_set (fixture->camera, "raw-width", WIDTH, NULL);
+    g_assert_cmpuint (open_indexed (fixture), ==, 0);
+}
+
+int main (int argc, char *argv[])
+{
+    gsize n_tests;
+
+#if !(GLIB_CHECK_VERSION (2, 36, 0))
+    g_type_init ();
+#endif
+
+    g_test_init (&argc, &argv, NULL);
+
+    struct {
+        const gchar *name;
+        void (*test_func) (Fixture *fixture, gconstpointer data);
+    }
+    tests[] = {
+        {"/format", test_format},
+        {"/recording/order", test_order},
+        {"/recording/order/prefetch", test_order_prefetch},
+        {"/recording/natural-sort", test_natural_sort},
+        {"/recording/raw", test_raw},
+        {"/readout/multi-page", test_readout_multi_page},
+        {"/index", test_index},
+    };
+
+    n_tests = sizeof(tests) / sizeof(tests[0]);
+
+    for (gsize i = 0; i < n_tests; i++)
+        g_test_add (tests[i].name, Fixture, NULL, fixture_setup, tests[i].test_func, fixture_teardown);
+
+    return g_test_run ();
+}
@@ -1,5 +1,8 @@
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "uca-camera.h"
 #include "uca-plugin-manager.h"
 
@@ -129,6 +132,232 @@ test_recording_async (Fixture *fixture, gconstpointer data)
     g_assert_cmpint (count, ==, 2);
 }
 
+static void
+test_recording_async_pacing (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    guint count = 0;
+    guint n_paced;
+
+    uca_camera_set_grab_func (camera, grab_func, &count);
+
+    /* Frames are due every 2 ms, independent of the time spent on each */
+    g_object_set (G_OBJECT (camera),
+                  "exposure-time", 0.002,
+                  "transfer-asynchronously", TRUE,
+                  "fill-data", FALSE,
+                  "spin-time", 0.0001,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+    g_usleep (G_USEC_PER_SEC / 5);
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpuint (count, >=, 50);
+    g_assert_cmpuint (count, <=, 102);
+
+    n_paced = count;
+    count = 0;
+    g_object_set (G_OBJECT (camera), "free-run", TRUE, NULL);
+
+    /* Without pacing only the spin time limits the rate, twenty times faster */
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+    g_usleep (G_USEC_PER_SEC / 5);
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpuint (count, >, 2 * n_paced);
+}
+
+static void
+grab_metadata_func (gpointer data, const UcaFrameMetadata *metadata, gpointer user_data)
+{
+    UcaFrameMetadata *last = (UcaFrameMetadata *) user_data;
+
+    g_assert (metadata->timestamp >= last->timestamp);
+    *last = *metadata;
+}
+
+static void
+test_recording_metadata (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    UcaFrameMetadata metadata;
+    UcaFrameMetadata last = { 0, };
+    UcaFrameMetadata async_last = { 0, };
+    guint64 dropped;
+    guint n_dropped = 0;
+    gchar *buffer;
+
+    buffer = g_malloc0 (512 * 512);
+
+    g_object_set (G_OBJECT (camera), "exposure-time", 0.001, NULL);
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    for (guint i = 0; i < 3; i++) {
+        g_assert (uca_camera_grab_with_metadata (camera, buffer, &metadata, &error));
+        g_assert_no_error (error);
+        g_assert_cmpuint (metadata.sequence, ==, i);
+        g_assert_cmpuint (metadata.n_dropped, ==, 0);
+        g_assert_cmpfloat (metadata.exposure_time, ==, 0.001);
+        g_assert (metadata.timestamp > last.timestamp);
+
+        if (i > 0)
+            g_assert_cmpuint (metadata.frame_number, ==, last.frame_number + 1);
+
+        last = metadata;
+    }
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    /* Frames lost in the ring buffer show up as gaps once a newer frame is read */
+    g_object_set (G_OBJECT (camera),
+                  "buffered", TRUE,
+                  "num-buffers", 2,
+                  "overrun-policy", UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    for (guint i = 0; i < 5; i++) {
+        g_assert (uca_camera_grab_with_metadata (camera, buffer, &metadata, &error));
+        g_assert_no_error (error);
+        n_dropped += metadata.n_dropped;
+        g_usleep (10000);
+    }
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_object_get (G_OBJECT (camera), "frames-dropped", &dropped, NULL);
+    g_assert_cmpuint (n_dropped, >, 0);
+    g_assert_cmpuint (n_dropped, <=, dropped);
+
+    /* Asynchronous delivery */
+    uca_camera_set_grab_metadata_func (camera, grab_metadata_func, &async_last);
+
+    g_object_set (G_OBJECT (camera),
+                  "buffered", FALSE,
+                  "frames-per-second", 100.0,
+                  "transfer-asynchronously", TRUE,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+    g_usleep (G_USEC_PER_SEC / 10);
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpuint (async_last.sequence, >, 0);
+    g_assert (async_last.timestamp > 0);
+
+    g_free (buffer);
+}
+
+typedef struct {
+    GMutex lock;
+    guint64 last_sequence;
+    guint count;
+    gboolean in_order;
+} DispatchState;
+
+static void
+dispatch_metadata_func (gpointer data, const UcaFrameMetadata *metadata, gpointer user_data)
+{
+    DispatchState *state = (DispatchState *) user_data;
+
+    /* A consumer slower than the camera */
+    g_usleep (G_USEC_PER_SEC / 100);
+
+    g_mutex_lock (&state->lock);
+
+    if (state->count > 0 && metadata->sequence <= state->last_sequence)
+        state->in_order = FALSE;
+
+    state->last_sequence = metadata->sequence;
+    state->count++;
+    g_mutex_unlock (&state->lock);
+}
+
+static void
+test_recording_async_dispatch (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    DispatchState state = { { 0, }, 0, 0, TRUE };
+    guint64 produced, consumed, dropped;
+    gdouble latency_mean, latency_max;
+
+    g_mutex_init (&state.lock);
+    uca_camera_set_grab_metadata_func (camera, dispatch_metadata_func, &state);
+
+    /* In order and blocking, every frame must arrive */
+    g_object_set (G_OBJECT (camera),
+                  "frames-per-second", 200.0,
+                  "transfer-asynchronously", TRUE,
+                  "num-buffers", 4,
+                  "dispatch-threads", 2,
+                  "dispatch-ordered", TRUE,
+                  "overrun-policy", UCA_CAMERA_OVERRUN_POLICY_BLOCK,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+    g_usleep (G_USEC_PER_SEC / 10);
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_object_get (G_OBJECT (camera),
+                  "frames-produced", &produced,
+                  "frames-consumed", &consumed,
+                  "frames-dropped", &dropped,
+                  "callback-latency-mean", &latency_mean,
+                  "callback-latency-max", &latency_max,
+                  NULL);
+
+    g_assert (state.in_order);
+    g_assert_cmpuint (state.count, >, 0);
+    g_assert_cmpuint (consumed, ==, state.count);
+    g_assert_cmpuint (produced, ==, consumed);
+    g_assert_cmpuint (dropped, ==, 0);
+    g_assert (latency_mean > 0.0);
+    g_assert (latency_max >= latency_mean);
+
+    /* Unordered and dropping, every frame is either delivered or dropped */
+    state.count = 0;
+
+    g_object_set (G_OBJECT (camera),
+                  "dispatch-threads", 4,
+                  "dispatch-ordered", FALSE,
+                  "overrun-policy", UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+    g_usleep (G_USEC_PER_SEC / 10);
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_object_get (G_OBJECT (camera),
+                  "frames-produced", &produced,
+                  "frames-consumed", &consumed,
+                  "frames-dropped", &dropped,
+                  NULL);
+
+    g_assert_cmpuint (consumed, ==, state.count);
+    g_assert_cmpuint (produced, ==, consumed + dropped);
+
+    g_mutex_clear (&state.lock);
+}
+
 static void
 test_recording_property (Fixture *fixture, gconstpointer data)
 {
@@ -146,6 +375,452 @@ test_recording_property (Fixture *fixture, gconstpointer data)
     g_assert (!uca_camera_is_recording (camera));
 }
 
+static void
+test_recording_grab_n (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    guint width, height, bitdepth;
+    gsize frame_size;
+    gpointer frames[3];
+    gchar *buffer;
+
+    g_object_get (G_OBJECT (camera),
+                  "roi-width", &width,
+                  "roi-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    frame_size = width * height * (bitdepth <= 8 ? 1 : 2);
+    buffer = g_malloc0 (4 * frame_size);
+
+    g_assert_cmpuint (uca_camera_grab_n (camera, buffer, 4, &error), ==, 0);
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_NOT_RECORDING);
+    g_error_free (error);
+    error = NULL;
+
+    g_object_set (G_OBJECT (camera), "exposure-time", 0.001, NULL);
+
+    for (guint buffered = 0; buffered < 2; buffered++) {
+        g_object_set (G_OBJECT (camera), "buffered", (gboolean) buffered, NULL);
+
+        uca_camera_start_recording (camera, &error);
+        g_assert_no_error (error);
+
+        g_assert_cmpuint (uca_camera_grab_n (camera, buffer, 4, &error), ==, 4);
+        g_assert_no_error (error);
+
+        for (guint i = 0; i < G_N_ELEMENTS (frames); i++)
+            frames[i] = buffer + (G_N_ELEMENTS (frames) - 1 - i) * frame_size;
+
+        g_assert_cmpuint (uca_camera_grab_scatter (camera, frames, G_N_ELEMENTS (frames), &error), ==, 3);
+        g_assert_no_error (error);
+
+        uca_camera_stop_recording (camera, &error);
+        g_assert_no_error (error);
+    }
+
+    g_free (buffer);
+}
+
+static void
+test_recording_transform (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    guint width, height, bitdepth;
+    gsize stride;
+    guint8 *frame;
+
+    g_object_get (G_OBJECT (camera),
+                  "roi-width", &width,
+                  "roi-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    stride = width * (bitdepth <= 8 ? 1 : 2);
+    frame = g_malloc (height * stride);
+
+    for (gsize i = 0; i < height * stride; i++)
+        frame[i] = i % 251;
+
+    /* Without fill-data the mock leaves the frame as is */
+    g_object_set (G_OBJECT (camera),
+                  "fill-data", FALSE,
+                  "exposure-time", 0.001,
+                  "mirror", TRUE,
+                  "rotate", 2,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    uca_camera_grab (camera, frame, &error);
+    g_assert_no_error (error);
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    /* Mirroring and rotating by 180 degrees flips the rows */
+    for (guint y = 0; y < height; y++) {
+        for (gsize j = 0; j < stride; j++)
+            g_assert_cmpuint (frame[y * stride + j], ==, ((height - 1 - y) * stride + j) % 251);
+    }
+
+    g_free (frame);
+}
+
+static void
+set_content (UcaCamera *camera, const gchar *nick)
+{
+    GEnumClass *enum_class;
+    GEnumValue *value;
+
+    enum_class = g_type_class_ref (g_type_from_name ("UcaMockCameraContent"));
+    value = g_enum_get_value_by_nick (enum_class, nick);
+    g_assert (value != NULL);
+    g_object_set (G_OBJECT (camera), "content", value->value, NULL);
+    g_type_class_unref (enum_class);
+}
+
+static void
+grab_two_frames (UcaCamera *camera, guint8 *first, guint8 *second)
+{
+    GError *error = NULL;
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    uca_camera_grab (camera, first, &error);
+    g_assert_no_error (error);
+
+    uca_camera_grab (camera, second, &error);
+    g_assert_no_error (error);
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+}
+
+static void
+test_recording_content (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    guint width, height, bitdepth;
+    guint pixel_size;
+    gsize size;
+    gsize header;
+    gdouble max_val;
+    gdouble mean = 0.0;
+    guint8 *first;
+    guint8 *second;
+
+    g_object_get (G_OBJECT (camera),
+                  "roi-width", &width,
+                  "roi-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    pixel_size = bitdepth <= 8 ? 1 : 2;
+    max_val = (1 << bitdepth) - 1;
+    size = width * height * pixel_size;
+    header = 15 * width * pixel_size;
+    first = g_malloc0 (size);
+    second = g_malloc0 (size);
+
+    g_object_set (G_OBJECT (camera), "exposure-time", 0.001, NULL);
+
+    /* Fresh noise in every frame, centered in the value range */
+    set_content (camera, "noise");
+    grab_two_frames (camera, first, second);
+    g_assert (memcmp (first + header, second + header, size - header) != 0);
+
+    for (guint y = height / 3; y < height * 2 / 3; y++) {
+        for (guint x = width / 3; x < width * 2 / 3; x++) {
+            gsize i = (gsize) y * width + x;
+            mean += pixel_size == 1 ? first[i] : ((guint16 *) first)[i];
+        }
+    }
+
+    mean /= (height * 2 / 3 - height / 3) * (width * 2 / 3 - width / 3);
+    g_assert_cmpfloat (ABS (mean - max_val / 2), <, max_val / 32);
+
+    /* A pool of one frame only changes the frame counter */
+    set_content (camera, "pool");
+    g_object_set (G_OBJECT (camera), "pool-size", 1, NULL);
+    grab_two_frames (camera, first, second);
+    g_assert (memcmp (first, second, header) != 0);
+    g_assert (memcmp (first + header, second + header, size - header) == 0);
+
+    set_content (camera, "constant");
+    grab_two_frames (camera, first, second);
+    g_assert (memcmp (first, second, size) == 0);
+
+    g_free (first);
+    g_free (second);
+}
+
+static void
+record_and_read_out (UcaCamera *camera, guint n_frames)
+{
+    GError *error = NULL;
+    GTimer *timer;
+    guint width, height, bitdepth;
+    guint recorded_frames = 0;
+    gsize size;
+    guint8 *frames;
+    guint8 *frame;
+
+    g_object_get (G_OBJECT (camera),
+                  "roi-width", &width,
+                  "roi-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    size = width * height * (bitdepth <= 8 ? 1 : 2);
+    frames = g_malloc0 (size * n_frames);
+    frame = g_malloc0 (size);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    /* recorded-frames grows while recording without grabbing frames */
+    timer = g_timer_new ();
+
+    while (recorded_frames < n_frames && g_timer_elapsed (timer, NULL) < 5.0)
+        g_object_get (G_OBJECT (camera), "recorded-frames", &recorded_frames, NULL);
+
+    g_assert_cmpuint (recorded_frames, ==, n_frames);
+
+    /* Live frames are delivered while recording */
+    uca_camera_grab (camera, frame, &error);
+    g_assert_no_error (error);
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_object_get (G_OBJECT (camera), "recorded-frames", &recorded_frames, NULL);
+    g_assert_cmpuint (recorded_frames, ==, n_frames);
+
+    uca_camera_start_readout (camera, &error);
+    g_assert_no_error (error);
+
+    for (guint i = 0; i < n_frames; i++) {
+        uca_camera_grab (camera, frames + i * size, &error);
+        g_assert_no_error (error);
+    }
+
+    uca_camera_grab (camera, frame, &error);
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM);
+    g_clear_error (&error);
+
+    /* Random access returns exactly the frames read out in sequence */
+    for (guint i = n_frames; i > 0; i--) {
+        uca_camera_readout (camera, frame, i, &error);
+        g_assert_no_error (error);
+        g_assert (memcmp (frame, frames + (i - 1) * size, size) == 0);
+
+        if (i > 1)
+            g_assert (memcmp (frames + (i - 1) * size, frames + (i - 2) * size, size) != 0);
+    }
+
+    uca_camera_readout (camera, frame, n_frames + 1, &error);
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_END_OF_STREAM);
+    g_clear_error (&error);
+
+    /* Reading out is limited by the camera memory bandwidth */
+    g_object_set (G_OBJECT (camera), "camram-bandwidth", (gdouble) size * 100.0, NULL);
+    g_timer_start (timer);
+
+    for (guint i = 1; i <= 10; i++) {
+        uca_camera_readout (camera, frame, 1 + i % n_frames, &error);
+        g_assert_no_error (error);
+    }
+
+    g_assert_cmpfloat (g_timer_elapsed (timer, NULL), >=, 0.09);
+    g_object_set (G_OBJECT (camera), "camram-bandwidth", 0.0, NULL);
+
+    uca_camera_stop_readout (camera, &error);
+    g_assert_no_error (error);
+
+    g_timer_destroy (timer);
+    g_free (frames);
+    g_free (frame);
+}
+
+static void
+test_recording_camram (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    gboolean has_camram;
+    gchar *filename;
+    gint fd;
+
+    g_object_get (G_OBJECT (camera), "has-camram-recording", &has_camram, NULL);
+    g_assert (!has_camram);
+
+    g_object_set (G_OBJECT (camera),
+                  "exposure-time", 0.002,
+                  "camram-size", 8,
+                  NULL);
+
+    g_object_get (G_OBJECT (camera), "has-camram-recording", &has_camram, NULL);
+    g_assert (has_camram);
+
+    record_and_read_out (camera, 8);
+
+    /* The same with camera memory backed by a file */
+    fd = g_file_open_tmp ("test-mock-camram-XXXXXX", &filename, &error);
+    g_assert_no_error (error);
+    close (fd);
+
+    g_object_set (G_OBJECT (camera), "camram-file", filename, NULL);
+    record_and_read_out (camera, 8);
+
+    g_unlink (filename);
+    g_free (filename);
+}
+
+/*
+ * Grab n_frames and store the frame numbers relative to the first delivered
+ * frame, or G_MAXUINT64 for frames that failed with a device error.
+ */
+static void
+grab_with_faults (UcaCamera *camera, guint n_frames, guint64 *frame_numbers)
+{
+    GError *error = NULL;
+    UcaFrameMetadata metadata;
+    gpointer buffer;
+    gboolean have_first = FALSE;
+    guint64 first = 0;
+    guint width, height;
+
+    g_object_get (G_OBJECT (camera), "roi-width", &width, "roi-height", &height, NULL);
+    buffer = g_malloc0 (width * height * 2);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    for (guint i = 0; i < n_frames; i++) {
+        if (!uca_camera_grab_with_metadata (camera, buffer, &metadata, &error)) {
+            g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_DEVICE);
+            g_clear_error (&error);
+            frame_numbers[i] = G_MAXUINT64;
+            continue;
+        }
+
+        if (!have_first) {
+            first = metadata.frame_number;
+            have_first = TRUE;
+        }
+
+        frame_numbers[i] = metadata.frame_number - first;
+    }
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+    g_free (buffer);
+}
+
+static void
+test_recording_faults (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    GTimer *timer;
+    guint64 first[64];
+    guint64 second[64];
+    guint n_errors = 0;
+    guint64 last = 0;
+    gboolean have_gap = FALSE;
+    gpointer buffer;
+    guint width, height;
+
+    g_object_set (G_OBJECT (camera),
+                  "free-run", TRUE,
+                  "fill-data", FALSE,
+                  "fault-seed", 42,
+                  "drop-probability", 0.3,
+                  "error-probability", 0.2,
+                  NULL);
+
+    /* The same seed injects the same faults */
+    grab_with_faults (camera, G_N_ELEMENTS (first), first);
+    grab_with_faults (camera, G_N_ELEMENTS (second), second);
+    g_assert (memcmp (first, second, sizeof (first)) == 0);
+
+    for (guint i = 0; i < G_N_ELEMENTS (first); i++) {
+        if (first[i] == G_MAXUINT64) {
+            n_errors++;
+            continue;
+        }
+
+        have_gap = have_gap || first[i] > last + 1;
+        last = first[i];
+    }
+
+    g_assert_cmpuint (n_errors, >, 0);
+    g_assert_cmpuint (n_errors, <, G_N_ELEMENTS (first));
+    g_assert (have_gap);
+
+    g_object_set (G_OBJECT (camera),
+                  "drop-probability", 0.0,
+                  "error-probability", 0.0,
+                  "stall-period", 5,
+                  "stall-time", 0.05,
+                  NULL);
+
+    /* Every fifth frame stalls */
+    timer = g_timer_new ();
+    grab_with_faults (camera, 10, first);
+    g_assert_cmpfloat (g_timer_elapsed (timer, NULL), >=, 0.1);
+
+    g_object_get (G_OBJECT (camera), "roi-width", &width, "roi-height", &height, NULL);
+    buffer = g_malloc0 (width * height * 2);
+
+    /* Software triggers arrive late */
+    g_object_set (G_OBJECT (camera),
+                  "stall-period", 0,
+                  "trigger-source", UCA_CAMERA_TRIGGER_SOURCE_SOFTWARE,
+                  "trigger-delay", 0.05,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_timer_start (timer);
+    uca_camera_trigger (camera, &error);
+    g_assert_no_error (error);
+
+    uca_camera_grab (camera, buffer, &error);
+    g_assert_no_error (error);
+    g_assert_cmpfloat (g_timer_elapsed (timer, NULL), >=, 0.05);
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    /* Buffered acquisition reports device errors to the consumer */
+    g_object_set (G_OBJECT (camera),
+                  "trigger-source", UCA_CAMERA_TRIGGER_SOURCE_AUTO,
+                  "trigger-delay", 0.0,
+                  "error-probability", 1.0,
+                  "buffered", TRUE,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_assert (!uca_camera_grab (camera, buffer, &error));
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_DEVICE);
+    g_clear_error (&error);
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_timer_destroy (timer);
+    g_free (buffer);
+}
+
 static void
 test_recording_buffered (Fixture *fixture, gconstpointer data)
 {
@@ -183,6 +858,230 @@ test_recording_buffered (Fixture *fixture, gconstpointer data)
     g_free (buffer);
 }
 
+static void
+test_recording_buffered_timeout (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    gchar *buffer;
+
+    buffer = g_malloc0 (512 * 512);
+
+    g_object_set (G_OBJECT (camera),
+                  "buffered", TRUE,
+                  "exposure-time", 0.5,
+                  "grab-timeout", 0.05,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_assert (!uca_camera_grab (camera, (gpointer) buffer, &error));
+    g_assert_error (error, UCA_CAMERA_ERROR, UCA_CAMERA_ERROR_TIMEOUT);
+    g_error_free (error);
+    error = NULL;
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_free (buffer);
+}
+
+static void
+test_recording_buffered_borrow (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    UcaCameraOverrunPolicy policies[] = {
+        UCA_CAMERA_OVERRUN_POLICY_BLOCK,
+        UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST,
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS (policies); i++) {
+        GError *error = NULL;
+
+        g_object_set (G_OBJECT (camera),
+                      "buffered", TRUE,
+                      "num-buffers", 3,
+                      "exposure-time", 0.001,
+                      "overrun-policy", policies[i],
+                      NULL);
+
+        uca_camera_start_recording (camera, &error);
+        g_assert_no_error (error);
+
+        for (int j = 0; j < 10; j++) {
+            gconstpointer frame;
+
+            frame = uca_camera_borrow_frame (camera, &error);
+            g_assert_no_error (error);
+            g_assert (frame != NULL);
+
+            /* Give the buffer thread a chance to run into the borrowed frame */
+            g_usleep (5000);
+            uca_camera_release_frame (camera);
+        }
+
+        uca_camera_stop_recording (camera, &error);
+        g_assert_no_error (error);
+    }
+}
+
+static void
+test_recording_buffered_dropped (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *camera = UCA_CAMERA (fixture->camera);
+    GError *error = NULL;
+    guint64 produced, consumed, dropped;
+    guint high_water;
+    gchar *buffer;
+
+    buffer = g_malloc0 (512 * 512);
+
+    g_object_set (G_OBJECT (camera),
+                  "buffered", TRUE,
+                  "num-buffers", 3,
+                  "exposure-time", 0.001,
+                  "overrun-policy", UCA_CAMERA_OVERRUN_POLICY_DROP_OLDEST,
+                  NULL);
+
+    uca_camera_start_recording (camera, &error);
+    g_assert_no_error (error);
+
+    /* Consume slower than the camera produces */
+    for (int i = 0; i < 5; i++) {
+        g_assert (uca_camera_grab (camera, (gpointer) buffer, &error));
+        g_assert_no_error (error);
+        g_usleep (20000);
+    }
+
+    uca_camera_stop_recording (camera, &error);
+    g_assert_no_error (error);
+
+    g_object_get (G_OBJECT (camera),
+                  "frames-produced", &produced,
+                  "frames-consumed", &consumed,
+                  "frames-dropped", &dropped,
+                  "buffer-high-water", &high_water,
+                  NULL);
+
+    g_assert_cmpuint (consumed, ==, 5);
+    g_assert_cmpuint (dropped, >, 0);
+    g_assert_cmpuint (produced, >=, consumed + dropped);
+    g_assert_cmpuint (high_water, >, 0);
+    g_assert_cmpuint (high_water, <=, 3);
+
+    g_free (buffer);
+}
+
+typedef struct {
+    UcaCamera *camera;
+    guint n_frames;
+    gboolean success;
+} GrabThreadData;
+
+static gpointer
+grab_thread_func (GrabThreadData *data)
+{
+    GError *error = NULL;
+    guint width, height, bitdepth;
+    gchar *buffer;
+
+    g_object_get (G_OBJECT (data->camera),
+                  "roi-width", &width,
+                  "roi-height", &height,
+                  "sensor-bitdepth", &bitdepth,
+                  NULL);
+
+    buffer = g_malloc0 (width * height * (bitdepth <= 8 ? 1 : 2));
+    data->success = TRUE;
+
+    for (guint i = 0; i < data->n_frames; i++)
+        data->success = data->success && uca_camera_grab (data->camera, buffer, &error);
+
+    g_free (buffer);
+    return NULL;
+}
+
+static gdouble
+grab_from_cameras (UcaCamera **cameras, guint n_cameras, guint n_frames)
+{
+    GrabThreadData *data;
+    GThread **threads;
+    GTimer *timer;
+    GError *error = NULL;
+    gdouble elapsed;
+
+    data = g_new0 (GrabThreadData, n_cameras);
+    threads = g_new0 (GThread *, n_cameras);
+
+    for (guint i = 0; i < n_cameras; i++) {
+        uca_camera_start_recording (cameras[i], &error);
+        g_assert_no_error (error);
+        data[i].camera = cameras[i];
+        data[i].n_frames = n_frames;
+    }
+
+    timer = g_timer_new ();
+
+    for (guint i = 0; i < n_cameras; i++)
+        threads[i] = g_thread_new (NULL, (GThreadFunc) grab_thread_func, &data[i]);
+
+    for (guint i = 0; i < n_cameras; i++) {
+        g_thread_join (threads[i]);
+        g_assert (data[i].success);
+    }
+
+    elapsed = g_timer_elapsed (timer, NULL);
+
+    for (guint i = 0; i < n_cameras; i++) {
+        uca_camera_stop_recording (cameras[i], &error);
+        g_assert_no_error (error);
+    }
+
+    g_timer_destroy (timer);
+    g_free (threads);
+    g_free (data);
+    return elapsed;
+}
+
+static void
+test_recording_multiple_cameras (Fixture *fixture, gconstpointer data)
+{
+    UcaCamera *cameras[3];
+    const guint n_cameras = G_N_ELEMENTS (cameras);
+    const guint n_frames = 10;
+    GError *error = NULL;
+    gdouble single;
+    gdouble multiple;
+
+    cameras[0] = fixture->camera;
+
+    for (guint i = 1; i < n_cameras; i++) {
+        cameras[i] = uca_plugin_manager_get_camera (fixture->manager, "mock", &error, NULL);
+        g_assert_no_error (error);
+    }
+
+    for (guint i = 0; i < n_cameras; i++) {
+        g_object_set (G_OBJECT (cameras[i]),
+                      "exposure-time", 0.02,
+                      "fill-data", FALSE,
+                      NULL);
+    }
+
+    single = grab_from_cameras (cameras, 1, n_frames);
+    multiple = grab_from_cameras (cameras, n_cameras, n_frames);
+
+    /*
+     * Each camera sleeps for the exposure time in grab, so without
+     * per-camera locking the aggregate time grows with the number of cameras.
+     */
+    g_test_message ("%u frames/s with one camera, %u frames/s with %u cameras",
+                    (guint) (n_frames / single), (guint) (n_cameras * n_frames / multiple), n_cameras);
+    g_assert_cmpfloat (multiple, <, 1.5 * single);
+
+    for (guint i = 1; i < n_cameras; i++)
+        g_object_unref (cameras[i]);
+}
 
 static void
 test_base_properties (Fixture *fixture, gconstpointer data)
@@ -338,7 +1237,19 @@ int main (int argc, char *argv[])
         {"/recording", test_recording},
         {"/recording/signal", test_recording_signal},
         {"/recording/asynchronous", test_recording_async},
+        {"/recording/asynchronous/dispatch", test_recording_async_dispatch},
+        {"/recording/asynchronous/pacing", test_recording_async_pacing},
+        {"/recording/metadata", test_recording_metadata},
+        {"/recording/grab-n", test_recording_grab_n},
+        {"/recording/transform", test_recording_transform},
+        {"/recording/content", test_recording_content},
+        {"/recording/camram", test_recording_camram},
+        {"/recording/faults", test_recording_faults},
         {"/recording/buffered", test_recording_buffered},
+        {"/recording/buffered/timeout", test_recording_buffered_timeout},
+        {"/recording/buffered/borrow", test_recording_buffered_borrow},
+        {"/recording/buffered/dropped", test_recording_buffered_dropped},
+        {"/recording/multiple-cameras", test_recording_multiple_cameras},
         {"/properties/base", test_base_properties},
         {"/properties/recording", test_recording_property},
         {"/properties/frames-per-second", test_fps_property},
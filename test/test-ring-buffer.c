@@ -1,4 +1,5 @@
 #include <glib.h>
+#include <glib/gstdio.h>
 #include "uca-ring-buffer.h"
 
 
@@ -19,6 +20,80 @@ test_new_constructor (void)
     g_object_unref (buffer);
 }
 
+static void
+test_new_full (void)
+{
+    UcaRingBuffer *buffer;
+    guint32 *data;
+    gsize block_size = 1 << 20;
+
+    buffer = uca_ring_buffer_new_full (block_size, 8,
+                                       UCA_RING_BUFFER_ALLOC_HUGE_PAGES | UCA_RING_BUFFER_ALLOC_PREFAULT,
+                                       -1);
+
+    g_assert (uca_ring_buffer_get_block_size (buffer) == block_size);
+
+    for (guint i = 0; i < 8; i++) {
+        data = uca_ring_buffer_get_pointer (buffer, i);
+        g_assert (data[0] == 0);
+        g_assert (data[block_size / sizeof (guint32) - 1] == 0);
+    }
+
+    data = uca_ring_buffer_get_write_pointer (buffer);
+    data[0] = 0xDEADBEEF;
+    uca_ring_buffer_write_advance (buffer);
+    data = uca_ring_buffer_get_read_pointer (buffer);
+    g_assert (data[0] == 0xDEADBEEF);
+
+    g_object_unref (buffer);
+}
+
+static void
+test_new_mapped (void)
+{
+    UcaRingBuffer *buffer;
+    GError *error = NULL;
+    gchar *dirname;
+    gchar *filename;
+    gchar *contents;
+    gsize length;
+    guint32 *data;
+
+    dirname = g_dir_make_tmp ("uca-XXXXXX", &error);
+    g_assert_no_error (error);
+    filename = g_build_filename (dirname, "ring.raw", NULL);
+
+    buffer = uca_ring_buffer_new_mapped (filename, 512, 4, UCA_RING_BUFFER_ALLOC_DEFAULT, &error);
+    g_assert_no_error (error);
+
+    for (guint32 i = 0; i < 4; i++) {
+        data = uca_ring_buffer_get_write_pointer (buffer);
+        data[0] = i;
+        uca_ring_buffer_write_advance (buffer);
+    }
+
+    for (guint32 i = 0; i < 4; i++) {
+        data = uca_ring_buffer_get_read_pointer (buffer);
+        g_assert_cmpuint (data[0], ==, i);
+    }
+
+    g_object_unref (buffer);
+
+    g_assert (g_file_get_contents (filename, &contents, &length, NULL));
+    g_assert_cmpuint (length, ==, 4 * 512);
+    g_assert_cmpuint (((guint32 *) contents)[3 * 512 / sizeof (guint32)], ==, 3);
+    g_free (contents);
+
+    g_assert (uca_ring_buffer_new_mapped (dirname, 512, 4, UCA_RING_BUFFER_ALLOC_DEFAULT, &error) == NULL);
+    g_assert (error != NULL);
+    g_error_free (error);
+
+    g_unlink (filename);
+    g_rmdir (dirname);
+    g_free (filename);
+    g_free (dirname);
+}
+
 static void
 test_new_func (void)
 {
@@ -72,18 +147,230 @@ test_overwrite (void)
     UcaRingBuffer *buffer;
     guint32 *data;
 
-    buffer = uca_ring_buffer_new (512, 1);
+    buffer = uca_ring_buffer_new (512, 2);
 
     data = uca_ring_buffer_get_write_pointer (buffer);
     data[0] = 0xBADF00D;
     uca_ring_buffer_write_advance (buffer);
 
+    data = uca_ring_buffer_get_write_pointer (buffer);
+    data[0] = 0xCAFEBABE;
+    uca_ring_buffer_write_advance (buffer);
+
     data = uca_ring_buffer_get_write_pointer (buffer);
     data[0] = 0xDEADBEEF;
     uca_ring_buffer_write_advance (buffer);
 
+    g_assert_cmpuint (uca_ring_buffer_get_high_water_mark (buffer), ==, 2);
+
+    /* The producer is idle, so the two most recent blocks are intact */
+    g_assert_cmpuint (uca_ring_buffer_get_num_blocks (buffer), ==, 2);
+    data = uca_ring_buffer_get_read_pointer (buffer);
+    g_assert (data[0] == 0xCAFEBABE);
+    g_assert_cmpuint (uca_ring_buffer_get_num_dropped (buffer), ==, 1);
     data = uca_ring_buffer_get_read_pointer (buffer);
     g_assert (data[0] == 0xDEADBEEF);
+    g_assert (!uca_ring_buffer_available (buffer));
+
+    uca_ring_buffer_reset (buffer);
+    g_assert_cmpuint (uca_ring_buffer_get_num_dropped (buffer), ==, 0);
+    g_assert_cmpuint (uca_ring_buffer_get_high_water_mark (buffer), ==, 0);
+
+    /* Filling up to capacity does not drop anything */
+    uca_ring_buffer_write_advance (buffer);
+    uca_ring_buffer_write_advance (buffer);
+    g_assert_cmpuint (uca_ring_buffer_get_num_blocks (buffer), ==, 2);
+    g_assert (uca_ring_buffer_get_read_pointer (buffer) != NULL);
+    g_assert (uca_ring_buffer_get_read_pointer (buffer) != NULL);
+    g_assert_cmpuint (uca_ring_buffer_get_num_dropped (buffer), ==, 0);
+
+    /* Unless the producer starts overwriting the oldest block */
+    uca_ring_buffer_reset (buffer);
+    uca_ring_buffer_write_advance (buffer);
+    data = uca_ring_buffer_get_write_pointer (buffer);
+    data[0] = 0xBADF00D;
+    uca_ring_buffer_write_advance (buffer);
+    data = uca_ring_buffer_get_write_pointer (buffer);
+    data[0] = 0;
+
+    g_assert_cmpuint (uca_ring_buffer_get_num_blocks (buffer), ==, 1);
+    data = uca_ring_buffer_get_read_pointer (buffer);
+    g_assert (data[0] == 0xBADF00D);
+    g_assert_cmpuint (uca_ring_buffer_get_num_dropped (buffer), ==, 1);
+    g_assert (!uca_ring_buffer_available (buffer));
+
+    g_object_unref (buffer);
+}
+
+static void
+test_drain_wrapped (void)
+{
+    UcaRingBuffer *buffer;
+    guint32 *data;
+    guint n_blocks;
+
+    buffer = uca_ring_buffer_new (512, 4);
+
+    for (guint32 i = 0; i < 10; i++) {
+        data = uca_ring_buffer_get_write_pointer (buffer);
+        data[0] = i;
+        uca_ring_buffer_write_advance (buffer);
+    }
+
+    n_blocks = uca_ring_buffer_get_num_blocks (buffer);
+    g_assert_cmpuint (n_blocks, ==, 4);
+
+    for (guint i = 0; i < n_blocks; i++) {
+        data = uca_ring_buffer_get_pointer (buffer, i);
+        g_assert_cmpuint (data[0], ==, 6 + i);
+    }
+
+    for (guint i = 0; i < n_blocks; i++) {
+        data = uca_ring_buffer_get_read_pointer (buffer);
+        g_assert (data != NULL);
+        g_assert_cmpuint (data[0], ==, 6 + i);
+    }
+
+    g_assert (!uca_ring_buffer_available (buffer));
+    g_assert_cmpuint (uca_ring_buffer_get_num_blocks (buffer), ==, 0);
+
+    /* With the producer writing, one block less is readable */
+    for (guint32 i = 10; i < 15; i++) {
+        data = uca_ring_buffer_get_write_pointer (buffer);
+        data[0] = i;
+        uca_ring_buffer_write_advance (buffer);
+    }
+
+    uca_ring_buffer_get_write_pointer (buffer);
+    n_blocks = uca_ring_buffer_get_num_blocks (buffer);
+    g_assert_cmpuint (n_blocks, ==, 3);
+
+    for (guint i = 0; i < n_blocks; i++) {
+        data = uca_ring_buffer_get_pointer (buffer, i);
+        g_assert_cmpuint (data[0], ==, 12 + i);
+    }
+
+    for (guint i = 0; i < n_blocks; i++) {
+        data = uca_ring_buffer_get_read_pointer (buffer);
+        g_assert (data != NULL);
+        g_assert_cmpuint (data[0], ==, 12 + i);
+    }
+
+    g_assert (!uca_ring_buffer_available (buffer));
+
+    g_object_unref (buffer);
+}
+
+static void
+test_rewind (void)
+{
+    UcaRingBuffer *buffer;
+    guint32 *data;
+
+    buffer = uca_ring_buffer_new (512, 4);
+
+    for (guint32 i = 0; i < 6; i++) {
+        data = uca_ring_buffer_get_write_pointer (buffer);
+        data[0] = i;
+        uca_ring_buffer_write_advance (buffer);
+    }
+
+    while (uca_ring_buffer_available (buffer))
+        uca_ring_buffer_get_read_pointer (buffer);
+
+    uca_ring_buffer_rewind (buffer);
+    g_assert_cmpuint (uca_ring_buffer_get_num_blocks (buffer), ==, 4);
+
+    for (guint i = 0; i < 4; i++) {
+        data = uca_ring_buffer_get_pointer (buffer, i);
+        g_assert_cmpuint (data[0], ==, 2 + i);
+    }
+
+    for (guint i = 0; i < 4; i++) {
+        data = uca_ring_buffer_get_read_pointer (buffer);
+        g_assert_cmpuint (data[0], ==, 2 + i);
+    }
+
+    g_assert (!uca_ring_buffer_available (buffer));
+
+    g_object_unref (buffer);
+}
+
+static void
+test_full (void)
+{
+    UcaRingBuffer *buffer;
+
+    buffer = uca_ring_buffer_new (512, 3);
+
+    g_assert (!uca_ring_buffer_full (buffer));
+    uca_ring_buffer_write_advance (buffer);
+    g_assert (!uca_ring_buffer_full (buffer));
+    uca_ring_buffer_write_advance (buffer);
+
+    /* The last slot is reserved for the block handed out by the next read */
+    g_assert (uca_ring_buffer_full (buffer));
+
+    uca_ring_buffer_get_read_pointer (buffer);
+    g_assert (!uca_ring_buffer_full (buffer));
+
+    g_object_unref (buffer);
+}
+
+#define STRESS_NUM_OPS (1 << 22)
+
+static gpointer
+stress_producer (UcaRingBuffer *buffer)
+{
+    for (guint32 i = 0; i < STRESS_NUM_OPS; i++) {
+        guint32 *data;
+
+        while (uca_ring_buffer_full (buffer))
+            g_thread_yield ();
+
+        data = uca_ring_buffer_get_write_pointer (buffer);
+        data[0] = i;
+        data[1] = ~i;
+        uca_ring_buffer_write_advance (buffer);
+    }
+
+    return NULL;
+}
+
+static void
+test_stress (void)
+{
+    UcaRingBuffer *buffer;
+    GThread *producer;
+    GTimer *timer;
+    guint n_errors = 0;
+    gdouble elapsed;
+
+    buffer = uca_ring_buffer_new (64, 256);
+    timer = g_timer_new ();
+    producer = g_thread_new (NULL, (GThreadFunc) stress_producer, buffer);
+
+    for (guint32 i = 0; i < STRESS_NUM_OPS; i++) {
+        guint32 *data;
+
+        while (!uca_ring_buffer_available (buffer))
+            g_thread_yield ();
+
+        data = uca_ring_buffer_get_read_pointer (buffer);
+
+        if (data[0] != i || data[1] != ~i)
+            n_errors++;
+    }
+
+    g_thread_join (producer);
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_test_message ("%.2f million ops/s", STRESS_NUM_OPS / elapsed / 1e6);
+
+    g_assert_cmpuint (n_errors, ==, 0);
+    g_assert (!uca_ring_buffer_available (buffer));
+
+    g_timer_destroy (timer);
+    g_object_unref (buffer);
 }
 
 int
@@ -97,8 +384,14 @@ main (int argc, char *argv[])
 
     g_test_add_func ("/ringbuffer/new/constructor", test_new_constructor);
     g_test_add_func ("/ringbuffer/new/func", test_new_func);
+    g_test_add_func ("/ringbuffer/new/full", test_new_full);
+    g_test_add_func ("/ringbuffer/new/mapped", test_new_mapped);
     g_test_add_func ("/ringbuffer/functionality ", test_ring);
     g_test_add_func ("/ringbuffer/overwrite ", test_overwrite);
+    g_test_add_func ("/ringbuffer/drain", test_drain_wrapped);
+    g_test_add_func ("/ringbuffer/rewind", test_rewind);
+    g_test_add_func ("/ringbuffer/full", test_full);
+    g_test_add_func ("/ringbuffer/stress", test_stress);
 
     return g_test_run ();
 }
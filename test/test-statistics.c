@@ -0,0 +1,176 @@
+#include <math.h>
+#include <glib.h>
+#include "uca-statistics.h"
+
+/* Compare against a straightforward per-pixel computation */
+static void
+check_statistics (gsize n_pixels, guint pixel_size, guint max_value, guint n_bins, guint n_threads, gboolean with_histogram)
+{
+    UcaStatistics stats;
+    guint8 *data;
+    guint32 *histogram;
+    guint32 *expected;
+    guint64 sum = 0;
+    guint64 sum_squared = 0;
+    guint min = G_MAXUINT;
+    guint max = 0;
+    guint shift;
+
+    data = g_malloc (MAX (n_pixels * pixel_size, 1));
+    histogram = with_histogram ? g_new (guint32, n_bins) : NULL;
+    expected = g_new0 (guint32, n_bins);
+    shift = uca_statistics_get_shift (max_value, n_bins);
+
+    for (gsize i = 0; i < n_pixels; i++) {
+        guint v = g_random_int_range (0, (gint) MIN (max_value + 1, pixel_size == 1 ? 256 : 65536));
+
+        if (pixel_size == 1)
+            data[i] = v;
+        else
+            ((guint16 *) data)[i] = v;
+
+        min = MIN (min, v);
+        max = MAX (max, v);
+        sum += v;
+        sum_squared += (guint64) v * v;
+        expected[MIN (v >> shift, n_bins - 1)]++;
+    }
+
+    uca_statistics_compute (&stats, histogram, n_bins, shift, data, n_pixels, pixel_size, n_threads);
+
+    g_assert_cmpuint (stats.n_pixels, ==, n_pixels);
+    g_assert_cmpuint (stats.min, ==, n_pixels > 0 ? min : 0);
+    g_assert_cmpuint (stats.max, ==, max);
+    g_assert_cmpuint (stats.sum, ==, sum);
+    g_assert_cmpuint (stats.sum_squared, ==, sum_squared);
+
+    if (histogram != NULL) {
+        for (guint b = 0; b < n_bins; b++)
+            g_assert_cmpuint (histogram[b], ==, expected[b]);
+    }
+
+    g_free (expected);
+    g_free (histogram);
+    g_free (data);
+}
+
+static void
+test_shift (void)
+{
+    g_assert_cmpuint (uca_statistics_get_shift (255, 256), ==, 0);
+    g_assert_cmpuint (uca_statistics_get_shift (256, 256), ==, 1);
+    g_assert_cmpuint (uca_statistics_get_shift (4095, 256), ==, 4);
+    g_assert_cmpuint (uca_statistics_get_shift (65535, 256), ==, 8);
+    g_assert_cmpuint (uca_statistics_get_shift (65535, 65536), ==, 0);
+    g_assert_cmpuint (uca_statistics_get_shift (0, 1), ==, 0);
+}
+
+static void
+test_compute (void)
+{
+    /* Sizes that leave remainders after unrolling and after splitting */
+    const gsize sizes[] = {0, 1, 3, 4, 1023, 640 * 480 + 1, 2048 * 1024 + 3};
+    const guint n_bins[] = {1, 256, 65536};
+
+    for (guint i = 0; i < G_N_ELEMENTS (sizes); i++) {
+        for (guint j = 0; j < G_N_ELEMENTS (n_bins); j++) {
+            check_statistics (sizes[i], 1, 255, n_bins[j], 1, TRUE);
+            check_statistics (sizes[i], 2, 4095, n_bins[j], 1, TRUE);
+            check_statistics (sizes[i], 2, 65535, n_bins[j], 4, TRUE);
+        }
+
+        check_statistics (sizes[i], 2, 65535, 256, 3, FALSE);
+    }
+}
+
+static void
+test_clamped (void)
+{
+    UcaStatistics stats;
+    guint16 data[] = {0, 100, 5000, 65535};
+    guint32 histogram[4];
+
+    /* Values beyond the expected range end up in the last bin */
+    uca_statistics_compute (&stats, histogram, 4, uca_statistics_get_shift (1023, 4), data, 4, 2, 1);
+    g_assert_cmpuint (histogram[0], ==, 2);
+    g_assert_cmpuint (histogram[1], ==, 0);
+    g_assert_cmpuint (histogram[3], ==, 2);
+    g_assert_cmpuint (stats.max, ==, 65535);
+}
+
+static void
+check_region (guint frame_width, guint frame_height, guint x, guint y, guint width, guint height, guint n_threads)
+{
+    UcaStatistics stats;
+    guint16 *frame;
+    guint32 histogram[64];
+    guint32 expected[64] = { 0, };
+    guint64 sum = 0;
+    guint min = G_MAXUINT;
+    guint max = 0;
+
+    frame = g_new (guint16, frame_width * frame_height);
+
+    for (guint i = 0; i < frame_width * frame_height; i++)
+        frame[i] = g_random_int_range (0, 4096);
+
+    for (guint r = y; r < y + height; r++) {
+        for (guint c = x; c < x + width; c++) {
+            guint v = frame[r * frame_width + c];
+
+            min = MIN (min, v);
+            max = MAX (max, v);
+            sum += v;
+            expected[v >> 6]++;
+        }
+    }
+
+    uca_statistics_compute_region (&stats, histogram, 64, uca_statistics_get_shift (4095, 64),
+                                   frame + y * frame_width + x, width, height, frame_width, 2, n_threads);
+
+    g_assert_cmpuint (stats.n_pixels, ==, (guint64) width * height);
+    g_assert_cmpuint (stats.min, ==, width * height > 0 ? min : 0);
+    g_assert_cmpuint (stats.max, ==, max);
+    g_assert_cmpuint (stats.sum, ==, sum);
+
+    for (guint b = 0; b < 64; b++)
+        g_assert_cmpuint (histogram[b], ==, expected[b]);
+
+    g_free (frame);
+}
+
+static void
+test_region (void)
+{
+    check_region (64, 48, 0, 0, 64, 48, 1);
+    check_region (64, 48, 3, 5, 17, 9, 1);
+    check_region (64, 48, 63, 47, 1, 1, 2);
+    check_region (64, 48, 10, 10, 0, 5, 1);
+    check_region (2048, 1024, 100, 1, 1501, 1000, 4);
+    check_region (2048, 1024, 7, 0, 2041, 3, 4);
+}
+
+static void
+test_moments (void)
+{
+    UcaStatistics stats;
+    guint8 data[] = {2, 4, 4, 4, 5, 5, 7, 9};
+
+    uca_statistics_compute (&stats, NULL, 0, 0, data, G_N_ELEMENTS (data), 1, 1);
+    g_assert_cmpfloat (fabs (uca_statistics_get_mean (&stats) - 5.0), <, 1e-9);
+    g_assert_cmpfloat (fabs (uca_statistics_get_sigma (&stats) - sqrt (32.0 / 7.0)), <, 1e-9);
+}
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/statistics/shift", test_shift);
+    g_test_add_func ("/statistics/compute", test_compute);
+    g_test_add_func ("/statistics/clamped", test_clamped);
+    g_test_add_func ("/statistics/region", test_region);
+    g_test_add_func ("/statistics/moments", test_moments);
+
+    return g_test_run ();
+}
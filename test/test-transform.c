@@ -0,0 +1,110 @@
+#include <string.h>
+#include <glib.h>
+#include "uca-transform.h"
+
+static guint
+get_pixel (const guint8 *frame, guint pixel_size, gsize index)
+{
+    return pixel_size == 1 ? frame[index] : ((const guint16 *) frame)[index];
+}
+
+/* Compare against the definition: mirror first, then rotate clockwise */
+static void
+check_transform (guint width, guint height, guint pixel_size, gboolean mirror, guint rotate, gboolean in_place)
+{
+    guint8 *src;
+    guint8 *dst;
+    gsize size;
+    guint out_width, out_height;
+
+    size = (gsize) width * height * pixel_size;
+    src = g_malloc (size);
+    dst = g_malloc (size);
+
+    for (gsize i = 0; i < size; i++)
+        src[i] = g_random_int ();
+
+    if (in_place)
+        memcpy (dst, src, size);
+
+    uca_transform_frame (dst, in_place ? dst : src, width, height, pixel_size, mirror, rotate);
+
+    out_width = uca_transform_is_transposed (rotate) ? height : width;
+    out_height = uca_transform_is_transposed (rotate) ? width : height;
+
+    for (guint r = 0; r < out_height; r++) {
+        for (guint c = 0; c < out_width; c++) {
+            guint y, x;
+
+            switch (rotate) {
+                case 0:
+                    y = r;
+                    x = c;
+                    break;
+                case 1:
+                    y = height - 1 - c;
+                    x = r;
+                    break;
+                case 2:
+                    y = height - 1 - r;
+                    x = width - 1 - c;
+                    break;
+                default:
+                    y = c;
+                    x = width - 1 - r;
+                    break;
+            }
+
+            if (mirror)
+                x = width - 1 - x;
+
+            g_assert_cmpuint (get_pixel (dst, pixel_size, (gsize) r * out_width + c), ==,
+                              get_pixel (src, pixel_size, (gsize) y * width + x));
+        }
+    }
+
+    g_free (src);
+    g_free (dst);
+}
+
+static void
+test_transform (void)
+{
+    /* Sizes that hit partial 8x8 blocks, partial tiles and single rows */
+    const guint sizes[][2] = {{1, 1}, {7, 3}, {8, 8}, {16, 8}, {65, 67}, {130, 9}, {3, 200}, {513, 257}};
+
+    for (guint i = 0; i < G_N_ELEMENTS (sizes); i++) {
+        for (guint pixel_size = 1; pixel_size <= 2; pixel_size++) {
+            for (guint rotate = 0; rotate < 4; rotate++) {
+                check_transform (sizes[i][0], sizes[i][1], pixel_size, FALSE, rotate, FALSE);
+                check_transform (sizes[i][0], sizes[i][1], pixel_size, TRUE, rotate, FALSE);
+
+                if (!uca_transform_is_transposed (rotate)) {
+                    check_transform (sizes[i][0], sizes[i][1], pixel_size, FALSE, rotate, TRUE);
+                    check_transform (sizes[i][0], sizes[i][1], pixel_size, TRUE, rotate, TRUE);
+                }
+            }
+        }
+    }
+}
+
+static void
+test_identity (void)
+{
+    g_assert (uca_transform_is_identity (FALSE, 0));
+    g_assert (!uca_transform_is_identity (TRUE, 0));
+    g_assert (!uca_transform_is_identity (FALSE, 2));
+    g_assert (uca_transform_is_transposed (1));
+    g_assert (!uca_transform_is_transposed (2));
+}
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/transform/identity", test_identity);
+    g_test_add_func ("/transform/frame", test_transform);
+
+    return g_test_run ();
+}